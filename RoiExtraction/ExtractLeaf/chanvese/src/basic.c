@@ -16,6 +16,12 @@
 #include <stdarg.h>
 #include "basic.h"
 
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
 
 /** @brief malloc with an error message on failure. */
 void *MallocWithErrorMessage(size_t Size)
@@ -54,3 +60,49 @@ void ErrorMessage(const char *Format, ...)
     vfprintf(stderr, Format, Args);
     va_end(Args);
 }
+
+
+/**
+ * @brief Timer function that returns the current time in milliseconds
+ *
+ * The origin of the time is unspecified, so only differences between two
+ * calls are meaningful.  Differences should be computed in unsigned long
+ * arithmetic, which is correct across a wrap around of the counter.
+ */
+unsigned long Clock()
+{
+#if defined(WIN32) || defined(_WIN32) || defined(WIN64) || defined(_WIN64)
+    return (unsigned long)GetTickCount();
+#else
+    struct timeval TimeVal;
+    
+    gettimeofday(&TimeVal, NULL);
+    return ((unsigned long)TimeVal.tv_sec)*1000
+        + (unsigned long)(TimeVal.tv_usec/1000);
+#endif
+}
+
+
+/**
+ * @brief Detect instruction set extensions supported by the CPU
+ * @return bitwise OR of the CPU_* flags
+ *
+ * Detection is implemented with GCC builtins on x86 processors.  On other
+ * compilers or processors, the routine returns 0 so that only portable code
+ * paths are used.
+ */
+unsigned CpuFeatures()
+{
+    unsigned Features = 0;
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    
+    if(__builtin_cpu_supports("sse4.1"))
+        Features |= CPU_SSE41;
+    if(__builtin_cpu_supports("avx2"))
+        Features |= CPU_AVX2;
+#endif
+
+    return Features;
+}
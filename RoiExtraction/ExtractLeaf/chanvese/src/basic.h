@@ -172,4 +172,11 @@ void ErrorMessage(const char *Format, ...);
 /* Timer function */
 unsigned long Clock();
 
+/* CPU feature detection */
+/** @brief CpuFeatures flag for SSE4.1 support */
+#define CPU_SSE41   0x0001
+/** @brief CpuFeatures flag for AVX2 support */
+#define CPU_AVX2    0x0002
+unsigned CpuFeatures();
+
 #endif /* _BASIC_H_ */
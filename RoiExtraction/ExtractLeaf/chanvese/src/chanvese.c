@@ -21,57 +21,1767 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "chanvese.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "basic.h"
+#include "chanveseopt.h"
+#include "edt.h"
 
-#define Malloc(s)    malloc(s)
-#define Free(p)      free(p)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+/* Compile vectorized kernels, selected at runtime by CpuFeatures */
+#define CHANVESE_SIMD
+#include <immintrin.h>
+#endif
 
 #define DIVIDE_EPS       ((num)1e-16)
 
-#ifndef M_PI
-/** @brief The constant pi */
-#define M_PI        3.14159265358979323846264338327950288
-#endif
+/* Layout of the accumulators that each row update adds to */
+/** @brief Sum of the squared changes in Phi */
+#define ACC_PHIDIFF      0
+/** @brief Number of pixels where Phi changed sign */
+#define ACC_FLIPS        1
+/** @brief Change in the number of pixels with Phi >= 0 */
+#define ACC_COUNT1       2
+/** @brief Per-channel changes in the sums of f over pixels with Phi >= 0 */
+#define ACC_SUM1         3
+/** @brief Number of accumulators */
+#define ACC_SIZE(NumChannels)   (ACC_SUM1 + (NumChannels))
+/** @brief Iterations between exact recomputations of the region sums */
+#define REGION_REFRESH   64
+
+/** @brief Maximum number of channels handled by the vectorized kernels */
+#define SIMD_MAX_CHANNELS   4
+
+/** @brief Distance label of pixels outside of the narrow band */
+#define BAND_OUTSIDE        255
+
+/** @brief Pyramid levels are not made smaller than this width or height */
+#define PYRAMID_MIN_SIZE    16
+/** @brief Maximum number of pyramid levels */
+#define PYRAMID_MAX_LEVELS  16
+/** @brief Iterations at full resolution before the pyramid is built */
+#define PYRAMID_FIRST_ITER  1
+/** @brief Number of pixels per block when computing the data term */
+#define DATA_BLOCK          4096
+
+
+/** @brief Data shared by the row updates of one sweep */
+typedef struct sweepstruct
+{
+    /** @brief Scalar span kernel for the number of channels */
+    void (*SpanKernel)(const struct sweepstruct*, int, int, int, int,
+        double*);
+    /** @brief Vectorized kernel for red-black row interiors, or NULL */
+    void (*RowKernel)(const struct sweepstruct*, int, int, int, int,
+        double*, int*);
+    num *Phi;
+    const num *f;
+    /** @brief Data force plane, or NULL to compute the data term from f */
+    const num *Data;
+    const num *c1;
+    const num *c2;
+    long NumPixels;
+    int Width;
+    int Height;
+    int NumChannels;
+    num Mu;
+    num Nu;
+    num Lambda1;
+    num Lambda2;
+    num dt;
+} sweepdata;
+
+/** @brief Narrow band of pixels near the zero level set */
+typedef struct bandstruct
+{
+    /** @brief Distance of each pixel to the front, or BAND_OUTSIDE */
+    unsigned char *Dist;
+    /** @brief Queue for computing the distances */
+    long *Queue;
+    /** @brief Spans of row j are Span[2*s], Span[2*s+1] for
+        RowStart[j] <= s < RowStart[j+1] */
+    int *RowStart;
+    int *Span;
+    /** @brief Number of pixels in the band */
+    long NumPixels;
+    /** @brief Number of pixels on the front when the band was built */
+    long NumFront;
+} narrowband;
+
+/** @brief Data term computed from precomputed moments of f */
+typedef struct datastruct
+{
+    /** @brief Data force lambda2 |f - c2|^2 - lambda1 |f - c1|^2 */
+    num *Force;
+    /** @brief Squared norm |f|^2 of each pixel, or NULL if lambda1 = lambda2 */
+    num *NormSq;
+    /** @brief Weight of each channel in the inner product with f */
+    num *Weight;
+} dataterm;
+
+/** @brief Buffers for tiled sweeps */
+typedef struct tilestruct
+{
+    /** @brief Level set after the current time block */
+    num *PhiNext;
+    /** @brief Copy of Phi and f over a tile and its halo, for each thread */
+    num *Buffer;
+    /** @brief Accumulators of each tile, followed by scratch accumulators */
+    double *Acc;
+    /** @brief Number of num elements in the buffer of one thread */
+    long BufferSize;
+    int Size;
+    int Depth;
+    int NumTilesX;
+    int NumTiles;
+    int NumThreads;
+} tiledata;
+
+#ifdef __GNUC__
+int ChanVeseSimplePlot(int State, int Iter,
+    __attribute__((unused)) num Delta,
+    __attribute__((unused)) const num *c1,
+    __attribute__((unused)) const num *c2,
+    __attribute__((unused)) const num *Phi,
+    __attribute__((unused)) int Width,
+    __attribute__((unused)) int Height,
+    __attribute__((unused)) int NumChannels,
+    __attribute__((unused)) void *Param);
+#else
+int ChanVeseSimplePlot(int State, int Iter, num Delta,
+    const num *c1, const num *c2,
+    const num *Phi,
+    int Width,
+    int Height,
+    int NumChannels,
+    void *Param);
+#endif
+
+/** @brief Default options struct */
+static struct chanvesestruct DefaultChanVeseOpt =
+        {(num)1e-3, 0, 0, 500, (num)0.25, 0, 1, 1, (num)0.5, 0,
+        CHANVESE_BACKEND_LEVELSET, 8, CHANVESE_DATA_DIRECT, CHANVESE_SWEEP_SERIAL,
+        0, 128, 4, 0, 1, 0, 20, 0, 0, 0, NULL, NULL, ChanVeseSimplePlot, NULL};
+        
+
+/* Scalar span kernels for one and three channels and for any number of
+   channels, see chanvesespan.h */
+#define SPAN_NAME           UpdateSpan1
+#define SPAN_CHANNELS       1
+#include "chanvesespan.h"
+#undef SPAN_NAME
+#undef SPAN_CHANNELS
+
+#define SPAN_NAME           UpdateSpan3
+#define SPAN_CHANNELS       3
+#include "chanvesespan.h"
+#undef SPAN_NAME
+#undef SPAN_CHANNELS
+
+#define SPAN_NAME           UpdateSpanN
+#include "chanvesespan.h"
+#undef SPAN_NAME
+
+
+/**
+ * @brief Semi-implicit update of a span of Phi, vectorized if possible
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param j the row to update
+ * @param i0, i1 range of pixels [i0, i1) to update
+ * @param Color which pixels to update (see chanvesespan.h)
+ * @param Acc accumulators for the row
+ *
+ * For red-black sweeps, the interior of the span is updated with the
+ * vectorized kernel if one is available.  The one-pixel image border, where
+ * the stencil is clamped, is always updated with the scalar code.
+ */
+static void UpdateRow(const sweepdata *Sweep, int j, int i0, int i1,
+    int Color, double *Acc)
+{
+    const int Width = Sweep->Width;
+    int i;
+    
+    if(!Sweep->RowKernel || Color < 0
+        || j == 0 || j == Sweep->Height - 1 || Width < 3)
+        Sweep->SpanKernel(Sweep, j, i0, i1, Color, Acc);
+    else
+    {
+        i = (i0 < 1) ? 1 : i0;
+        
+        if(i0 < i)
+            Sweep->SpanKernel(Sweep, j, i0, i, Color, Acc);
+        
+        Sweep->RowKernel(Sweep, j, i, (i1 < Width - 1) ? i1 : Width - 1,
+            Color, Acc, &i);
+        Sweep->SpanKernel(Sweep, j, i, i1, Color, Acc);
+    }
+}
+
+
+/**
+ * @brief Update the pixels of one row that are in the narrow band
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param Band the narrow band, or NULL to update the whole row
+ * @param j the row to update
+ * @param Color which pixels to update (see chanvesespan.h)
+ * @param Acc accumulators for the row
+ */
+static void UpdateBandRow(const sweepdata *Sweep, const narrowband *Band,
+    int j, int Color, double *Acc)
+{
+    int s;
+    
+    if(!Band)
+        UpdateRow(Sweep, j, 0, Sweep->Width, Color, Acc);
+    else
+        for(s = Band->RowStart[j]; s < Band->RowStart[j + 1]; s++)
+            UpdateRow(Sweep, j, Band->Span[2*s], Band->Span[2*s + 1],
+                Color, Acc);
+}
+
+
+#ifdef CHANVESE_SIMD
+#ifdef NUM_SINGLE
+/* AVX2 kernel, 8 floats at a time */
+#define KERNEL_NAME         UpdateRowAvx2
+#define KERNEL_TARGET       __attribute__((target("avx2")))
+#define VNUM                __m256
+#define VWIDTH              8
+#define VLOAD               _mm256_loadu_ps
+#define VSTORE              _mm256_storeu_ps
+#define VSET1               _mm256_set1_ps
+#define VADD                _mm256_add_ps
+#define VSUB                _mm256_sub_ps
+#define VMUL                _mm256_mul_ps
+#define VDIV                _mm256_div_ps
+#define VSQRT               _mm256_sqrt_ps
+#define VBLEND              _mm256_blendv_ps
+#define VAND                _mm256_and_ps
+#define VXOR                _mm256_xor_ps
+#define VCMPGE(a,b)         _mm256_cmp_ps(a, b, _CMP_GE_OQ)
+#define VEVENMASK           _mm256_castsi256_ps( \
+    _mm256_set_epi32(0, -1, 0, -1, 0, -1, 0, -1))
+#define VODDMASK            _mm256_castsi256_ps( \
+    _mm256_set_epi32(-1, 0, -1, 0, -1, 0, -1, 0))
+#include "chanvesesimd.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VNUM
+#undef VWIDTH
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VBLEND
+#undef VAND
+#undef VXOR
+#undef VCMPGE
+#undef VEVENMASK
+#undef VODDMASK
+
+/* SSE4.1 kernel, 4 floats at a time */
+#define KERNEL_NAME         UpdateRowSse41
+#define KERNEL_TARGET       __attribute__((target("sse4.1")))
+#define VNUM                __m128
+#define VWIDTH              4
+#define VLOAD               _mm_loadu_ps
+#define VSTORE              _mm_storeu_ps
+#define VSET1               _mm_set1_ps
+#define VADD                _mm_add_ps
+#define VSUB                _mm_sub_ps
+#define VMUL                _mm_mul_ps
+#define VDIV                _mm_div_ps
+#define VSQRT               _mm_sqrt_ps
+#define VBLEND              _mm_blendv_ps
+#define VAND                _mm_and_ps
+#define VXOR                _mm_xor_ps
+#define VCMPGE              _mm_cmpge_ps
+#define VEVENMASK           _mm_castsi128_ps(_mm_set_epi32(0, -1, 0, -1))
+#define VODDMASK            _mm_castsi128_ps(_mm_set_epi32(-1, 0, -1, 0))
+#include "chanvesesimd.h"
+#else
+/* AVX2 kernel, 4 doubles at a time */
+#define KERNEL_NAME         UpdateRowAvx2
+#define KERNEL_TARGET       __attribute__((target("avx2")))
+#define VNUM                __m256d
+#define VWIDTH              4
+#define VLOAD               _mm256_loadu_pd
+#define VSTORE              _mm256_storeu_pd
+#define VSET1               _mm256_set1_pd
+#define VADD                _mm256_add_pd
+#define VSUB                _mm256_sub_pd
+#define VMUL                _mm256_mul_pd
+#define VDIV                _mm256_div_pd
+#define VSQRT               _mm256_sqrt_pd
+#define VBLEND              _mm256_blendv_pd
+#define VAND                _mm256_and_pd
+#define VXOR                _mm256_xor_pd
+#define VCMPGE(a,b)         _mm256_cmp_pd(a, b, _CMP_GE_OQ)
+#define VEVENMASK           _mm256_castsi256_pd( \
+    _mm256_set_epi32(0, 0, -1, -1, 0, 0, -1, -1))
+#define VODDMASK            _mm256_castsi256_pd( \
+    _mm256_set_epi32(-1, -1, 0, 0, -1, -1, 0, 0))
+#include "chanvesesimd.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VNUM
+#undef VWIDTH
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VSUB
+#undef VMUL
+#undef VDIV
+#undef VSQRT
+#undef VBLEND
+#undef VAND
+#undef VXOR
+#undef VCMPGE
+#undef VEVENMASK
+#undef VODDMASK
+
+/* SSE4.1 kernel, 2 doubles at a time */
+#define KERNEL_NAME         UpdateRowSse41
+#define KERNEL_TARGET       __attribute__((target("sse4.1")))
+#define VNUM                __m128d
+#define VWIDTH              2
+#define VLOAD               _mm_loadu_pd
+#define VSTORE              _mm_storeu_pd
+#define VSET1               _mm_set1_pd
+#define VADD                _mm_add_pd
+#define VSUB                _mm_sub_pd
+#define VMUL                _mm_mul_pd
+#define VDIV                _mm_div_pd
+#define VSQRT               _mm_sqrt_pd
+#define VBLEND              _mm_blendv_pd
+#define VAND                _mm_and_pd
+#define VXOR                _mm_xor_pd
+#define VCMPGE              _mm_cmpge_pd
+#define VEVENMASK           _mm_castsi128_pd(_mm_set_epi32(0, 0, -1, -1))
+#define VODDMASK            _mm_castsi128_pd(_mm_set_epi32(-1, -1, 0, 0))
+#include "chanvesesimd.h"
+#endif
+#endif /* CHANVESE_SIMD */
+
+
+/**
+ * @brief Select the span kernel and the fastest row kernel
+ *
+ * The span kernel is specialized for the number of channels, and the row
+ * kernel is the vectorized kernel for the instruction sets supported by the
+ * CPU.  Both are selected once per segmentation, so that the row updates do
+ * not test the number of channels per pixel.
+ */
+static void SelectKernels(sweepdata *Sweep)
+{
+#ifdef CHANVESE_SIMD
+    unsigned Features = CpuFeatures();
+#endif
+    
+    if(Sweep->NumChannels == 1)
+        Sweep->SpanKernel = UpdateSpan1;
+    else if(Sweep->NumChannels == 3)
+        Sweep->SpanKernel = UpdateSpan3;
+    else
+        Sweep->SpanKernel = UpdateSpanN;
+
+#ifdef CHANVESE_SIMD
+    if(Sweep->NumChannels > SIMD_MAX_CHANNELS)
+        Sweep->RowKernel = NULL;
+    else if(Features & CPU_AVX2)
+        Sweep->RowKernel = UpdateRowAvx2;
+    else if(Features & CPU_SSE41)
+        Sweep->RowKernel = UpdateRowSse41;
+    else
+        Sweep->RowKernel = NULL;
+#else
+    Sweep->RowKernel = NULL;
+#endif
+}
+
+
+/**
+ * @brief Initialize the sign change test
+ * @param Test the test to initialize
+ * @param Opt chanveseopt options object
+ * @param NumPixels number of pixels in the image
+ * @param Ws workspace the history is allocated from
+ * @return 1 on success, 0 on failure
+ */
+int FlipTestInit(fliptest *Test, const chanveseopt *Opt, long NumPixels,
+    workspace *Ws)
+{
+    int k;
+    
+    Test->History = NULL;
+    Test->Sum = 0;
+    Test->MaxFlips = Opt->FlipTol*NumPixels;
+    Test->Window = Opt->FlipWindow;
+    
+    if(Test->Window <= 0)
+        return 1;
+    else if(!(Test->History = (long *)WorkspaceAlloc(Ws,
+        sizeof(long)*Test->Window)))
+        return 0;
+    
+    for(k = 0; k < Test->Window; k++)
+        Test->History[k] = 0;
+    
+    return 1;
+}
+
+
+/**
+ * @brief Update the sign change test after an iteration
+ * @param Test the sign change test
+ * @param Iter the iteration number, starting from 1
+ * @param Flips number of pixels that changed sign in this iteration
+ * @return 1 if the test passed and the iterations should stop
+ */
+int FlipTestUpdate(fliptest *Test, int Iter, double Flips)
+{
+    int k;
+    
+    if(!Test->History)
+        return 0;
+    
+    k = Iter % Test->Window;
+    Test->Sum += Flips - Test->History[k];
+    Test->History[k] = (long)Flips;
+    return (Iter >= Test->Window && Test->Sum <= Test->MaxFlips);
+}
+
+
+/**
+ * @brief Test whether the time budget of ChanVeseSetDeadline is spent
+ * @param Opt chanveseopt options object
+ * @param StartTime the Clock() time when the segmentation started
+ * @return 1 if a deadline is set and has been reached
+ */
+int DeadlineReached(const chanveseopt *Opt, unsigned long StartTime)
+{
+    return Opt->Deadline > 0
+        && Clock() - StartTime >= (unsigned long)Opt->Deadline;
+}
+
+
+/**
+ * @brief Chan-Vese energy of the segmentation given by the sign of Phi
+ * @param Phi, f, Width, Height, NumChannels the level set and image
+ * @param Opt chanveseopt options object
+ * @return the energy
+ *
+ * The energy is evaluated with c1 and c2 equal to the region averages,
+ * which minimize it for the given segmentation.  The length is measured as
+ * in graphcut.c with the Cauchy-Crofton formula on the 4-neighborhood, that
+ * is, pi/4 times the number of pairs of 4-neighbors of opposite signs.
+ */
+static double SegmentationEnergy(const num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    double Sum1, Sum2, Square1, Square2, Energy;
+    long n, Count1 = 0, Edges = 0;
+    int i, j, Channel, Inside;
+    
+    for(j = 0, n = 0; j < Height; j++)
+        for(i = 0; i < Width; i++, n++)
+        {
+            Inside = (Phi[n] >= 0);
+            Count1 += Inside;
+            
+            if(i < Width - 1 && (Phi[n + 1] >= 0) != Inside)
+                Edges++;
+            if(j < Height - 1 && (Phi[n + Width] >= 0) != Inside)
+                Edges++;
+        }
+    
+    Energy = Opt->Mu*M_PI_4*Edges + Opt->Nu*Count1;
+    
+    /* Over a region with average c, the sum of |f - c|^2 is
+       sum f^2 - (sum f)^2 / count */
+    for(Channel = 0; Channel < NumChannels; Channel++, f += NumPixels)
+    {
+        Sum1 = Sum2 = Square1 = Square2 = 0;
+        
+        for(n = 0; n < NumPixels; n++)
+            if(Phi[n] >= 0)
+            {
+                Sum1 += f[n];
+                Square1 += ((double)f[n])*f[n];
+            }
+            else
+            {
+                Sum2 += f[n];
+                Square2 += ((double)f[n])*f[n];
+            }
+        
+        if(Count1 > 0)
+            Energy += Opt->Lambda1*(Square1 - Sum1*Sum1/Count1);
+        if(Count1 < NumPixels)
+            Energy += Opt->Lambda2*(Square2 - Sum2*Sum2/(NumPixels - Count1));
+    }
+    
+    return Energy;
+}
+
+
+/** @brief Compute the sum of each channel of f over the whole image */
+static void ChannelSums(double *Total, const num *f,
+    long NumPixels, int NumChannels)
+{
+    long n;
+    int Channel;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++, f += NumPixels)
+        for(n = 0, Total[Channel] = 0; n < NumPixels; n++)
+            Total[Channel] += f[n];
+}
+
+
+/**
+ * @brief Exact count and sums of f over the pixels with Phi >= 0
+ * @param Region set to the count at ACC_COUNT1 and the sums at ACC_SUM1
+ * @param Phi, f, NumPixels, NumChannels the level set and image
+ */
+static void RegionSums(double *Region, const num *Phi, const num *f,
+    long NumPixels, int NumChannels)
+{
+    long n;
+    int Channel;
+    
+    for(n = 0, Region[ACC_COUNT1] = 0; n < NumPixels; n++)
+        if(Phi[n] >= 0)
+            Region[ACC_COUNT1]++;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++, f += NumPixels)
+        for(n = 0, Region[ACC_SUM1 + Channel] = 0; n < NumPixels; n++)
+            if(Phi[n] >= 0)
+                Region[ACC_SUM1 + Channel] += f[n];
+}
+
+
+/** @brief Add up the accumulators of all rows */
+static void SumRows(double *Sum, const double *RowAcc,
+    int AccStride, int Height)
+{
+    int j, k;
+    
+    for(k = 0; k < AccStride; k++)
+        Sum[k] = 0;
+    
+    for(j = 0; j < Height; j++, RowAcc += AccStride)
+        for(k = 0; k < AccStride; k++)
+            Sum[k] += RowAcc[k];
+}
+
+
+/**
+ * @brief Reinitialize Phi to a normalized signed distance
+ * @param Edt distance transform for the size of Phi
+ * @param Phi the level set, modified in place
+ * @param NumPixels number of pixels in Phi
+ *
+ * The distances are divided by the largest one so that Phi is within
+ * [-1,1], the range of the initializations.  In pixel units, the
+ * regularized delta function 1/(pi (1 + Phi^2)) would vanish a few pixels
+ * away from the curve, and with the default dt the curve would barely move.
+ */
+static void ReinitPhi(edt *Edt, num *Phi, long NumPixels)
+{
+    num Max = 0;
+    long n;
+    
+    EdtSignedDistance(Edt, Phi);
+    
+    for(n = 0; n < NumPixels; n++)
+        if(fabs(Phi[n]) > Max)
+            Max = (num)fabs(Phi[n]);
+    
+    if(Max > 0)
+        for(n = 0; n < NumPixels; n++)
+            Phi[n] /= Max;
+}
+
+
+/**
+ * @brief Region averages from the sums inside the curve
+ * @param c1, c2 the averages inside and outside the curve
+ * @param Sum count and sums inside the curve at ACC_COUNT1 and ACC_SUM1,
+ *    followed by the sums over the whole image at ACC_SIZE(NumChannels)
+ * @param NumPixels, NumChannels the size of the image
+ */
+static void AveragesFromSums(num *c1, num *c2, const double *Sum,
+    long NumPixels, int NumChannels)
+{
+    const double *Total = Sum + ACC_SIZE(NumChannels);
+    const double Count1 = Sum[ACC_COUNT1];
+    const double Count2 = NumPixels - Count1;
+    int Channel;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+    {
+        c1[Channel] = (Count1 > 0) ?
+            (num)(Sum[ACC_SUM1 + Channel]/Count1) : 0;
+        c2[Channel] = (Count2 > 0) ?
+            (num)((Total[Channel] - Sum[ACC_SUM1 + Channel])/Count2) : 0;
+    }
+}
+
+
+/** @brief Allocate the narrow band arrays, returns 1 on success */
+static int AllocBand(narrowband *Band, int Width, int Height, workspace *Ws)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    
+    Band->NumPixels = Band->NumFront = 0;
+    
+    /* A row has at most (Width + 1)/2 spans */
+    return (Band->Dist = (unsigned char *)WorkspaceAlloc(Ws, NumPixels))
+        && (Band->Queue = (long *)WorkspaceAlloc(Ws, sizeof(long)*NumPixels))
+        && (Band->RowStart = (int *)WorkspaceAlloc(Ws,
+            sizeof(int)*(Height + 1)))
+        && (Band->Span = (int *)WorkspaceAlloc(Ws,
+            sizeof(int)*2*Height*((Width + 1)/2)));
+}
+
+
+/** @brief Test whether a pixel has a 4-neighbor of opposite sign */
+static int OnFront(const num *Phi, int Width, int Height, int i, int j)
+{
+    const long n = i + ((long)Width)*j;
+    const int Inside = (Phi[n] >= 0);
+    
+    return (i > 0 && (Phi[n - 1] >= 0) != Inside)
+        || (i < Width - 1 && (Phi[n + 1] >= 0) != Inside)
+        || (j > 0 && (Phi[n - Width] >= 0) != Inside)
+        || (j < Height - 1 && (Phi[n + Width] >= 0) != Inside);
+}
+
+
+/**
+ * @brief Build the narrow band around the current zero level set
+ * @param Band the narrow band
+ * @param BandWidth half-width of the band in pixels
+ * @param Phi, Width, Height the level set
+ *
+ * The band is the set of pixels within city block distance BandWidth of a
+ * pixel on the front, i.e. of a pixel having a 4-neighbor of opposite sign.
+ * The distances are computed by breadth-first search from the front.  The
+ * pixels outside the band are not updated until the next rebuild, so they
+ * do not change sign and do not contribute to the region sums.
+ */
+static void BuildBand(narrowband *Band, int BandWidth,
+    const num *Phi, int Width, int Height)
+{
+    unsigned char *Dist = Band->Dist;
+    long *Queue = Band->Queue;
+    long n, Head, Tail = 0;
+    int i, j, s = 0;
+    
+    for(j = 0, n = 0; j < Height; j++)
+        for(i = 0; i < Width; i++, n++)
+            if(OnFront(Phi, Width, Height, i, j))
+            {
+                Dist[n] = 0;
+                Queue[Tail++] = n;
+            }
+            else
+                Dist[n] = BAND_OUTSIDE;
+    
+    Band->NumFront = Tail;
+    
+    for(Head = 0; Head < Tail; Head++)
+    {
+        n = Queue[Head];
+        
+        if(Dist[n] >= BandWidth)
+            continue;
+        
+        i = (int)(n % Width);
+        j = (int)(n / Width);
+        
+        if(i > 0 && Dist[n - 1] == BAND_OUTSIDE)
+        {
+            Dist[n - 1] = Dist[n] + 1;
+            Queue[Tail++] = n - 1;
+        }
+        if(i < Width - 1 && Dist[n + 1] == BAND_OUTSIDE)
+        {
+            Dist[n + 1] = Dist[n] + 1;
+            Queue[Tail++] = n + 1;
+        }
+        if(j > 0 && Dist[n - Width] == BAND_OUTSIDE)
+        {
+            Dist[n - Width] = Dist[n] + 1;
+            Queue[Tail++] = n - Width;
+        }
+        if(j < Height - 1 && Dist[n + Width] == BAND_OUTSIDE)
+        {
+            Dist[n + Width] = Dist[n] + 1;
+            Queue[Tail++] = n + Width;
+        }
+    }
+    
+    Band->NumPixels = Tail;
+    
+    /* Split the band into spans */
+    for(j = 0, n = 0; j < Height; j++)
+    {
+        Band->RowStart[j] = s;
+        
+        for(i = 0; i < Width; i++, n++)
+            if(Dist[n] != BAND_OUTSIDE)
+            {
+                if(i == 0 || Dist[n - 1] == BAND_OUTSIDE)
+                    Band->Span[2*s] = i;
+                if(i == Width - 1 || Dist[n + 1] == BAND_OUTSIDE)
+                    Band->Span[2*(s++) + 1] = i + 1;
+            }
+    }
+    
+    Band->RowStart[Height] = s;
+}
+
+
+/**
+ * @brief Test whether the narrow band needs to be rebuilt
+ * @return 1 if the band should be rebuilt
+ *
+ * The band is rebuilt when the front has moved into the outer half of the
+ * band, or when the front has shrunk to less than half of its length at the
+ * last rebuild (e.g., as small spurious components vanish), so that the band
+ * follows the front as it moves and as it gets shorter.
+ */
+static int BandNeedsRebuild(const narrowband *Band, int BandWidth,
+    const num *Phi, int Width, int Height)
+{
+    const int EdgeDist = (BandWidth + 1)/2;
+    long NumFront = 0;
+    int i, j, s;
+    
+    for(j = 0; j < Height; j++)
+        for(s = Band->RowStart[j]; s < Band->RowStart[j + 1]; s++)
+            for(i = Band->Span[2*s]; i < Band->Span[2*s + 1]; i++)
+                if(OnFront(Phi, Width, Height, i, j))
+                {
+                    if(Band->Dist[i + ((long)Width)*j] >= EdgeDist)
+                        return 1;
+                    
+                    NumFront++;
+                }
+    
+    return (2*NumFront < Band->NumFront);
+}
+
+
+#ifdef _OPENMP
+/** @brief Number of threads to use, see ChanVeseSetNumThreads */
+static int GetNumThreads(const chanveseopt *Opt)
+{
+    return (Opt->NumThreads > 0) ? Opt->NumThreads : omp_get_num_procs();
+}
+#endif
+
+
+/**
+ * @brief Allocate the data term and precompute the moments of f
+ * @param Data the data term
+ * @param f, NumPixels, NumChannels the image
+ * @param Opt chanveseopt options object
+ * @param Ws workspace the arrays are allocated from
+ * @return 1 on success, 0 on failure
+ *
+ * The squared norm |f|^2 of each pixel is only needed if lambda1 differs
+ * from lambda2, otherwise it cancels out of the data term.
+ */
+static int AllocDataTerm(dataterm *Data, const num *f,
+    long NumPixels, int NumChannels, const chanveseopt *Opt, workspace *Ws)
+{
+    long n;
+    int Channel;
+    
+    Data->NormSq = NULL;
+    
+    if(!(Data->Force = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Data->Weight = (num *)WorkspaceAlloc(Ws,
+            sizeof(num)*NumChannels)))
+        return 0;
+    
+    if(Opt->Lambda1 != Opt->Lambda2)
+    {
+        if(!(Data->NormSq = (num *)WorkspaceAlloc(Ws,
+            sizeof(num)*NumPixels)))
+            return 0;
+        
+        for(n = 0; n < NumPixels; n++)
+            Data->NormSq[n] = 0;
+        
+        for(Channel = 0; Channel < NumChannels; Channel++, f += NumPixels)
+            for(n = 0; n < NumPixels; n++)
+                Data->NormSq[n] += f[n]*f[n];
+    }
+    
+    return 1;
+}
+
+
+/**
+ * @brief Compute the data force for the current region averages
+ * @param Data the data term
+ * @param f, NumPixels, NumChannels the image
+ * @param c1, c2 the region averages
+ * @param Lambda1, Lambda2 the data term weights
+ * @param NumThreads number of threads to use
+ *
+ * Expanding the squares,
+ *
+ *    lambda2 |f - c2|^2 - lambda1 |f - c1|^2 = (lambda2 - lambda1) |f|^2
+ *       + 2 <f, lambda1 c1 - lambda2 c2> + lambda2 |c2|^2 - lambda1 |c1|^2.
+ *
+ * With |f|^2 precomputed, the force is a constant plus one multiply-add per
+ * channel, computed here one plane at a time over blocks of DATA_BLOCK
+ * pixels so that the sweep only reads one value per pixel.
+ */
+static void UpdateDataTerm(dataterm *Data, const num *f,
+    long NumPixels, int NumChannels, const num *c1, const num *c2,
+    num Lambda1, num Lambda2, int NumThreads)
+{
+    const int NumBlocks = (int)((NumPixels + DATA_BLOCK - 1)/DATA_BLOCK);
+    const num Scale = Lambda2 - Lambda1;
+    num *Force = Data->Force;
+    const num *NormSq = Data->NormSq;
+    const num *fPtr;
+    num Weight, Offset = 0;
+    long n, n0, n1;
+    int Block, Channel;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+    {
+        Data->Weight[Channel] = 2*(Lambda1*c1[Channel] - Lambda2*c2[Channel]);
+        Offset += Lambda2*c2[Channel]*c2[Channel]
+            - Lambda1*c1[Channel]*c1[Channel];
+    }
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(static) if(NumThreads > 1) \
+        num_threads(NumThreads) private(n, n0, n1, Channel, fPtr, Weight)
+#else
+    (void)NumThreads;
+#endif
+    for(Block = 0; Block < NumBlocks; Block++)
+    {
+        n0 = ((long)Block)*DATA_BLOCK;
+        n1 = (n0 + DATA_BLOCK < NumPixels) ? n0 + DATA_BLOCK : NumPixels;
+        
+        if(NormSq)
+            for(n = n0; n < n1; n++)
+                Force[n] = Offset + Scale*NormSq[n];
+        else
+            for(n = n0; n < n1; n++)
+                Force[n] = Offset;
+        
+        for(Channel = 0, fPtr = f; Channel < NumChannels;
+            Channel++, fPtr += NumPixels)
+            for(n = n0, Weight = Data->Weight[Channel]; n < n1; n++)
+                Force[n] += Weight*fPtr[n];
+    }
+}
+
+
+/** @brief Allocate the buffers for tiled sweeps, returns 1 on success */
+static int AllocTiles(tiledata *Tiles, const chanveseopt *Opt,
+    int Width, int Height, int NumChannels, workspace *Ws)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    long Side;
+    
+    Tiles->Size = (Opt->TileSize > 0) ? Opt->TileSize : 1;
+    Tiles->Depth = (Opt->TileDepth > 0) ? Opt->TileDepth : 1;
+    Tiles->NumTilesX = (Width + Tiles->Size - 1)/Tiles->Size;
+    Tiles->NumTiles = Tiles->NumTilesX
+        * ((Height + Tiles->Size - 1)/Tiles->Size);
+#ifdef _OPENMP
+    Tiles->NumThreads = GetNumThreads(Opt);
+#else
+    Tiles->NumThreads = 1;
+#endif
+    /* Each iteration is two red-black half-sweeps, and each half-sweep
+       invalidates one more pixel from the edge of the buffer */
+    Side = Tiles->Size + 4*Tiles->Depth;
+    Tiles->BufferSize = Side*Side*(2 + NumChannels);
+    
+    if(Tiles->BufferSize > NumPixels*(2 + NumChannels))
+        Tiles->BufferSize = NumPixels*(2 + NumChannels);
+    
+    return (Tiles->PhiNext = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        && (Tiles->Buffer = (num *)WorkspaceAlloc(Ws, sizeof(num)
+            *Tiles->BufferSize*Tiles->NumThreads))
+        && (Tiles->Acc = (double *)WorkspaceAlloc(Ws, sizeof(double)
+            *ACC_SIZE(NumChannels)*(Tiles->NumTiles + Tiles->NumThreads)));
+}
+
+
+/**
+ * @brief Run several red-black iterations on one tile
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param Tiles the tile buffers
+ * @param Tile index of the tile
+ * @param Depth number of iterations
+ * @param Buffer buffer of the calling thread
+ * @param Acc accumulators for the tile
+ * @param Scratch accumulators for the pixels outside the tile
+ *
+ * The tile and a halo of 2*Depth pixels around it are copied to Buffer,
+ * along with f and the data force if there is one,
+ * where the iterations are done with the usual red-black row updates.  Each
+ * half-sweep updates the pixels within one pixel less of the tile than the
+ * previous one, so that the pixels it reads from the previous half-sweep
+ * are always up to date.  The updated tile is written to Tiles->PhiNext.
+ * The squared changes and sign changes of the last iteration over the tile
+ * and the changes in the region sums over the whole block are added to Acc.
+ */
+static void UpdateTile(const sweepdata *Sweep, const tiledata *Tiles,
+    int Tile, int Depth, num *Buffer, double *Acc, double *Scratch)
+{
+    const int Halo = 2*Depth;
+    const int ti0 = (Tile % Tiles->NumTilesX)*Tiles->Size;
+    const int tj0 = (Tile / Tiles->NumTilesX)*Tiles->Size;
+    const int ti1 = (ti0 + Tiles->Size < Sweep->Width) ?
+        ti0 + Tiles->Size : Sweep->Width;
+    const int tj1 = (tj0 + Tiles->Size < Sweep->Height) ?
+        tj0 + Tiles->Size : Sweep->Height;
+    const int x0 = (ti0 > Halo) ? ti0 - Halo : 0;
+    const int y0 = (tj0 > Halo) ? tj0 - Halo : 0;
+    const int x1 = (ti1 + Halo < Sweep->Width) ? ti1 + Halo : Sweep->Width;
+    const int y1 = (tj1 + Halo < Sweep->Height) ? tj1 + Halo : Sweep->Height;
+    sweepdata Local = *Sweep;
+    num *Dest = Buffer;
+    const num *Src, *Old, *fPtr;
+    int i, j, k, Color, LocalColor, Grow, i0, i1, j0, j1, Channel, Sign;
+    
+    Local.Width = x1 - x0;
+    Local.Height = y1 - y0;
+    Local.NumPixels = ((long)Local.Width) * ((long)Local.Height);
+    Local.Phi = Buffer;
+    Local.f = Buffer + Local.NumPixels;
+    
+    if(Sweep->Data)
+        Local.Data = Local.f + Local.NumPixels*Sweep->NumChannels;
+    
+    for(Channel = -1; Channel < Sweep->NumChannels
+        + ((Sweep->Data) ? 1 : 0); Channel++)
+    {
+        Src = (Channel < 0) ? Sweep->Phi : (Channel == Sweep->NumChannels) ?
+            Sweep->Data : Sweep->f + Sweep->NumPixels*Channel;
+        
+        for(j = y0, Src += ((long)Sweep->Width)*y0 + x0; j < y1;
+            j++, Src += Sweep->Width, Dest += Local.Width)
+            memcpy(Dest, Src, sizeof(num)*Local.Width);
+    }
+    
+    for(k = 1; k <= Depth; k++)
+        for(Color = 0; Color < 2; Color++)
+        {
+            Grow = 2*(Depth - k) + 1 - Color;
+            LocalColor = (Color + x0 + y0) & 1;
+            i0 = ((ti0 - Grow > x0) ? ti0 - Grow : x0) - x0;
+            i1 = ((ti1 + Grow < x1) ? ti1 + Grow : x1) - x0;
+            j0 = ((tj0 - Grow > y0) ? tj0 - Grow : y0) - y0;
+            j1 = ((tj1 + Grow < y1) ? tj1 + Grow : y1) - y0;
+            
+            for(j = j0; j < j1; j++)
+                if(k < Depth || j < tj0 - y0 || j >= tj1 - y0)
+                    UpdateRow(&Local, j, i0, i1, LocalColor, Scratch);
+                else
+                {
+                    /* Accumulate the last iteration over the tile only */
+                    if(i0 < ti0 - x0)
+                        UpdateRow(&Local, j, i0, ti0 - x0,
+                            LocalColor, Scratch);
+                    
+                    UpdateRow(&Local, j, ti0 - x0, ti1 - x0,
+                        LocalColor, Acc);
+                    
+                    if(ti1 - x0 < i1)
+                        UpdateRow(&Local, j, ti1 - x0, i1,
+                            LocalColor, Scratch);
+                }
+        }
+    
+    /* The changes in the region sums accumulated by the last iteration
+       are replaced by the net changes over the whole block */
+    for(Channel = ACC_COUNT1; Channel < ACC_SIZE(Sweep->NumChannels);
+        Channel++)
+        Acc[Channel] = 0;
+    
+    for(j = tj0, Dest = Tiles->PhiNext + ((long)Sweep->Width)*tj0 + ti0,
+        Old = Sweep->Phi + ((long)Sweep->Width)*tj0 + ti0,
+        Src = Buffer + ((long)Local.Width)*(tj0 - y0) + (ti0 - x0);
+        j < tj1; j++, Dest += Sweep->Width, Old += Sweep->Width,
+        Src += Local.Width)
+    {
+        for(i = 0; i < ti1 - ti0; i++)
+            if((Src[i] >= 0) != (Old[i] >= 0))
+            {
+                Sign = (Src[i] >= 0) ? 1 : -1;
+                Acc[ACC_COUNT1] += Sign;
+                
+                for(Channel = 0, fPtr = Sweep->f + (Old - Sweep->Phi) + i;
+                    Channel < Sweep->NumChannels;
+                    Channel++, fPtr += Sweep->NumPixels)
+                    Acc[ACC_SUM1 + Channel] += Sign*fPtr[0];
+            }
+        
+        memcpy(Dest, Src, sizeof(num)*(ti1 - ti0));
+    }
+}
+
+
+/**
+ * @brief Advance Phi by a block of iterations, one tile at a time
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param Tiles the tile buffers
+ * @param Depth number of iterations
+ * @param Sum set to the sum of the accumulators (see UpdateTile)
+ *
+ * The tiles are independent and are updated concurrently.  On return,
+ * the new level set is in Tiles->PhiNext.
+ */
+static void TiledSweep(const sweepdata *Sweep, tiledata *Tiles,
+    int Depth, double *Sum)
+{
+    const int AccStride = ACC_SIZE(Sweep->NumChannels);
+    long k;
+    int Tile, Thread = 0;
+    
+    for(k = 0; k < AccStride*Tiles->NumTiles; k++)
+        Tiles->Acc[k] = 0;
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) \
+        num_threads(Tiles->NumThreads) firstprivate(Thread)
+#endif
+    for(Tile = 0; Tile < Tiles->NumTiles; Tile++)
+    {
+#ifdef _OPENMP
+        Thread = omp_get_thread_num();
+#endif
+        UpdateTile(Sweep, Tiles, Tile, Depth,
+            Tiles->Buffer + Tiles->BufferSize*Thread,
+            Tiles->Acc + AccStride*Tile,
+            Tiles->Acc + AccStride*(Tiles->NumTiles + Thread));
+    }
+    
+    /* Reduce in a fixed order, independent of the number of threads */
+    SumRows(Sum, Tiles->Acc, AccStride, Tiles->NumTiles);
+}
+
+
+/**
+ * @brief Downsample an image by an integer factor with area averaging
+ * @param Dest the downsampled image, of size ceil(Width/Factor) by
+ *    ceil(Height/Factor)
+ * @param Src the input image
+ * @param Width, Height, NumChannels dimensions of Src
+ * @param Factor the downsampling factor
+ *
+ * Each pixel of Dest is the average of a Factor by Factor block of Src.  If
+ * the size is not a multiple of Factor, the last column or row of Dest
+ * averages the pixels that are available.
+ */
+static void Downsample(num *Dest, const num *Src,
+    int Width, int Height, int NumChannels, int Factor)
+{
+    const int DestWidth = (Width + Factor - 1)/Factor;
+    const int DestHeight = (Height + Factor - 1)/Factor;
+    const num *Src2;
+    num Sum;
+    int i, j, i2, j2, Count, Channel;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+    {
+        for(j = 0; j < DestHeight; j++)
+            for(i = 0; i < DestWidth; i++, Dest++)
+            {
+                Sum = 0;
+                Count = 0;
+                
+                for(j2 = Factor*j; j2 < Factor*(j + 1) && j2 < Height; j2++)
+                    for(i2 = Factor*i, Src2 = Src + i2 + ((long)Width)*j2;
+                        i2 < Factor*(i + 1) && i2 < Width;
+                        i2++, Src2++, Count++)
+                        Sum += *Src2;
+                
+                *Dest = Sum/Count;
+            }
+        
+        Src += ((long)Width)*Height;
+    }
+}
+
+
+/**
+ * @brief Downsample a level set by an integer factor by taking every
+ *    Factor-th pixel
+ * @param Dest the downsampled level set, of size ceil(Width/Factor) by
+ *    ceil(Height/Factor)
+ * @param Src the input level set, of size Width by Height
+ * @param Factor the downsampling factor
+ *
+ * Unlike averaging, decimation keeps the values of the level set, so that the
+ * coarse level set is not flattened where the sign of Phi varies.
+ */
+static void Decimate(num *Dest, const num *Src, int Width, int Height,
+    int Factor)
+{
+    int i, j;
+    
+    for(j = 0; j < Height; j += Factor)
+        for(i = 0; i < Width; i += Factor)
+            *(Dest++) = Src[i + ((long)Width)*j];
+}
+
+
+/**
+ * @brief Upsample a level set by an integer factor with bilinear
+ *    interpolation
+ * @param Dest the upsampled level set, of size Width by Height
+ * @param Width, Height dimensions of Dest
+ * @param Src the coarse level set, of size ceil(Width/Factor) by
+ *    ceil(Height/Factor)
+ * @param Factor the upsampling factor
+ *
+ * Each value of Dest is a convex combination of the four nearest values of
+ * Src, so the interpolation preserves the sign wherever these agree and
+ * the zero level set of Dest only passes between coarse pixels of
+ * opposite sign.
+ */
+static void Upsample(num *Dest, int Width, int Height, const num *Src,
+    int Factor)
+{
+    const int SrcWidth = (Width + Factor - 1)/Factor;
+    const int SrcHeight = (Height + Factor - 1)/Factor;
+    num x, y, wx, wy;
+    int i, j, i0, j0, i1, j1;
+    
+    for(j = 0; j < Height; j++)
+    {
+        /* Pixel centers of Dest in the coordinates of Src */
+        y = (j + (num)0.5)/Factor - (num)0.5;
+        j0 = (y < 0) ? 0 : (int)y;
+        j1 = (j0 + 1 < SrcHeight) ? j0 + 1 : j0;
+        wy = (y < 0) ? 0 : y - j0;
+        
+        for(i = 0; i < Width; i++, Dest++)
+        {
+            x = (i + (num)0.5)/Factor - (num)0.5;
+            i0 = (x < 0) ? 0 : (int)x;
+            i1 = (i0 + 1 < SrcWidth) ? i0 + 1 : i0;
+            wx = (x < 0) ? 0 : x - i0;
+            
+            *Dest = (1 - wy)*((1 - wx)*Src[i0 + SrcWidth*j0]
+                    + wx*Src[i1 + SrcWidth*j0])
+                + wy*((1 - wx)*Src[i0 + SrcWidth*j1]
+                    + wx*Src[i1 + SrcWidth*j1]);
+        }
+    }
+}
+
+
+/** @brief Plotting function for the coarse levels, records the final state */
+#ifdef __GNUC__
+static int PyramidPlot(int State, int Iter,
+    __attribute__((unused)) num Delta,
+    __attribute__((unused)) const num *c1,
+    __attribute__((unused)) const num *c2,
+    __attribute__((unused)) const num *Phi,
+    __attribute__((unused)) int Width,
+    __attribute__((unused)) int Height,
+    __attribute__((unused)) int NumChannels, void *Param)
+#else
+static int PyramidPlot(int State, int Iter, num Delta,
+    const num *c1, const num *c2, const num *Phi,
+    int Width, int Height, int NumChannels, void *Param)
+#endif
+{
+    if(State != 0)
+    {
+        ((int *)Param)[0] = State;
+        ((int *)Param)[1] = Iter;
+    }
+    
+    return 1;
+}
+
+
+/** @brief Number of pyramid levels that are used for an image size */
+static int PyramidLevels(int Width, int Height, int NumLevels)
+{
+    int Levels;
+    
+    for(Levels = 1; Levels < NumLevels && Levels < PYRAMID_MAX_LEVELS;
+        Levels++)
+    {
+        Width = (Width + 1)/2;
+        Height = (Height + 1)/2;
+        
+        if(Width < PYRAMID_MIN_SIZE || Height < PYRAMID_MIN_SIZE)
+            break;
+    }
+    
+    return Levels;
+}
+
+
+static int SolveChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws);
+
+
+/**
+ * @brief Coarse-to-fine Chan-Vese segmentation
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @return the final state as for ChanVese, 0 on failure
+ *
+ * PYRAMID_FIRST_ITER level set iterations are first done at full
+ * resolution.  The default initialization of ChanVeseInitPhi oscillates on
+ * the scale of a few pixels, so it does not survive downsampling, and which
+ * phase ends up inside the curve is decided in the first iterations.  After
+ * them, Phi follows the image and can be downsampled.
+ *
+ * The image f is then successively downsampled by factors of two with 2x2
+ * averaging and Phi by decimation, where no level is made smaller than
+ * PYRAMID_MIN_SIZE.  The coarsest level is solved with up to Opt->MaxIter
+ * iterations.  Then each finer level down to Opt->StopLevel is initialized by
+ * upsampling Phi from the next coarser level and refined with up to
+ * Opt->RefineIter iterations.  If StopLevel > 0, the solution of that level
+ * is upsampled without further iterations to obtain the full resolution Phi.
+ *
+ * Lengths measured in the pixels of a level are 2^Level times shorter and
+ * areas 4^Level times smaller than at full resolution, so the length penalty
+ * of each level is Opt->Mu/2^Level to minimize the same energy.  The other
+ * options, including Tol, are the same on every level.  The deadline of
+ * ChanVeseSetDeadline covers the whole pyramid: when it is reached, the
+ * levels not yet started are skipped in the same way.
+ *
+ * The plotting function is only called for the full resolution image.  If
+ * StopLevel > 0 or levels were skipped, it is called once with the final
+ * state and number of iterations of the last level solved.
+ */
+static int PyramidChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    const size_t Mark = WorkspaceMark(Ws);
+    chanveseopt LevelOpt = *Opt;
+    const num *fLevel[PYRAMID_MAX_LEVELS];
+    num *fBuf[PYRAMID_MAX_LEVELS], *PhiLevel[PYRAMID_MAX_LEVELS];
+    int LevelWidth[PYRAMID_MAX_LEVELS], LevelHeight[PYRAMID_MAX_LEVELS];
+    num *c1, *c2;
+    const int NumLevels = PyramidLevels(Width, Height, Opt->NumLevels);
+    const unsigned long StartTime = Clock();
+    unsigned long Elapsed;
+    int LastState[2] = {0, 0};
+    int StopLevel, Level, Skipped = 0, Success = 0;
+    
+    fLevel[0] = f;
+    PhiLevel[0] = Phi;
+    LevelWidth[0] = Width;
+    LevelHeight[0] = Height;
+    
+    /* Resolve the initialization at full resolution.  This always uses the
+       level set method, one iteration of the other backends is a full
+       solve. */
+    LevelOpt.Tol = 0;
+    LevelOpt.FlipWindow = 0;
+    LevelOpt.MaxIter = PYRAMID_FIRST_ITER;
+    LevelOpt.Backend = CHANVESE_BACKEND_LEVELSET;
+    LevelOpt.NumLevels = 1;
+    LevelOpt.Deadline = 0;
+    LevelOpt.KeepBest = 0;
+    LevelOpt.Workspace = Ws;
+    LevelOpt.Trace = NULL;
+    LevelOpt.PlotFun = NULL;
+    
+    if(!SolveChanVese(Phi, f, Width, Height, NumChannels, &LevelOpt, Ws))
+        goto Catch;
+    
+    LevelOpt = *Opt;
+    
+    for(Level = 1; Level < NumLevels; Level++)
+    {
+        LevelWidth[Level] = (LevelWidth[Level - 1] + 1)/2;
+        LevelHeight[Level] = (LevelHeight[Level - 1] + 1)/2;
+        
+        if(!(fBuf[Level] = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels
+                *LevelWidth[Level]*LevelHeight[Level]))
+            || !(PhiLevel[Level] = (num *)WorkspaceAlloc(Ws, sizeof(num)
+                *LevelWidth[Level]*LevelHeight[Level])))
+            goto Catch;
+        
+        Downsample(fBuf[Level], fLevel[Level - 1],
+            LevelWidth[Level - 1], LevelHeight[Level - 1], NumChannels, 2);
+        Decimate(PhiLevel[Level], PhiLevel[Level - 1],
+            LevelWidth[Level - 1], LevelHeight[Level - 1], 2);
+        fLevel[Level] = fBuf[Level];
+    }
+    
+    StopLevel = (Opt->StopLevel < NumLevels) ? Opt->StopLevel : NumLevels - 1;
+    LevelOpt.NumLevels = 1;
+    LevelOpt.Workspace = Ws;
+    
+    for(Level = NumLevels - 1; Level >= StopLevel; Level--)
+    {
+        if(Level < NumLevels - 1)
+            Upsample(PhiLevel[Level], LevelWidth[Level], LevelHeight[Level],
+                PhiLevel[Level + 1], 2);
+        
+        LevelOpt.MaxIter = (Level == NumLevels - 1) ?
+            Opt->MaxIter : Opt->RefineIter;
+        LevelOpt.Mu = Opt->Mu/(num)(1L << Level);
+        
+        /* Each level gets the time left of the deadline.  When the time is
+           spent, the finer levels are skipped and the current result is
+           upsampled to full resolution. */
+        if(Opt->Deadline > 0)
+        {
+            Elapsed = Clock() - StartTime;
+            
+            if(Level < NumLevels - 1
+                && Elapsed >= (unsigned long)Opt->Deadline)
+            {
+                LastState[0] = CHANVESE_DEADLINE;
+                StopLevel = Level;
+                Skipped = 1;
+                Success = CHANVESE_DEADLINE;
+                break;
+            }
+            
+            LevelOpt.Deadline = (Elapsed < (unsigned long)Opt->Deadline) ?
+                (int)(Opt->Deadline - Elapsed) : 1;
+        }
+        
+        /* Only plot at full resolution, but keep track of the number of
+           iterations at the stopping level */
+        if(Level == 0)
+        {
+            LevelOpt.PlotFun = Opt->PlotFun;
+            LevelOpt.PlotParam = Opt->PlotParam;
+        }
+        else
+        {
+            LevelOpt.PlotFun = PyramidPlot;
+            LevelOpt.PlotParam = LastState;
+        }
+        
+        TraceSetLevel(Opt->Trace, Level);
+        
+        if(!(Success = SolveChanVese(PhiLevel[Level], fLevel[Level],
+            LevelWidth[Level], LevelHeight[Level], NumChannels, &LevelOpt,
+            Ws)))
+            goto Catch;
+    }
+    
+    if(StopLevel > 0 || Skipped)
+    {
+        for(Level = StopLevel - 1; Level >= 0; Level--)
+            Upsample(PhiLevel[Level], LevelWidth[Level], LevelHeight[Level],
+                PhiLevel[Level + 1], 2);
+        
+        if(Opt->PlotFun)
+        {
+            if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+                || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels)))
+            {
+                Success = 0;
+                goto Catch;
+            }
+            
+            RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+            Opt->PlotFun(LastState[0], LastState[1], 0, c1, c2, Phi,
+                Width, Height, NumChannels, Opt->PlotParam);
+        }
+    }
+
+Catch:
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
+
+
+/**
+ * @brief Chan-Vese segmentation on a downscaled image
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @param Ws workspace for the scratch memory
+ * @return the final state as for ChanVese, 0 on failure
+ *
+ * The image is downscaled by the smallest integer factor that brings its
+ * longer side to at most Opt->MaxSide pixels, averaging f over blocks of
+ * Factor by Factor pixels and decimating the initial Phi.  The segmentation
+ * is computed at that size, with a pyramid if Opt->NumLevels > 1, and Phi is
+ * upsampled back to full resolution with bilinear interpolation.  As with
+ * StopLevel > 0 in PyramidChanVese, the plotting function is only called
+ * once, with the full resolution Phi and the final state.
+ */
+static int ScaledChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    const size_t Mark = WorkspaceMark(Ws);
+    const int Side = (Width > Height) ? Width : Height;
+    const int Factor = (Side + Opt->MaxSide - 1)/Opt->MaxSide;
+    const int SmallWidth = (Width + Factor - 1)/Factor;
+    const int SmallHeight = (Height + Factor - 1)/Factor;
+    chanveseopt SmallOpt = *Opt;
+    num *fSmall, *PhiSmall, *c1, *c2;
+    int LastState[2] = {0, 0};
+    int Success = 0;
+    
+    if(!(fSmall = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels
+            *SmallWidth*SmallHeight))
+        || !(PhiSmall = (num *)WorkspaceAlloc(Ws, sizeof(num)
+            *SmallWidth*SmallHeight)))
+        goto Catch;
+    
+    Downsample(fSmall, f, Width, Height, NumChannels, Factor);
+    Decimate(PhiSmall, Phi, Width, Height, Factor);
+    
+    SmallOpt.MaxSide = 0;
+    SmallOpt.Workspace = Ws;
+    SmallOpt.PlotFun = PyramidPlot;
+    SmallOpt.PlotParam = LastState;
+    
+    if(!(Success = (Opt->NumLevels > 1) ?
+        PyramidChanVese(PhiSmall, fSmall, SmallWidth, SmallHeight,
+            NumChannels, &SmallOpt, Ws) :
+        SolveChanVese(PhiSmall, fSmall, SmallWidth, SmallHeight,
+            NumChannels, &SmallOpt, Ws)))
+        goto Catch;
+    
+    Upsample(Phi, Width, Height, PhiSmall, Factor);
+    
+    if(Opt->PlotFun)
+    {
+        if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+            || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels)))
+        {
+            Success = 0;
+            goto Catch;
+        }
+        
+        RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+        Opt->PlotFun(LastState[0], LastState[1], 0, c1, c2, Phi,
+            Width, Height, NumChannels, Opt->PlotParam);
+    }
+
+Catch:
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
 
 
-/** @brief Options handling for ChanVese */
-struct chanvesestruct
+/**
+ * @brief Chan-Vese segmentation with the level set backend
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @param Ws workspace for the scratch memory
+ * @return the final state as for ChanVese, 0 on failure
+ */
+static int LevelSetChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
 {
-    num Tol;
-    int MaxIter;
-    num Mu;
-    num Nu;
-    num Lambda1;
-    num Lambda2;
-    num dt;
     int (*PlotFun)(int, int, num, const num*, const num*, const num*,
         int, int, int, void*);
-    void *PlotParam;
-};
+    const long NumPixels = ((long)Width) * ((long)Height);
+    const long NumEl = NumPixels * NumChannels;
+    const int AccStride = ACC_SIZE(NumChannels);
+    const size_t Mark = WorkspaceMark(Ws);
+    sweepdata Sweep;
+    narrowband Band, *SweepBand = NULL;
+    tiledata Tiles;
+    dataterm Data;
+    edt *Edt = NULL;
+    double *RowAcc, *Sum, *Region;
+    fliptest FlipTest;
+    const unsigned long StartTime = Clock();
+    double PhiDiffNorm, Energy, BestEnergy = 0;
+    num *c1, *c2, *Best = NULL, *Temp;
+    num PhiTol;
+    long n;
+    int Iter, j, k, Color, MaxIter, BandWidth, Depth, Stop;
+    int NextReinit, NextRefresh, BestIter = 0;
+    int DataThreads = 1, State = CHANVESE_MAXITER, Success = 0;
+    
+    Band.Dist = NULL;
+    memset(&Tiles, 0, sizeof(tiledata));
+    Data.Force = NULL;
+    Data.NormSq = NULL;
+    Data.Weight = NULL;
+    Sweep.Phi = Phi;
+    Sweep.Data = NULL;
+    BandWidth = (Opt->Sweep == CHANVESE_SWEEP_TILED) ? 0 :
+        (Opt->Band < BAND_OUTSIDE) ? Opt->Band : BAND_OUTSIDE - 1;
+    MaxIter = Opt->MaxIter;
+    PlotFun = Opt->PlotFun;
+    PhiTol = Opt->Tol;
+    PhiDiffNorm = (PhiTol > 0) ? PhiTol*1000 : 1000;
+    
+    if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(Sum = (double *)WorkspaceAlloc(Ws, sizeof(double)*AccStride))
+        || !(Region = (double *)WorkspaceAlloc(Ws, sizeof(double)
+            *(AccStride + NumChannels)))
+        || !(RowAcc = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*AccStride*Height))
+        || (BandWidth > 0
+            && !AllocBand(&Band, Width, Height, Ws))
+        || (Opt->Sweep == CHANVESE_SWEEP_TILED
+            && !AllocTiles(&Tiles, Opt, Width, Height, NumChannels, Ws))
+        || (Opt->DataTerm == CHANVESE_DATA_MOMENTS && BandWidth == 0
+            && !AllocDataTerm(&Data, f, NumPixels, NumChannels, Opt, Ws))
+        || (Opt->KeepBest
+            && !(Best = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels)))
+        || !FlipTestInit(&FlipTest, Opt, NumPixels, Ws))
+        goto Done;
+    
+    if(Data.Force)
+        Sweep.Data = Data.Force;
 
-#ifdef __GNUC__
-int ChanVeseSimplePlot(int State, int Iter, num Delta,
-    const num *c1, const num *c2,
-    __attribute__((unused)) const num *Phi,
-    __attribute__((unused)) int Width,
-    __attribute__((unused)) int Height,
-    int NumChannels,
-    __attribute__((unused)) void *Param);
-#else
-int ChanVeseSimplePlot(int State, int Iter, num Delta,
-    const num *c1, const num *c2,
-    const num *Phi,
-    int Width,
-    int Height,
-    int NumChannels,
-    void *Param);
+#ifdef _OPENMP
+    if(Opt->Sweep != CHANVESE_SWEEP_SERIAL)
+        DataThreads = GetNumThreads(Opt);
 #endif
 
-/** @brief Default options struct */
-static struct chanvesestruct DefaultChanVeseOpt =
-        {(num)1e-3, 500, (num)0.25, 0, 1, 1, (num)0.5,
-        ChanVeseSimplePlot, NULL};
+    /* The initial Phi is kept, the first reinitialization is done after
+       Reinit iterations.  It keeps the sign of Phi, so the region averages
+       and the narrow band are not affected. */
+    if(Opt->Reinit > 0 && !(Edt = EdtNew(Width, Height, DataThreads, Ws)))
+        goto Done;
+    
+    NextReinit = 1 + Opt->Reinit;
+    
+    Sweep.f = f;
+    Sweep.c1 = c1;
+    Sweep.c2 = c2;
+    Sweep.NumPixels = NumPixels;
+    Sweep.Width = Width;
+    Sweep.Height = Height;
+    Sweep.NumChannels = NumChannels;
+    Sweep.Mu = Opt->Mu;
+    Sweep.Nu = Opt->Nu;
+    Sweep.Lambda1 = Opt->Lambda1;
+    Sweep.Lambda2 = Opt->Lambda2;
+    Sweep.dt = Opt->dt;
+    SelectKernels(&Sweep);
+    
+    /* The count and sums inside the curve are kept in Region and updated
+       with the changes accumulated by the sweeps, followed by the sums of
+       each channel over the whole image, so that the sums outside the curve
+       can be obtained from the sums inside. */
+    ChannelSums(Region + AccStride, f, NumPixels, NumChannels);
+    RegionSums(Region, Phi, f, NumPixels, NumChannels);
+    AveragesFromSums(c1, c2, Region, NumPixels, NumChannels);
+    NextRefresh = REGION_REFRESH;
+    Success = CHANVESE_MAXITER;
+    
+    if(Best)
+    {
+        memcpy(Best, Phi, sizeof(num)*NumPixels);
+        BestEnergy = SegmentationEnergy(Phi, f,
+            Width, Height, NumChannels, Opt);
+    }
+    
+    if(BandWidth > 0)
+    {
+        BuildBand(&Band, BandWidth, Phi, Width, Height);
+        SweepBand = &Band;
+    }
+    
+    if(PlotFun)
+        if(!PlotFun(0, 0, PhiDiffNorm, c1, c2, Phi,
+                Width, Height, NumChannels, Opt->PlotParam))
+            goto Done;
+    
+    for(Iter = 1; Iter <= MaxIter; Iter++)
+    {
+        Depth = 1;
+        
+        if(Edt && Iter >= NextReinit)
+        {
+            ReinitPhi(Edt, Sweep.Phi, NumPixels);
+            NextReinit = Iter + Opt->Reinit;
+        }
+        
+        if(Sweep.Data)
+            UpdateDataTerm(&Data, f, NumPixels, NumChannels, c1, c2,
+                Opt->Lambda1, Opt->Lambda2, DataThreads);
+        
+        if(Opt->Sweep == CHANVESE_SWEEP_TILED)
+        {
+            /* Advance a block of iterations, ending at iteration Iter */
+            Depth = (Tiles.Depth <= MaxIter - Iter) ?
+                Tiles.Depth : MaxIter - Iter + 1;
+            Iter += Depth - 1;
+            TiledSweep(&Sweep, &Tiles, Depth, Sum);
+            Temp = Sweep.Phi;
+            Sweep.Phi = Tiles.PhiNext;
+            Tiles.PhiNext = Temp;
+        }
+        else
+        {
+            for(j = 0; j < AccStride*Height; j++)
+                RowAcc[j] = 0;
+            
+            /* If the band is empty, fall back to a full sweep */
+            if(SweepBand && !SweepBand->NumPixels)
+                SweepBand = NULL;
+            
+            if(Opt->Sweep == CHANVESE_SWEEP_REDBLACK)
+            {
+                /* Pixels of one color only depend on pixels of the other
+                   color, so the rows of each half-sweep can be updated
+                   concurrently. */
+                for(Color = 0; Color < 2; Color++)
+                {
+#ifdef _OPENMP
+                    #pragma omp parallel for schedule(dynamic, 16) \
+                        num_threads(GetNumThreads(Opt))
+#endif
+                    for(j = 0; j < Height; j++)
+                        UpdateBandRow(&Sweep, SweepBand, j, Color,
+                            RowAcc + AccStride*j);
+                }
+            }
+            else
+                for(j = 0; j < Height; j++)
+                    UpdateBandRow(&Sweep, SweepBand, j, -1,
+                        RowAcc + AccStride*j);
+            
+            /* Reduce the row accumulators in a fixed order so that the
+               result does not depend on the number of threads */
+            SumRows(Sum, RowAcc, AccStride, Height);
+        }
+        
+        if(SweepBand)
+            PhiDiffNorm = sqrt(Sum[ACC_PHIDIFF]
+                / (SweepBand->NumPixels*NumChannels));
+        else
+            PhiDiffNorm = sqrt(Sum[ACC_PHIDIFF]/NumEl);
+        
+        /* Update the region sums with the pixels that changed sign, and
+           recompute them periodically to bound the rounding drift */
+        if(Iter >= NextRefresh)
+        {
+            RegionSums(Region, Sweep.Phi, f, NumPixels, NumChannels);
+            NextRefresh = Iter + REGION_REFRESH;
+        }
+        else
+            for(j = ACC_COUNT1; j < AccStride; j++)
+                Region[j] += Sum[j];
+        
+        AveragesFromSums(c1, c2, Region, NumPixels, NumChannels);
+        TraceRecord(Opt->Trace, Iter, PhiDiffNorm, c1, c2, Sum[ACC_FLIPS]);
+        
+        if(BandWidth > 0 && (!SweepBand
+            || BandNeedsRebuild(&Band, BandWidth, Phi, Width, Height)))
+        {
+            BuildBand(&Band, BandWidth, Phi, Width, Height);
+            SweepBand = &Band;
+        }
+        
+        if(Best && (Energy = SegmentationEnergy(Sweep.Phi, f,
+            Width, Height, NumChannels, Opt)) < BestEnergy)
+        {
+            memcpy(Best, Sweep.Phi, sizeof(num)*NumPixels);
+            BestEnergy = Energy;
+            BestIter = Iter;
+        }
+        
+        if(Iter >= 2 && PhiDiffNorm <= PhiTol)
+        {
+            State = CHANVESE_CONVERGED;
+            break;
+        }
+        
+        /* For a tiled block, each iteration counts the sign changes of
+           the last iteration of the block */
+        for(k = Iter - Depth + 1, Stop = 0; k <= Iter && !Stop; k++)
+            Stop = FlipTestUpdate(&FlipTest, k, Sum[ACC_FLIPS]);
+        
+        if(Stop)
+        {
+            State = CHANVESE_NOFLIPS;
+            break;
+        }
+        
+        if(DeadlineReached(Opt, StartTime))
+        {
+            State = CHANVESE_DEADLINE;
+            break;
+        }
         
+        if(PlotFun)
+            if(!PlotFun(0, Iter, PhiDiffNorm, c1, c2, Sweep.Phi,
+                    Width, Height, NumChannels, Opt->PlotParam))
+                goto Done;
+    }
+
+    Success = State;
+    
+    /* Return the lowest energy segmentation if it was not the last one */
+    if(Best && BestIter != ((Iter <= MaxIter) ? Iter:MaxIter))
+    {
+        memcpy(Sweep.Phi, Best, sizeof(num)*NumPixels);
+        RegionAverages(c1, c2, Sweep.Phi, f, Width, Height, NumChannels);
+    }
+    
+    TraceClearProgress(Opt->Trace);
+    
+    if(PlotFun)
+        PlotFun(State, (Iter <= MaxIter) ? Iter:MaxIter,
+            PhiDiffNorm, c1, c2, Sweep.Phi,
+            Width, Height, NumChannels, Opt->PlotParam);
+    
+Done:
+    if(Sweep.Phi != Phi)
+    {
+        /* The result of the last tiled block is in the tile buffer */
+        for(n = 0; n < NumPixels; n++)
+            Phi[n] = Sweep.Phi[n];
+    }
+    
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
+
+
+/** @brief Segmentation of a single level with the selected backend */
+static int SolveChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    if(Opt->Backend == CHANVESE_BACKEND_SPARSEFIELD)
+        return SparseFieldChanVese(Phi, f,
+            Width, Height, NumChannels, Opt, Ws);
+    else if(Opt->Backend == CHANVESE_BACKEND_PRIMALDUAL)
+        return PrimalDualChanVese(Phi, f,
+            Width, Height, NumChannels, Opt, Ws);
+    else if(Opt->Backend == CHANVESE_BACKEND_GRAPHCUT)
+        return GraphCutChanVese(Phi, f,
+            Width, Height, NumChannels, Opt, Ws);
+    else
+        return LevelSetChanVese(Phi, f,
+            Width, Height, NumChannels, Opt, Ws);
+}
+
 
 /**
  * @brief Chan-Vese two-phase image segmentation
@@ -86,6 +1796,8 @@ static struct chanvesestruct DefaultChanVeseOpt =
  * @param Lambda2 fit penalty outside the curve
  * @param dt timestep
  * @param PlotFun function for outputting intermediate results
+ * @return the final state, CHANVESE_CONVERGED, CHANVESE_MAXITER,
+ *    CHANVESE_NOFLIPS, or CHANVESE_DEADLINE (see chanvese.h), or 0 on failure
  *
  * This function performs Chan-Vese active contours two-phase image
  * segmentation by minimizing the functional
@@ -122,23 +1834,64 @@ static struct chanvesestruct DefaultChanVeseOpt =
  *
  * The routine runs at most MaxIter number of iterations and stops when the
  * change between successive iterations is less than Tol.  Set Tol=0 to force
- * the routine to run exactly MaxIter iterations.
+ * the routine to run exactly MaxIter iterations.  Additionally, with
+ * ChanVeseSetFlipWindow(Opt, K), K > 0, the routine stops when the number of
+ * pixels where Phi changed sign in the last K iterations is at most
+ * FlipTol*Width*Height (see ChanVeseSetFlipTol).  With
+ * ChanVeseSetDeadline(Opt, Ms), Ms > 0, it also stops once Ms milliseconds
+ * have passed, and with ChanVeseSetKeepBest(Opt, 1), Phi is returned from
+ * the iteration of lowest energy rather than the last one.
+ *
+ * By default, each iteration updates Phi in place in raster order.  With
+ * ChanVeseSetSweep(Opt, CHANVESE_SWEEP_REDBLACK), the pixels are instead
+ * updated in a checkerboard order, and the rows of each half of the sweep are
+ * split over ChanVeseSetNumThreads threads (when compiled with OpenMP).  The
+ * red-black ordering converges to the same segmentations as the in-place
+ * ordering, though intermediate iterates differ slightly.  For red-black
+ * sweeps, the interior pixels are updated with AVX2 or SSE4.1 instructions
+ * if the CPU supports them.
+ *
+ * With ChanVeseSetSweep(Opt, CHANVESE_SWEEP_TILED), the image is split into
+ * tiles of ChanVeseSetTileSize pixels, and ChanVeseSetTileDepth red-black
+ * iterations are done on each tile while it is in cache before moving to the
+ * next tile.  The region averages are then only updated between blocks of
+ * TileDepth iterations, and the convergence tests are done at the end of
+ * each block, using Delta and the sign changes of its last iteration.  The
+ * narrow band option is not used with tiled sweeps.
+ *
+ * With ChanVeseSetBand(Opt, Band), Band > 0, only the pixels within Band
+ * pixels of the front are updated, so that the cost of an iteration is
+ * proportional to the length of the contour rather than to the image area.
+ * The band is rebuilt whenever the front moves into its outer half.  Phi is
+ * left unchanged outside of the band, so new components of the segmentation
+ * cannot appear far from the current front.  If the band is empty, a full
+ * sweep is done instead.
+ *
+ * The region averages are updated from the pixels that changed sign during
+ * the sweep rather than by summing over the whole image, and the sums are
+ * recomputed exactly every REGION_REFRESH iterations.
+ *
+ * With ChanVeseSetLevels(Opt, NumLevels), NumLevels > 1, the segmentation is
+ * computed coarse to fine on an image pyramid, see ChanVeseSetLevels.  With
+ * ChanVeseSetMaxSide(Opt, MaxSide), larger images are segmented at a
+ * reduced size and Phi is upsampled to full resolution.
+ *
+ * With ChanVeseSetBackend(Opt, CHANVESE_BACKEND_SPARSEFIELD), the evolution
+ * is instead done with the sparse-field method of sparsefield.c, and with
+ * CHANVESE_BACKEND_PRIMALDUAL, the convex relaxation of primaldual.c is
+ * solved.  CHANVESE_BACKEND_GRAPHCUT alternates the minimum cuts of
+ * graphcut.c with updates of the region averages.
+ *
+ * The scratch memory is taken from the workspace set with
+ * ChanVeseSetWorkspace, so that repeated calls on images of the same size do
+ * not allocate memory.  If no workspace is set, a temporary one is created
+ * and freed for the call.
  */
 int ChanVese(num *Phi, const num *f,
     int Width, int Height, int NumChannels, const chanveseopt *Opt)
 {
-    int (*PlotFun)(int, int, num, const num*, const num*, const num*,
-        int, int, int, void*);
-    const long NumPixels = ((long)Width) * ((long)Height);
-    const long NumEl = NumPixels * NumChannels;
-    const num *fPtr, *fPtr2;
-    double PhiDiffNorm, PhiDiff;
-    num *PhiPtr, *c1 = 0, *c2 = 0;
-    num c1Scalar, c2Scalar, Mu, Nu, Lambda1, Lambda2, dt;
-    num PhiLast, Delta, PhiX, PhiY, IDivU, IDivD, IDivL, IDivR;
-    num Temp1, Temp2, Dist1, Dist2, PhiTol;
-    int Iter, i, j, Channel, MaxIter, Success = 2;
-    int iu, id, il, ir;
+    workspace *Ws;
+    int Success;
     
     if(!Phi || !f || Width <= 0 || Height <= 0 || NumChannels <= 0)
         return 0;
@@ -146,134 +1899,228 @@ int ChanVese(num *Phi, const num *f,
     if(!Opt)
         Opt = &DefaultChanVeseOpt;
     
-    Mu = Opt->Mu;
-    Nu = Opt->Nu;
-    Lambda1 = Opt->Lambda1;
-    Lambda2 = Opt->Lambda2;
-    dt = Opt->dt;
-    MaxIter = Opt->MaxIter;
-    PlotFun = Opt->PlotFun;
-    PhiTol = Opt->Tol;
-    PhiDiffNorm = (PhiTol > 0) ? PhiTol*1000 : 1000;
+    if(!TraceBegin(Opt->Trace, NumChannels)
+        || (!(Ws = Opt->Workspace) && !(Ws = WorkspaceNew())))
+        return 0;
     
-    if(NumChannels > 1)
-    {
-        if(!(c1 = Malloc(sizeof(num)*NumChannels))
-            || !(c2 = Malloc(sizeof(num)*NumChannels)))
-            return 0;
-    }
+    if(Opt->MaxSide > 0 && (Width > Opt->MaxSide || Height > Opt->MaxSide))
+        Success = ScaledChanVese(Phi, f, Width, Height, NumChannels, Opt, Ws);
+    else if(Opt->NumLevels > 1)
+        Success = PyramidChanVese(Phi, f, Width, Height, NumChannels, Opt, Ws);
     else
-    {
-        c1 = &c1Scalar;
-        c2 = &c2Scalar;
-    }
+        Success = SolveChanVese(Phi, f, Width, Height, NumChannels, Opt, Ws);
     
-    RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+    TraceEnd(Opt->Trace, Success);
     
-    if(PlotFun)
-        if(!PlotFun(0, 0, PhiDiffNorm, c1, c2, Phi,
-                Width, Height, NumChannels, Opt->PlotParam))
-            goto Done;
+    if(Ws != Opt->Workspace)
+        WorkspaceFree(Ws);
     
-    for(Iter = 1; Iter <= MaxIter; Iter++)
+    return Success;
+}
+
+
+/** @brief Default initialization for Phi */
+void ChanVeseInitPhi(num *Phi, int Width, int Height)
+{
+    int i, j;
+    
+    for(j = 0; j < Height; j++)
+        for(i = 0; i < Width; i++)
+            *(Phi++) = (num)(sin(i*M_PI/5.0)*sin(j*M_PI/5.0));
+}
+
+
+/**
+ * @brief Convert a +1/-1 mask to an initial level set
+ * @param Phi the mask on input, the level set on output
+ * @param Width, Height the size of Phi
+ *
+ * Phi is set to 1 on the pixels of the mask having an outside 4-neighbor,
+ * 0 on the other pixels of the mask, and -1 outside, as in the masks made
+ * for the Python scripts.  Since the regularized delta function
+ * 1/(pi (1 + Phi^2)) is largest where Phi = 0, the whole interior is on
+ * the front and follows the data term from the first iteration.  A signed
+ * distance would only move the contour near the boundary of the mask, by
+ * steps too small to pass the Tol test while c1 and c2 are still close.
+ */
+static void MaskToPhi(num *Phi, int Width, int Height)
+{
+    long n;
+    int i, j;
+    
+    for(j = 0, n = 0; j < Height; j++)
+        for(i = 0; i < Width; i++, n++)
+            if(Phi[n] < 0)
+                Phi[n] = -1;
+            else
+                Phi[n] = ((i > 0 && Phi[n - 1] < 0)
+                    || (i < Width - 1 && Phi[n + 1] < 0)
+                    || (j > 0 && Phi[n - Width] < 0)
+                    || (j < Height - 1 && Phi[n + Width] < 0)) ? 1 : 0;
+}
+
+
+/**
+ * @brief Initialize Phi from a centered box
+ * @param Phi, Width, Height the level set to initialize
+ * @param Fraction width and height of the box as a fraction of the image
+ * @return 1 on success, 0 on failure
+ *
+ * The box covers the middle Fraction of the rows and of the columns, so
+ * Fraction = 2/3 leaves a margin of 1/6 of the image on each side, as in
+ * make_mask.py.  Phi is 1 on the edge of the box, 0 inside, and -1 outside
+ * (see MaskToPhi).
+ */
+int ChanVeseInitPhiBox(num *Phi, int Width, int Height, double Fraction)
+{
+    const int x0 = (int)(Width*(1 - Fraction)/2);
+    const int y0 = (int)(Height*(1 - Fraction)/2);
+    int i, j;
+    
+    if(!Phi || Width <= 0 || Height <= 0 || Fraction <= 0 || Fraction > 1)
+        return 0;
+    
+    for(j = 0; j < Height; j++)
+        for(i = 0; i < Width; i++)
+            *(Phi++) = (x0 <= i && i < Width - x0
+                && y0 <= j && j < Height - y0) ? 1 : -1;
+    
+    MaskToPhi(Phi - ((long)Width)*Height, Width, Height);
+    return 1;
+}
+
+
+/**
+ * @brief Initialize Phi from a centered ellipse
+ * @param Phi, Width, Height the level set to initialize
+ * @param Fraction axes of the ellipse as a fraction of the image size
+ * @return 1 on success, 0 on failure
+ *
+ * With Fraction = 1, the ellipse is inscribed in the image.  As with
+ * ChanVeseInitPhiBox, Phi is 1 on the edge of the ellipse, 0 inside, and -1
+ * outside.
+ */
+int ChanVeseInitPhiEllipse(num *Phi, int Width, int Height, double Fraction)
+{
+    const double a = Fraction*Width/2, b = Fraction*Height/2;
+    double x, y;
+    int i, j;
+    
+    if(!Phi || Width <= 0 || Height <= 0 || Fraction <= 0 || Fraction > 1)
+        return 0;
+    
+    for(j = 0; j < Height; j++)
     {
-        PhiPtr = Phi;
-        fPtr = f;
-        PhiDiffNorm = 0;
+        y = (j - (Height - 1)/2.0)/b;
         
-        for(j = 0; j < Height; j++)
+        for(i = 0; i < Width; i++)
         {
-            iu = (j == 0) ? 0 : -Width;
-            id = (j == Height - 1) ? 0 : Width;
-            
-            for(i = 0; i < Width; i++, PhiPtr++, fPtr++)
-            {
-                il = (i == 0) ? 0 : -1;
-                ir = (i == Width - 1) ? 0 : 1;
-                
-                Delta = dt/(M_PI*(1 + PhiPtr[0]*PhiPtr[0]));
-                PhiX = PhiPtr[ir] - PhiPtr[0];
-                PhiY = (PhiPtr[id] - PhiPtr[iu])/2;
-                IDivR = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
-                PhiX = PhiPtr[0] - PhiPtr[il];
-                IDivL = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
-                PhiX = (PhiPtr[ir] - PhiPtr[il])/2;
-                PhiY =  PhiPtr[id] - PhiPtr[0];
-                IDivD = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
-                PhiY = PhiPtr[0] - PhiPtr[iu];
-                IDivU = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
-                
-                if(NumChannels == 1)
-                {
-                    Dist1 = fPtr[0] - c1Scalar;
-                    Dist2 = fPtr[0] - c2Scalar;
-                    Dist1 *= Dist1;
-                    Dist2 *= Dist2;
-                }
-                else
-                {
-                    Dist1 = Dist2 = 0.0;
-                    
-                    for(Channel = 0, fPtr2 = fPtr;
-                        Channel < NumChannels; Channel++, fPtr2 += NumPixels)
-                    {
-                        Temp1 = fPtr2[0] - c1[Channel];
-                        Temp2 = fPtr2[0] - c2[Channel];
-                        Dist1 += Temp1*Temp1;
-                        Dist2 += Temp2*Temp2;
-                    }
-                }
-                
-                /* Semi-implicit update of phi at the current point */
-                PhiLast = PhiPtr[0];
-                PhiPtr[0] = (PhiPtr[0] + Delta*(
-                        Mu*(PhiPtr[ir]*IDivR + PhiPtr[il]*IDivL
-                            + PhiPtr[id]*IDivD + PhiPtr[iu]*IDivU)
-                        - Nu - Lambda1*Dist1 + Lambda2*Dist2) ) /
-                    (1 + Delta*Mu*(IDivR + IDivL + IDivD + IDivU));
-                PhiDiff = (PhiPtr[0] - PhiLast);
-                PhiDiffNorm += PhiDiff * PhiDiff;
-            }
+            x = (i - (Width - 1)/2.0)/a;
+            *(Phi++) = (x*x + y*y <= 1) ? 1 : -1;
         }
-        
-        PhiDiffNorm = sqrt(PhiDiffNorm/NumEl);
-        RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
-        
-        if(Iter >= 2 && PhiDiffNorm <= PhiTol)
-            break;
-        
-        if(PlotFun)
-            if(!PlotFun(0, Iter, PhiDiffNorm, c1, c2, Phi,
-                    Width, Height, NumChannels, Opt->PlotParam))
-                goto Done;
     }
+    
+    MaskToPhi(Phi - ((long)Width)*Height, Width, Height);
+    return 1;
+}
 
-    Success = (Iter <= MaxIter) ? 1:2;
 
-    if(PlotFun)
-        PlotFun(Success, (Iter <= MaxIter) ? Iter:MaxIter,
-            PhiDiffNorm, c1, c2, Phi,
-            Width, Height, NumChannels, Opt->PlotParam);
+/**
+ * @brief Initialize Phi from an Otsu threshold of the image
+ * @param Phi the level set to initialize
+ * @param f, Width, Height, NumChannels the image
+ * @return 1 on success, 0 on failure
+ *
+ * The channel average of f is thresholded with Otsu's method, which picks
+ * the threshold maximizing the between-class variance of a 256-bin
+ * histogram.  The class covering the lesser part of the image border is
+ * taken as the inside, since the object is assumed to be surrounded by the
+ * background.  Phi is then set from the thresholded region as in
+ * ChanVeseInitPhiBox.
+ *
+ * N. Otsu, "A threshold selection method from gray-level histograms," IEEE
+ * Transactions on Systems, Man, and Cybernetics, vol. 9, pp. 62-66, 1979.
+ */
+int ChanVeseInitPhiOtsu(num *Phi, const num *f,
+    int Width, int Height, int NumChannels)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    long Hist[256];
+    double Sum = 0, SumBelow = 0, Between, BestBetween = -1;
+    double Min, Max, Scale, Mean, CountBelow = 0;
+    long n, BorderAbove = 0, BorderCount = 0;
+    int i, j, k, Channel, Threshold = 0;
+    num Inside;
+    
+    if(!Phi || !f || Width <= 0 || Height <= 0 || NumChannels <= 0)
+        return 0;
+    
+    /* Store the channel average in Phi */
+    for(n = 0; n < NumPixels; n++)
+    {
+        for(Channel = 0, Mean = 0; Channel < NumChannels; Channel++)
+            Mean += f[n + NumPixels*Channel];
+        
+        Phi[n] = (num)(Mean/NumChannels);
+    }
     
-Done:
-    if(NumChannels > 1)
+    for(n = 1, Min = Max = Phi[0]; n < NumPixels; n++)
+        if(Phi[n] < Min)
+            Min = Phi[n];
+        else if(Phi[n] > Max)
+            Max = Phi[n];
+    
+    Scale = (Max > Min) ? 255.999/(Max - Min) : 0;
+    
+    for(k = 0; k < 256; k++)
+        Hist[k] = 0;
+    
+    for(n = 0; n < NumPixels; n++)
+        Hist[(int)((Phi[n] - Min)*Scale)]++;
+    
+    for(k = 0; k < 256; k++)
+        Sum += ((double)k)*Hist[k];
+    
+    /* Pixels in bins 0 to Threshold are below the threshold */
+    for(k = 0; k < 255; k++)
     {
-        Free(c2);
-        Free(c1);
+        CountBelow += Hist[k];
+        SumBelow += ((double)k)*Hist[k];
+        
+        if(CountBelow == 0 || CountBelow == NumPixels)
+            continue;
+        
+        Mean = SumBelow/CountBelow - (Sum - SumBelow)/(NumPixels - CountBelow);
+        Between = CountBelow*(NumPixels - CountBelow)*Mean*Mean;
+        
+        if(Between > BestBetween)
+        {
+            BestBetween = Between;
+            Threshold = k;
+        }
     }
     
-    return Success;
-}
-
-
-/** @brief Default initialization for Phi */
-void ChanVeseInitPhi(num *Phi, int Width, int Height)
-{
-    int i, j;
+    for(n = 0; n < NumPixels; n++)
+        Phi[n] = ((int)((Phi[n] - Min)*Scale) > Threshold) ? 1 : -1;
     
     for(j = 0; j < Height; j++)
-        for(i = 0; i < Width; i++)
-            *(Phi++) = (num)(sin(i*M_PI/5.0)*sin(j*M_PI/5.0));
+        for(i = 0; i < Width; i += (j == 0 || j == Height - 1
+            || i == Width - 1) ? 1 : Width - 1)
+        {
+            BorderCount++;
+            
+            if(Phi[i + ((long)Width)*j] > 0)
+                BorderAbove++;
+        }
+    
+    /* The inside is the class covering less of the border */
+    Inside = (2*BorderAbove <= BorderCount) ? 1 : -1;
+    
+    for(n = 0; n < NumPixels; n++)
+        Phi[n] = (Phi[n] == Inside) ? 1 : -1;
+    
+    MaskToPhi(Phi, Width, Height);
+    return 1;
 }
 
 
@@ -282,13 +2129,16 @@ void RegionAverages(num *c1, num *c2, const num *Phi, const num *f,
     int Width, int Height, int NumChannels)
 {
     const long NumPixels = ((long)Width) * ((long)Height);
-    num Sum1 = 0, Sum2 = 0;
+    double Sum1, Sum2;
     long n;
-    long Count1 = 0, Count2 = 0;
+    long Count1, Count2;
     int Channel;
     
     for(Channel = 0; Channel < NumChannels; Channel++, f += NumPixels)
     {
+        Sum1 = Sum2 = 0;
+        Count1 = Count2 = 0;
+        
         for(n = 0; n < NumPixels; n++)
             if(Phi[n] >= 0)
             {
@@ -301,23 +2151,25 @@ void RegionAverages(num *c1, num *c2, const num *Phi, const num *f,
                 Sum2 += f[n];
             }
         
-        c1[Channel] = (Count1) ? (Sum1/Count1) : 0;
-        c2[Channel] = (Count2) ? (Sum2/Count2) : 0;
+        c1[Channel] = (Count1) ? (num)(Sum1/Count1) : 0;
+        c2[Channel] = (Count2) ? (num)(Sum2/Count2) : 0;
     }
 }
 
 
-
 /* If GNU C language extensions are available, apply the "unused" attribute
    to avoid warnings.  TvRestoreSimplePlot is a plotting callback function
-   for TvRestore, so the unused arguments are indeed required. */
+   for TvRestore, so the unused arguments are indeed required.  Only the
+   final state is printed. */
 #ifdef __GNUC__
-int ChanVeseSimplePlot(int State, int Iter, num Delta,
-    const num *c1, const num *c2,
+int ChanVeseSimplePlot(int State, int Iter,
+    __attribute__((unused)) num Delta,
+    __attribute__((unused)) const num *c1,
+    __attribute__((unused)) const num *c2,
     __attribute__((unused)) const num *Phi,
     __attribute__((unused)) int Width,
     __attribute__((unused)) int Height,
-    int NumChannels,
+    __attribute__((unused)) int NumChannels,
     __attribute__((unused)) void *Param)
 #else
 int ChanVeseSimplePlot(int State, int Iter, num Delta,
@@ -332,23 +2184,21 @@ int ChanVeseSimplePlot(int State, int Iter, num Delta,
     switch(State)
     {
     case 0: /* ChanVese is running */
-        /* We print to stderr so that messages are displayed on the console
-           immediately, during the ChanVese computation.  If we use stdout,
-           messages might be buffered and not displayed until after ChanVese
-           completes, which would defeat the point of having this real-time
-           plot callback. */
-        if(NumChannels == 1)
-            fprintf(stderr, "   Iteration %4d     Delta %7.4f     c1 = %6.4f     c2 = %6.4f\r",
-                Iter, Delta, *c1, *c2);
-        else
-            fprintf(stderr, "   Iteration %4d     Delta %7.4f\r", Iter, Delta);
+        /* Nothing is printed per iteration, since writing to stderr on every
+           iteration is costly when it is redirected to a pipe or a log.  Use
+           a trace (ChanVeseNewTrace) for rate-limited progress. */
         break;
     case 1: /* Converged successfully */
-        fprintf(stderr, "Converged in %d iterations.                                            \n",
-            Iter);
+        fprintf(stderr, "Converged in %d iterations.\n", Iter);
         break;
     case 2: /* Maximum iterations exceeded */
-        fprintf(stderr, "Maximum number of iterations exceeded.                                 \n");
+        fprintf(stderr, "Maximum number of iterations exceeded.\n");
+        break;
+    case 3: /* Converged, Phi stopped changing sign */
+        fprintf(stderr, "Sign changes stopped after %d iterations.\n", Iter);
+        break;
+    case 4: /* Deadline reached */
+        fprintf(stderr, "Deadline reached after %d iterations.\n", Iter);
         break;
     }
     return 1;
@@ -385,6 +2235,64 @@ void ChanVeseFreeOpt(chanveseopt *Opt)
 }
 
 
+/**
+* @brief Create a new workspace for ChanVese scratch memory
+*
+* The workspace is used with ChanVeseSetWorkspace.  It is the caller's
+* responsibility to call ChanVeseFreeWorkspace when done.
+*/
+chanveseworkspace *ChanVeseNewWorkspace()
+{
+    return WorkspaceNew();
+}
+
+
+/** @brief Free a workspace and all of its memory */
+void ChanVeseFreeWorkspace(chanveseworkspace *Ws)
+{
+    WorkspaceFree(Ws);
+}
+
+
+/**
+ * @brief Persistent buffer kept in a workspace
+ * @param Ws the workspace
+ * @param Buffer one of the CHANVESE_BUFFER_* constants
+ * @param Size minimum size in bytes
+ * @return pointer to the buffer, or NULL on failure
+ *
+ * Besides the scratch memory of ChanVese, a workspace keeps a buffer for each
+ * of the per-image arrays of a caller: the image, the level set, and the
+ * buffers for decoding the image file.  A buffer is only reallocated when a
+ * larger size is requested, so that a caller segmenting a sequence of images
+ * with one workspace allocates nothing once the largest image has been
+ * seen.  The buffer is valid until the next call with a larger size or until
+ * the workspace is freed.  Like the rest of the workspace, the buffers are
+ * for one thread.
+ */
+void *ChanVeseWorkspaceBuffer(chanveseworkspace *Ws, int Buffer, size_t Size)
+{
+    return WorkspaceBuffer(Ws, Buffer, Size);
+}
+
+
+/** @brief Image buffer of Width*Height*NumChannels elements in a workspace */
+num *ChanVeseWorkspaceImage(chanveseworkspace *Ws,
+    int Width, int Height, int NumChannels)
+{
+    return (num *)WorkspaceBuffer(Ws, CHANVESE_BUFFER_IMAGE,
+        sizeof(num)*((size_t)Width)*((size_t)Height)*NumChannels);
+}
+
+
+/** @brief Level set buffer of Width*Height elements in a workspace */
+num *ChanVeseWorkspacePhi(chanveseworkspace *Ws, int Width, int Height)
+{
+    return (num *)WorkspaceBuffer(Ws, CHANVESE_BUFFER_PHI,
+        sizeof(num)*((size_t)Width)*((size_t)Height));
+}
+
+
 /** @brief Specify mu, the edge length penalty */
 void ChanVeseSetMu(chanveseopt *Opt, num Mu)
 {
@@ -425,6 +2333,41 @@ void ChanVeseSetTol(chanveseopt *Opt, num Tol)
 }
 
 
+/**
+ * @brief Specify the sign change tolerance
+ * @param Opt chanveseopt options object
+ * @param FlipTol fraction of the pixels
+ *
+ * When the sign change test is enabled with ChanVeseSetFlipWindow, ChanVese
+ * stops when at most FlipTol*Width*Height pixels changed sign during the
+ * last FlipWindow iterations.  The default is 0, meaning that the
+ * segmentation must be unchanged for FlipWindow iterations.
+ */
+void ChanVeseSetFlipTol(chanveseopt *Opt, num FlipTol)
+{
+    if(Opt)
+        Opt->FlipTol = FlipTol;
+}
+
+
+/**
+ * @brief Specify the number of iterations for the sign change test
+ * @param Opt chanveseopt options object
+ * @param FlipWindow number of iterations, or 0 to disable the test
+ *
+ * The segmentation is given by the sign of Phi, so that it is often final
+ * long before the change in Phi is below Tol.  With FlipWindow > 0, ChanVese
+ * also stops when Phi has (almost) not changed sign in the last FlipWindow
+ * iterations.  The sign changes are counted during the update, so the test
+ * costs no extra pass over Phi.
+ */
+void ChanVeseSetFlipWindow(chanveseopt *Opt, int FlipWindow)
+{
+    if(Opt)
+        Opt->FlipWindow = FlipWindow;
+}
+
+
 /** @brief Specify the timestep */
 void ChanVeseSetDt(chanveseopt *Opt, num dt)
 {
@@ -433,6 +2376,34 @@ void ChanVeseSetDt(chanveseopt *Opt, num dt)
 }
 
 
+/**
+ * @brief Specify how often Phi is reinitialized to a signed distance
+ * @param Opt chanveseopt options object
+ * @param Reinit reinitialization interval in iterations, or 0 to disable
+ *
+ * With Reinit > 0, Phi is replaced every Reinit iterations, starting after
+ * the first Reinit iterations, with the signed distance to its zero level
+ * set divided by the largest distance.  This keeps Phi from becoming steep
+ * or flat away from the curve, so that the evolution stays stable with
+ * larger time steps.  The sign of Phi, and thus the segmentation, is not
+ * changed by the reinitialization.
+ *
+ * Since a signed distance is small only near the curve, the pixels far from
+ * the curve no longer change sign on their own, and the curve moves by a
+ * fraction of a pixel per iteration with the default dt.  Reinit = 1 keeps
+ * the segmentation close to the initial one; use Reinit of 5 or more.  Phi
+ * also changes at every reinitialization, so the Tol test rarely passes:
+ * combine Reinit with ChanVeseSetFlipWindow to stop when the segmentation
+ * no longer changes.  The option has no effect with the sparse field
+ * backend, which maintains its own distance layers.
+ */
+void ChanVeseSetReinit(chanveseopt *Opt, int Reinit)
+{
+    if(Opt)
+        Opt->Reinit = Reinit;
+}
+
+
 /** @brief Specify the maximum number of iterations */
 void ChanVeseSetMaxIter(chanveseopt *Opt, int MaxIter)
 {
@@ -441,6 +2412,321 @@ void ChanVeseSetMaxIter(chanveseopt *Opt, int MaxIter)
 }
 
 
+/**
+ * @brief Specify the solver backend
+ * @param Opt chanveseopt options object
+ * @param Backend one of CHANVESE_BACKEND_LEVELSET,
+ *        CHANVESE_BACKEND_SPARSEFIELD, CHANVESE_BACKEND_PRIMALDUAL, or
+ *        CHANVESE_BACKEND_GRAPHCUT
+ *
+ * CHANVESE_BACKEND_LEVELSET is the semi-implicit scheme of Chan and Vese,
+ * updating Phi over the whole image or over a narrow band.
+ * CHANVESE_BACKEND_SPARSEFIELD moves only the pixels next to the zero level
+ * set, maintaining the region averages incrementally (see sparsefield.c).
+ * The sparse-field front cannot create new components far from the current
+ * contour, so it needs an initialization near the object, such as a box or
+ * ChanVeseInitPhiOtsu.  From the default ChanVeseInitPhi pattern, the small
+ * initial regions shrink away before c1 and c2 separate.  The dt, sweep,
+ * thread, and band options have no effect on the sparse-field backend, and
+ * Tol is compared to the net change of the segmentation over the last 32
+ * iterations relative to the length of the contour.
+ *
+ * CHANVESE_BACKEND_PRIMALDUAL minimizes the convex relaxation of Chan,
+ * Esedoglu, and Nikolova with the primal-dual algorithm of Chambolle and
+ * Pock (see primaldual.c).  For fixed c1 and c2 this finds the global
+ * minimizer regardless of the initialization, which only determines the
+ * initial averages.  The threads option sets the number of threads, while
+ * the dt, sweep, reinit, and band options have no effect.  The returned
+ * Phi is +1 inside and -1 outside of the segmentation.
+ *
+ * CHANVESE_BACKEND_GRAPHCUT minimizes the energy exactly for fixed c1 and c2
+ * with a Boykov-Kolmogorov minimum cut, where the length of the curve is
+ * measured on the grid neighborhood set by ChanVeseSetConnectivity.  Each
+ * iteration is one cut followed by an update of c1 and c2, and Tol is
+ * compared to the fraction of pixels that changed label.  The dt, sweep,
+ * thread, reinit, and band options have no effect, and the returned Phi is
+ * +1 inside and -1 outside of the segmentation.  The max-flow is slow when
+ * the data term is weak, as in the first iteration from the default
+ * initialization where c1 and c2 are nearly equal.  It is best started
+ * from a box or other rough initialization, or used with the pyramid (see
+ * ChanVeseSetLevels).
+ */
+void ChanVeseSetBackend(chanveseopt *Opt, int Backend)
+{
+    if(Opt)
+        Opt->Backend = Backend;
+}
+
+
+/**
+ * @brief Specify the grid neighborhood of the graph-cut backend
+ * @param Opt chanveseopt options object
+ * @param Connectivity 4 or 8
+ *
+ * The curve length is approximated with the Cauchy-Crofton formula over
+ * the edges of the neighborhood.  The 8-neighborhood (the default) measures
+ * diagonal boundaries more accurately, while the 4-neighborhood favors
+ * horizontal and vertical boundaries but uses half the memory.
+ */
+void ChanVeseSetConnectivity(chanveseopt *Opt, int Connectivity)
+{
+    if(Opt)
+        Opt->Connectivity = Connectivity;
+}
+
+
+/**
+ * @brief Specify how the data term is computed
+ * @param Opt chanveseopt options object
+ * @param DataTerm either CHANVESE_DATA_DIRECT or CHANVESE_DATA_MOMENTS
+ *
+ * With CHANVESE_DATA_DIRECT, the distances |f - c1|^2 and |f - c2|^2 are
+ * computed in the sweep for each pixel, looping over the channels.  With
+ * CHANVESE_DATA_MOMENTS, |f|^2 is precomputed once, and the data term is
+ * computed once per iteration as a plane from the inner products of f with
+ * c1 and c2 (see UpdateDataTerm).  The sweep then reads one value per pixel
+ * whatever the number of channels, which is faster for color or
+ * multi-feature images.  The results differ from the direct computation by
+ * rounding.  The moments are not used with the narrow band, where only
+ * part of the data term plane would be needed.
+ */
+void ChanVeseSetDataTerm(chanveseopt *Opt, int DataTerm)
+{
+    if(Opt)
+        Opt->DataTerm = DataTerm;
+}
+
+
+/**
+ * @brief Specify the order in which pixels are updated
+ * @param Opt chanveseopt options object
+ * @param Sweep CHANVESE_SWEEP_SERIAL, CHANVESE_SWEEP_REDBLACK, or
+ *        CHANVESE_SWEEP_TILED
+ *
+ * CHANVESE_SWEEP_SERIAL updates Phi in place in raster order.  This ordering
+ * is inherently sequential.  CHANVESE_SWEEP_REDBLACK updates the pixels in
+ * two half-sweeps in a checkerboard pattern, where each half-sweep is done in
+ * parallel.  CHANVESE_SWEEP_TILED does red-black iterations in blocks of
+ * several iterations on cache-sized tiles (see ChanVeseSetTileSize and
+ * ChanVeseSetTileDepth), the tiles being done in parallel.
+ */
+void ChanVeseSetSweep(chanveseopt *Opt, int Sweep)
+{
+    if(Opt)
+        Opt->Sweep = Sweep;
+}
+
+
+/**
+ * @brief Specify the number of threads for the parallel parts of ChanVese
+ * @param Opt chanveseopt options object
+ * @param NumThreads number of threads, or 0 to use all processors
+ *
+ * The number of threads has an effect only if the program is compiled with
+ * OpenMP.  It is used by the CHANVESE_SWEEP_REDBLACK sweeps, which split
+ * the rows over the threads, and the CHANVESE_SWEEP_TILED sweeps, which
+ * process tiles in parallel; by the precomputation of the data term and
+ * the distance transform of ChanVeseSetReinit with these two sweep
+ * orderings; and by the primal-dual backend.  The serial sweep, the
+ * sparse-field and the graph-cut backends are single threaded.
+ */
+void ChanVeseSetNumThreads(chanveseopt *Opt, int NumThreads)
+{
+    if(Opt)
+        Opt->NumThreads = NumThreads;
+}
+
+
+/**
+ * @brief Specify the tile size for tiled sweeps
+ * @param Opt chanveseopt options object
+ * @param TileSize width and height of the tiles in pixels
+ *
+ * The tile, with a halo of 2*TileDepth pixels on each side, should fit in
+ * the L2 cache together with the corresponding pixels of f.
+ */
+void ChanVeseSetTileSize(chanveseopt *Opt, int TileSize)
+{
+    if(Opt)
+        Opt->TileSize = TileSize;
+}
+
+
+/**
+ * @brief Specify the number of iterations per tile for tiled sweeps
+ * @param Opt chanveseopt options object
+ * @param TileDepth number of iterations done on a tile at a time
+ *
+ * A deeper time block reads Phi and f from memory less often, but needs a
+ * wider halo around each tile, which is updated redundantly, and updates
+ * the region averages less often.
+ */
+void ChanVeseSetTileDepth(chanveseopt *Opt, int TileDepth)
+{
+    if(Opt)
+        Opt->TileDepth = TileDepth;
+}
+
+
+/**
+ * @brief Specify the narrow band half-width
+ * @param Opt chanveseopt options object
+ * @param Band half-width of the band in pixels, or 0 to update all pixels
+ *
+ * With Band > 0, each iteration only updates the pixels within city block
+ * distance Band of the zero level set.  A wider band is rebuilt less often
+ * but costs more per iteration.  Band is limited to 254.
+ */
+void ChanVeseSetBand(chanveseopt *Opt, int Band)
+{
+    if(Opt)
+        Opt->Band = Band;
+}
+
+
+/**
+ * @brief Specify the number of levels for coarse-to-fine segmentation
+ * @param Opt chanveseopt options object
+ * @param NumLevels number of pyramid levels, or 1 to disable the pyramid
+ *
+ * With NumLevels > 1, f and the initial Phi are downsampled NumLevels - 1
+ * times by factors of two.  The coarsest level is solved with up to MaxIter
+ * iterations, and each finer level is initialized by upsampling the solution
+ * of the previous level and refined with up to RefineIter iterations (see
+ * ChanVeseSetRefineIter).  Levels smaller than 16 pixels in width or height
+ * are not used.  The initial Phi is first evolved by one level set iteration
+ * at full resolution, and the length penalty of a level is Mu/2^Level, so
+ * that all levels minimize the energy of the full resolution image.
+ */
+void ChanVeseSetLevels(chanveseopt *Opt, int NumLevels)
+{
+    if(Opt)
+        Opt->NumLevels = NumLevels;
+}
+
+
+/**
+ * @brief Specify the finest pyramid level to solve
+ * @param Opt chanveseopt options object
+ * @param StopLevel finest level that is solved, 0 is full resolution
+ *
+ * With StopLevel > 0, no iterations are done on the levels finer than
+ * StopLevel, and Phi is obtained by upsampling the solution at StopLevel.
+ * This trades accuracy of the boundary for speed.
+ */
+void ChanVeseSetStopLevel(chanveseopt *Opt, int StopLevel)
+{
+    if(Opt)
+        Opt->StopLevel = StopLevel;
+}
+
+
+/** @brief Specify the maximum number of iterations on the finer levels */
+void ChanVeseSetRefineIter(chanveseopt *Opt, int RefineIter)
+{
+    if(Opt)
+        Opt->RefineIter = RefineIter;
+}
+
+
+/**
+ * @brief Specify a time budget for the segmentation
+ * @param Opt chanveseopt options object
+ * @param Deadline time budget in milliseconds, or 0 for no limit
+ *
+ * The elapsed time is checked with Clock() after each iteration (after each
+ * block for tiled sweeps), so the budget may be exceeded by up to one
+ * iteration, which for the graph-cut backend is a whole minimum cut.  With
+ * a pyramid, levels that have not started are skipped.  When the budget is
+ * spent, ChanVese stops, calls the plotting function with State
+ * CHANVESE_DEADLINE, and returns CHANVESE_DEADLINE.  Combine with
+ * ChanVeseSetKeepBest to obtain the best segmentation found within the
+ * budget.
+ */
+void ChanVeseSetDeadline(chanveseopt *Opt, int Deadline)
+{
+    if(Opt)
+        Opt->Deadline = Deadline;
+}
+
+
+/**
+ * @brief Specify whether to return the lowest energy segmentation
+ * @param Opt chanveseopt options object
+ * @param KeepBest nonzero to track the energy
+ *
+ * With KeepBest nonzero, the Chan-Vese energy of the segmentation is
+ * evaluated after every iteration, with c1 and c2 equal to the region
+ * averages and the length measured on the 4-neighborhood, and Phi is
+ * returned from the iteration with the lowest energy.  This costs an
+ * additional pass over Phi and f per iteration and a copy of Phi.  It has an
+ * effect only with the level set backend, since the other backends end on a
+ * segmentation that does not oscillate.
+ */
+void ChanVeseSetKeepBest(chanveseopt *Opt, int KeepBest)
+{
+    if(Opt)
+        Opt->KeepBest = KeepBest;
+}
+
+
+/**
+ * @brief Specify the maximum image side for the segmentation
+ * @param Opt chanveseopt options object
+ * @param MaxSide maximum width and height in pixels, or 0 for no limit
+ *
+ * With MaxSide > 0, an image whose width or height exceeds MaxSide is
+ * downscaled by the smallest integer factor that makes both at most
+ * MaxSide, with area averaging.  The segmentation is computed on the
+ * downscaled image and Phi is upsampled to full resolution with bilinear
+ * interpolation, so the output has the size of the input.  This is much
+ * faster on large images when the segmentation is only needed to the
+ * precision of the reduced size, for instance for a bounding box.
+ */
+void ChanVeseSetMaxSide(chanveseopt *Opt, int MaxSide)
+{
+    if(Opt)
+        Opt->MaxSide = MaxSide;
+}
+
+
+/**
+ * @brief Specify the workspace for the scratch memory
+ * @param Opt chanveseopt options object
+ * @param Ws workspace from ChanVeseNewWorkspace, or NULL
+ *
+ * ChanVese takes all of its scratch memory from Ws.  The workspace keeps the
+ * memory between calls, so after the first call on an image of a given size
+ * and options, further calls do not allocate memory.  A workspace must not
+ * be used by two calls at the same time, so threads calling ChanVese
+ * concurrently should each use their own workspace (ChanVeseBatch does this
+ * for its jobs).  With Ws = NULL, each call creates a temporary workspace.
+ */
+void ChanVeseSetWorkspace(chanveseopt *Opt, chanveseworkspace *Ws)
+{
+    if(Opt)
+        Opt->Workspace = Ws;
+}
+
+
+/**
+ * @brief Specify a trace to record the convergence
+ * @param Opt chanveseopt options object
+ * @param Trace trace from ChanVeseNewTrace, or NULL
+ *
+ * Each call of ChanVese clears the trace and records Delta, c1, c2, and the
+ * number of sign changes of every iteration, see ChanVeseNewTrace and
+ * ChanVeseWriteTrace.  The trace also prints the progress if it was created
+ * with ProgressMs > 0.  As with workspaces, concurrent calls of ChanVese
+ * must not share a trace.
+ */
+void ChanVeseSetTrace(chanveseopt *Opt, chanvesetrace *Trace)
+{
+    if(Opt)
+        Opt->Trace = Trace;
+}
+
+
 /**
  * @brief Specify plotting function
  * @param Opt chanveseopt options object
@@ -449,7 +2735,9 @@ void ChanVeseSetMaxIter(chanveseopt *Opt, int MaxIter)
  *
  * Specifying the plotting function gives control over how ChanVese displays
  * information.  Setting PlotFun = NULL disables all normal display (error
- * messages are still displayed).
+ * messages are still displayed).  The default ChanVeseSimplePlot only prints
+ * the final state; for progress during the computation, use a trace (see
+ * ChanVeseSetTrace), which limits how often the progress is printed.
  *
  * An example PlotFun is
 @code
@@ -468,12 +2756,22 @@ void ChanVeseSetMaxIter(chanveseopt *Opt, int MaxIter)
         case 2:
             fprintf(stderr, " Maximum number of iterations exceeded!\n");
             break;
+        case 3:
+            fprintf(stderr, " NO SIGN CHANGES Iter=%4d\n", Iter);
+            break;
+        case 4:
+            fprintf(stderr, " DEADLINE Iter=%4d\n", Iter);
+            break;
         }
         
         return 1;
     }
 @endcode
- * The State argument is either 0, 1, or 2, and indicates ChanVese's status.
+ * The State argument is one of the CHANVESE_* states defined in chanvese.h,
+ * the same numbering as the return value of ChanVese: 0 running, 1 converged
+ * (change below Tol), 2 maximum number of iterations exceeded, 3 converged
+ * (sign changes below FlipTol), 4 stopped by the deadline (see
+ * ChanVeseSetDeadline).
  * Iter is the number of Bregman iterations completed, Delta is the change in
  * the solution Delta = ||u^cur - u^prev||_2 / ||f||_2.  Argument u gives a
  * pointer to the current solution, which can be used to plot an animated
@@ -498,10 +2796,63 @@ void ChanVesePrintOpt(const chanveseopt *Opt)
         Opt = &DefaultChanVeseOpt;
     
     printf("tol       : %g\n", Opt->Tol);
+    
+    if(Opt->FlipWindow > 0)
+        printf("sign test : %g over %d iterations\n",
+            Opt->FlipTol, Opt->FlipWindow);
+    
     printf("max iter  : %d\n", Opt->MaxIter);
     printf("mu        : %g\n", Opt->Mu);
     printf("nu        : %g\n", Opt->Nu);
     printf("lambda1   : %g\n", Opt->Lambda1);
     printf("lambda2   : %g\n", Opt->Lambda2);
     printf("dt        : %g\n", Opt->dt);
+    
+    if(Opt->Reinit > 0)
+        printf("reinit    : every %d iterations\n", Opt->Reinit);
+    
+    printf("backend   : %s\n", (Opt->Backend == CHANVESE_BACKEND_SPARSEFIELD) ?
+        "sparse field" : (Opt->Backend == CHANVESE_BACKEND_PRIMALDUAL) ?
+        "primal-dual" : (Opt->Backend == CHANVESE_BACKEND_GRAPHCUT) ?
+        "graph cut" : "level set");
+    
+    if(Opt->Backend == CHANVESE_BACKEND_GRAPHCUT)
+        printf("connected : %d\n", Opt->Connectivity);
+    
+    printf("data term : %s\n", (Opt->DataTerm == CHANVESE_DATA_MOMENTS) ?
+        "moments" : "direct");
+    
+    if(Opt->Sweep == CHANVESE_SWEEP_REDBLACK)
+    {
+        if(Opt->NumThreads > 0)
+            printf("sweep     : red-black, %d threads\n", Opt->NumThreads);
+        else
+            printf("sweep     : red-black, all processors\n");
+    }
+    else if(Opt->Sweep == CHANVESE_SWEEP_TILED)
+        printf("sweep     : tiled, %dx%d tiles, %d iterations per block\n",
+            Opt->TileSize, Opt->TileSize, Opt->TileDepth);
+    else
+        printf("sweep     : serial\n");
+    
+    if(Opt->Band > 0)
+        printf("band      : %d\n", Opt->Band);
+    else
+        printf("band      : full domain\n");
+    
+    if(Opt->NumLevels > 1)
+    {
+        printf("levels    : %d\n", Opt->NumLevels);
+        printf("stoplevel : %d\n", Opt->StopLevel);
+        printf("refineiter: %d\n", Opt->RefineIter);
+    }
+    
+    if(Opt->Deadline > 0)
+        printf("deadline  : %d ms\n", Opt->Deadline);
+    
+    if(Opt->KeepBest)
+        printf("keep best : lowest energy\n");
+    
+    if(Opt->MaxSide > 0)
+        printf("max side  : %d\n", Opt->MaxSide);
 }
@@ -6,9 +6,92 @@
 #ifndef _CHANVESE_H_
 #define _CHANVESE_H_
 
+#include <stddef.h>
 #include "num.h"
 
 typedef struct chanvesestruct chanveseopt;
+typedef struct workspacestruct chanveseworkspace;
+typedef struct chanvesetracestruct chanvesetrace;
+
+/** @brief Evolve Phi over the whole image (or narrow band) */
+#define CHANVESE_BACKEND_LEVELSET       0
+/** @brief Evolve the zero level set with the sparse-field method */
+#define CHANVESE_BACKEND_SPARSEFIELD    1
+/** @brief Solve the convex relaxation with a primal-dual algorithm */
+#define CHANVESE_BACKEND_PRIMALDUAL     2
+/** @brief Alternate minimum graph cuts and region average updates */
+#define CHANVESE_BACKEND_GRAPHCUT       3
+
+/* States of the segmentation.  ChanVese returns the final state, or 0 on
+   failure, and the plotting function receives the state as its first
+   argument, 0 while the iterations are running (see ChanVeseSetPlotFun). */
+/** @brief The iterations are running (plotting function only) */
+#define CHANVESE_RUNNING            0
+/** @brief Converged, the change in the iteration was at most Tol */
+#define CHANVESE_CONVERGED          1
+/** @brief The maximum number of iterations was reached */
+#define CHANVESE_MAXITER            2
+/** @brief Converged, the sign changes were at most FlipTol */
+#define CHANVESE_NOFLIPS            3
+/** @brief Stopped by the deadline */
+#define CHANVESE_DEADLINE           4
+
+/* Persistent buffers of a workspace (see ChanVeseWorkspaceBuffer) */
+/** @brief The image */
+#define CHANVESE_BUFFER_IMAGE       0
+/** @brief The level set */
+#define CHANVESE_BUFFER_PHI         1
+/** @brief RGBA data for decoding the image */
+#define CHANVESE_BUFFER_DECODE      2
+/** @brief File data of a row for decoding the image */
+#define CHANVESE_BUFFER_DECODE_ROW  3
+
+/** @brief A segmentation job for ChanVeseBatch */
+typedef struct
+{
+    /** @brief Initial level set on input, final level set on output */
+    num *Phi;
+    /** @brief Input image in planar order */
+    const num *f;
+    int Width;
+    int Height;
+    int NumChannels;
+    /** @brief Options, or NULL for the defaults */
+    const chanveseopt *Opt;
+    /** @brief Return value of ChanVese, 0 on failure or a CHANVESE_* state */
+    int Status;
+    /** @brief Number of iterations */
+    int Iter;
+    /** @brief Wall clock time spent on the job in seconds */
+    double Seconds;
+} chanvesejob;
+
+/** @brief Bounding box of the largest region of a segmentation */
+typedef struct
+{
+    /** @brief Left column of the bounding box */
+    int x;
+    /** @brief Top row of the bounding box */
+    int y;
+    int Width;
+    int Height;
+    /** @brief Number of pixels in the region */
+    long Area;
+    /** @brief Number of connected components in the segmentation */
+    long NumComponents;
+} chanveseroi;
+
+/** @brief Compute the data term from f for each pixel and channel */
+#define CHANVESE_DATA_DIRECT        0
+/** @brief Compute the data term once per iteration from moments of f */
+#define CHANVESE_DATA_MOMENTS       1
+
+/** @brief Update Phi in place in raster order */
+#define CHANVESE_SWEEP_SERIAL       0
+/** @brief Update Phi in checkerboard order, rows split over threads */
+#define CHANVESE_SWEEP_REDBLACK     1
+/** @brief Red-black sweeps, several iterations at a time on cache-sized tiles */
+#define CHANVESE_SWEEP_TILED        2
 
 chanveseopt *ChanVeseNewOpt();
 void ChanVeseFreeOpt(chanveseopt *Opt);
@@ -17,8 +100,27 @@ void ChanVeseSetNu(chanveseopt *Opt, num Nu);
 void ChanVeseSetLambda1(chanveseopt *Opt, num Lambda1);
 void ChanVeseSetLambda2(chanveseopt *Opt, num Lambda2);
 void ChanVeseSetTol(chanveseopt *Opt, num Tol);
+void ChanVeseSetFlipTol(chanveseopt *Opt, num FlipTol);
+void ChanVeseSetFlipWindow(chanveseopt *Opt, int FlipWindow);
 void ChanVeseSetDt(chanveseopt *Opt, num dt);
+void ChanVeseSetReinit(chanveseopt *Opt, int Reinit);
 void ChanVeseSetMaxIter(chanveseopt *Opt, int MaxIter);
+void ChanVeseSetBackend(chanveseopt *Opt, int Backend);
+void ChanVeseSetConnectivity(chanveseopt *Opt, int Connectivity);
+void ChanVeseSetDataTerm(chanveseopt *Opt, int DataTerm);
+void ChanVeseSetSweep(chanveseopt *Opt, int Sweep);
+void ChanVeseSetNumThreads(chanveseopt *Opt, int NumThreads);
+void ChanVeseSetTileSize(chanveseopt *Opt, int TileSize);
+void ChanVeseSetTileDepth(chanveseopt *Opt, int TileDepth);
+void ChanVeseSetBand(chanveseopt *Opt, int Band);
+void ChanVeseSetLevels(chanveseopt *Opt, int NumLevels);
+void ChanVeseSetStopLevel(chanveseopt *Opt, int StopLevel);
+void ChanVeseSetRefineIter(chanveseopt *Opt, int RefineIter);
+void ChanVeseSetDeadline(chanveseopt *Opt, int Deadline);
+void ChanVeseSetKeepBest(chanveseopt *Opt, int KeepBest);
+void ChanVeseSetMaxSide(chanveseopt *Opt, int MaxSide);
+void ChanVeseSetWorkspace(chanveseopt *Opt, chanveseworkspace *Ws);
+void ChanVeseSetTrace(chanveseopt *Opt, chanvesetrace *Trace);
 void ChanVeseSetPlotFun(chanveseopt *Opt,
     int (*PlotFun)(int, int, num, const num*, const num*, const num*,
         int, int, int, void*), void *PlotParam);
@@ -26,8 +128,27 @@ void ChanVesePrintOpt(const chanveseopt *Opt);
 
 int ChanVese(num *Phi, const num *f,
     int Width, int Height, int NumChannels, const chanveseopt *Opt);
+int ChanVeseBatch(chanvesejob *Jobs, int NumJobs, int NumThreads);
+
+chanveseworkspace *ChanVeseNewWorkspace();
+void ChanVeseFreeWorkspace(chanveseworkspace *Ws);
+void *ChanVeseWorkspaceBuffer(chanveseworkspace *Ws, int Buffer, size_t Size);
+num *ChanVeseWorkspaceImage(chanveseworkspace *Ws,
+    int Width, int Height, int NumChannels);
+num *ChanVeseWorkspacePhi(chanveseworkspace *Ws, int Width, int Height);
+
+chanvesetrace *ChanVeseNewTrace(int Capacity, int ProgressMs);
+void ChanVeseFreeTrace(chanvesetrace *Trace);
+int ChanVeseWriteTrace(const chanvesetrace *Trace, const char *FileName);
 
 void ChanVeseInitPhi(num *Phi, int Width, int Height);
+int ChanVeseInitPhiBox(num *Phi, int Width, int Height, double Fraction);
+int ChanVeseInitPhiEllipse(num *Phi, int Width, int Height, double Fraction);
+int ChanVeseInitPhiOtsu(num *Phi, const num *f,
+    int Width, int Height, int NumChannels);
+
+int ChanVeseLargestRegion(chanveseroi *Roi, const num *Phi,
+    int Width, int Height, int Connectivity);
 
 void RegionAverages(num *c1, num *c2, const num *Phi, const num *f,
     int Width, int Height, int NumChannels);
@@ -0,0 +1,188 @@
+/**
+ * @file chanvesebatch.c
+ * @brief Chan-Vese segmentation of several images in parallel
+ *
+ * ChanVeseBatch runs a list of independent ChanVese jobs on a pool of
+ * threads.  The jobs are sorted by decreasing image size and handed out one
+ * at a time to whichever thread is idle, so that a few large images do not
+ * leave the other threads waiting at the end of the batch.
+ */
+
+#include <stdlib.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "basic.h"
+#include "chanveseopt.h"
+
+/** @brief Job order entry, sorted by decreasing number of pixels */
+typedef struct
+{
+    long NumPixels;
+    int Index;
+} jobsize;
+
+/** @brief Plotting function wrapper recording the iterations of a job */
+typedef struct
+{
+    int (*PlotFun)(int, int, num, const num*, const num*, const num*,
+        int, int, int, void*);
+    void *PlotParam;
+    chanvesejob *Job;
+} batchplot;
+
+
+/** @brief Compare jobs by decreasing size for qsort */
+static int CompareJobSize(const void *a, const void *b)
+{
+    const long Diff = ((const jobsize *)b)->NumPixels
+        - ((const jobsize *)a)->NumPixels;
+    
+    if(Diff)
+        return (Diff > 0) ? 1 : -1;
+    else    /* Keep the job order for equal sizes */
+        return ((const jobsize *)a)->Index - ((const jobsize *)b)->Index;
+}
+
+
+/** @brief Plotting function for batch jobs */
+static int BatchPlot(int State, int Iter, num Delta,
+    const num *c1, const num *c2, const num *Phi,
+    int Width, int Height, int NumChannels, void *Param)
+{
+    batchplot *Plot = (batchplot *)Param;
+    
+    if(State != CHANVESE_RUNNING)
+        Plot->Job->Iter = Iter;
+    
+    return (Plot->PlotFun) ? Plot->PlotFun(State, Iter, Delta, c1, c2, Phi,
+        Width, Height, NumChannels, Plot->PlotParam) : 1;
+}
+
+
+/** @brief Run one job of the batch */
+static void RunJob(chanvesejob *Job, const chanveseopt *DefaultOpt,
+    workspace *Ws)
+{
+    struct chanvesestruct Opt;
+    batchplot Plot;
+    const unsigned long StartTime = Clock();
+    
+    Opt = (Job->Opt) ? *Job->Opt : *DefaultOpt;
+    Plot.PlotFun = Opt.PlotFun;
+    Plot.PlotParam = Opt.PlotParam;
+    Plot.Job = Job;
+    Opt.PlotFun = BatchPlot;
+    Opt.PlotParam = &Plot;
+    
+    if(!Opt.Workspace)
+        Opt.Workspace = Ws;
+    
+    Job->Iter = 0;
+    Job->Status = ChanVese(Job->Phi, Job->f,
+        Job->Width, Job->Height, Job->NumChannels, &Opt);
+    
+    Job->Seconds = (Clock() - StartTime)/1000.0;
+}
+
+
+/**
+ * @brief Chan-Vese segmentation of a batch of images
+ * @param Jobs array of jobs
+ * @param NumJobs number of jobs
+ * @param NumThreads number of threads, or 0 to use all processors
+ * @return 1 if every job succeeded, 0 otherwise
+ *
+ * Each job is solved as with ChanVese(Job->Phi, Job->f, Job->Width,
+ * Job->Height, Job->NumChannels, Job->Opt), where Job->Opt may be NULL for
+ * the default options.  On return, each job's Status, Iter, and Seconds are
+ * filled in:
+ *
+ * @li Status is the return value of ChanVese: 0 if the job failed,
+ *     otherwise the final CHANVESE_* state defined in chanvese.h
+ * @li Iter is the number of iterations
+ * @li Seconds is the wall clock time spent on the job, measured with Clock()
+ *
+ * The jobs are distributed dynamically over NumThreads threads (when
+ * compiled with OpenMP), largest images first.  The images are not
+ * themselves split over threads, since nested parallelism is normally
+ * disabled.  The plotting function of each job is called from the thread
+ * running it, so it must be thread safe or NULL.  Note that the default
+ * options print the final state of each job with ChanVeseSimplePlot; use
+ * ChanVeseSetPlotFun(Opt, NULL, NULL) to run the batch quietly.  Jobs
+ * running concurrently must not share a trace (see ChanVeseSetTrace).
+ *
+ * Each thread has its own workspace (see ChanVeseSetWorkspace), which is
+ * used for the jobs whose options do not set one, so that the scratch
+ * memory is allocated once per thread rather than once per job.  Since a
+ * workspace must not be shared between threads, a workspace set in the
+ * options of a job is only safe if no other job uses it.
+ */
+int ChanVeseBatch(chanvesejob *Jobs, int NumJobs, int NumThreads)
+{
+    jobsize *Order = NULL;
+    chanveseopt *DefaultOpt = NULL;
+    workspace **Ws = NULL;
+    int k, Success = 0;
+    
+    if(!Jobs || NumJobs < 0 || NumThreads < 0)
+        return 0;
+    else if(NumJobs == 0)
+        return 1;
+
+#ifdef _OPENMP
+    if(NumThreads == 0)
+        NumThreads = omp_get_num_procs();
+#else
+    NumThreads = 1;
+#endif
+
+    if(!(Order = (jobsize *)Malloc(sizeof(jobsize)*NumJobs))
+        || !(DefaultOpt = ChanVeseNewOpt())
+        || !(Ws = (workspace **)Malloc(sizeof(workspace *)*NumThreads)))
+        goto Catch;
+    
+    for(k = 0; k < NumThreads; k++)
+        Ws[k] = NULL;
+    
+    for(k = 0; k < NumThreads; k++)
+        if(!(Ws[k] = WorkspaceNew()))
+            goto Catch;
+    
+    for(k = 0; k < NumJobs; k++)
+    {
+        Order[k].NumPixels = ((long)Jobs[k].Width) * ((long)Jobs[k].Height);
+        Order[k].Index = k;
+    }
+    
+    qsort(Order, NumJobs, sizeof(jobsize), CompareJobSize);
+
+#ifdef _OPENMP
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(NumThreads)
+    for(k = 0; k < NumJobs; k++)
+        RunJob(&Jobs[Order[k].Index], DefaultOpt, Ws[omp_get_thread_num()]);
+#else
+    for(k = 0; k < NumJobs; k++)
+        RunJob(&Jobs[Order[k].Index], DefaultOpt, Ws[0]);
+#endif
+    
+    for(k = 0, Success = 1; k < NumJobs; k++)
+        if(!Jobs[k].Status)
+            Success = 0;
+
+Catch:
+    if(Ws)
+    {
+        for(k = 0; k < NumThreads; k++)
+            WorkspaceFree(Ws[k]);
+        
+        Free(Ws);
+    }
+    if(DefaultOpt)
+        ChanVeseFreeOpt(DefaultOpt);
+    if(Order)
+        Free(Order);
+    return Success;
+}
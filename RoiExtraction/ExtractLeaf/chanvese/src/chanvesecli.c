@@ -29,6 +29,12 @@
 #define ROUNDCLAMP(x)   ((x < 0) ? 0 : \
     ((x > 1) ? 255 : (uint8_t)floor(255.0*(x) + 0.5)))
 
+/** @brief Built-in initializations of phi */
+#define PHI0_DEFAULT    0
+#define PHI0_BOX        1
+#define PHI0_ELLIPSE    2
+#define PHI0_OTSU       3
+
 #ifdef __GNUC__
     /** @brief Macro for the unused attribue GNU extension */
     #define ATTRIBUTE_UNUSED __attribute__((unused))
@@ -50,8 +56,28 @@ typedef struct
   
     /** @brief Level set */
     image Phi;
+    /** @brief Built-in initialization of Phi (PHI0_*), if not read */
+    int PhiInit;
+    /** @brief Size of the box or ellipse as a fraction of the image */
+    double PhiFraction;
+    /** @brief Solver backend (CHANVESE_BACKEND_*) */
+    int Backend;
     /** @brief ChanVese options object */
     chanveseopt *Opt;
+    /** @brief Convergence trace output file name */
+    const char *TraceFile;
+    /** @brief Number of iterations kept in the trace */
+    int TraceLength;
+    /** @brief Minimum interval between progress lines in milliseconds */
+    int ProgressMs;
+    /** @brief ROI bounding box JSON output file name */
+    const char *RoiFile;
+    /** @brief Cropped ROI image output file name */
+    const char *RoiCropFile;
+    /** @brief Image to crop for RoiCropFile, NULL for the input */
+    const char *RoiSourceFile;
+    /** @brief Reduced size JPEG decoding of the input (IMAGEIO_SCALE_*) */
+    unsigned DecodeScale;
     
     int IterPerFrame;
 } programparams;
@@ -81,9 +107,59 @@ static void PrintHelpMessage()
     puts("   lambda1:<number>      fit weight inside the cuve (default 1.0)");
     puts("   lambda2:<number>      fit weight outside the curve (default 1.0)");
     puts("   phi0:<file>           read initial level set from an image or text file");
+    puts("   phi0:box:<fraction>   initial level set is a centered box covering this");
+    puts("                         fraction of the width and height (default 2/3)");
+    puts("   phi0:ellipse:<fraction> centered ellipse (default 2/3)");
+    puts("   phi0:otsu             Otsu threshold of the image");
     puts("   tol:<number>          convergence tolerance (default 1e-3)");
+    puts("   flipwindow:<number>   stop when the sign of phi did not change for this");
+    puts("                         many iterations (default 0 = off)");
+    puts("   fliptol:<number>      fraction of pixels allowed to change sign within");
+    puts("                         flipwindow (default 0)");
     puts("   maxiter:<number>      maximum number of iterations (default 500)");
-    puts("   dt:<number>           time step (default 0.5)\n");
+    puts("   dt:<number>           time step (default 0.5)");
+    puts("   reinit:<number>       reinitialize phi to a signed distance every");
+    puts("                         this many iterations (default 0 = off); use 5");
+    puts("                         or more with flipwindow, reinit:1 barely moves");
+    puts("   backend:<method>      solver, method is");
+    puts("                         levelset    level set over the image (default)");
+    puts("                         sparsefield level set on the boundary only,");
+    puts("                                     phi0:otsu by default");
+    puts("                         primaldual  convex relaxation, multithreaded");
+    puts("                         graphcut    min cuts alternating with c1, c2");
+    puts("   connectivity:<number> graphcut neighborhood, 4 or 8 (default 8)");
+    puts("   dataterm:<method>     data term computation, method is");
+    puts("                         direct   per pixel and channel (default)");
+    puts("                         moments  once per iteration from moments of f");
+    puts("   sweep:<method>        pixel update order, method is");
+    puts("                         serial   in-place raster order (default)");
+    puts("                         redblack checkerboard order, multithreaded");
+    puts("                         tiled    redblack on cache-sized tiles");
+    puts("   threads:<number>      threads for redblack, tiled, primaldual (default 0 = all)");
+    puts("   tilesize:<number>     tile size for tiled sweeps (default 128)");
+    puts("   tiledepth:<number>    iterations per tile (default 4)");
+    puts("   band:<number>         narrow band half-width in pixels (default 0 = off)");
+    puts("   levels:<number>       coarse-to-fine pyramid levels (default 1 = off)");
+    puts("   stoplevel:<number>    finest pyramid level to solve (default 0 = full)");
+    puts("   refineiter:<number>   max iterations on finer levels (default 20)");
+    puts("   deadline:<number>     time budget in milliseconds (default 0 = none)");
+    puts("   keepbest:<number>     if 1, return the lowest energy phi (default 0)");
+    puts("   maxside:<number>      segment images larger than this many pixels on");
+    puts("                         a side at reduced size (default 0 = off)");
+    puts("   decodescale:<scale>   decode JPEG input at reduced size, scale is 1/2,");
+    puts("                         1/4, 1/8, or a number for the smallest of these");
+    puts("                         keeping at least this many pixels on the larger");
+    puts("                         side (default 1 = full size)");
+    puts("   progress:<number>     print progress at most every this many");
+    puts("                         milliseconds (default 250, 0 = off)");
+    puts("   trace:<file>          write the convergence trace, as JSON if file ends");
+    puts("                         with .json and as CSV otherwise");
+    puts("   tracelen:<number>     iterations kept in the trace (default 10000)");
+    puts("   roi:<file>            write the bounding box of the largest connected");
+    puts("                         region of the segmentation as JSON");
+    puts("   roicrop:<file>        write the image cropped to this bounding box");
+    puts("   roisource:<file>      image to crop instead of the input, it must have");
+    puts("                         the same size as the input before decodescale\n");
     puts("   iterperframe:<number> iterations per frame (default 10)\n");
 #ifdef LIBJPEG_SUPPORT
     puts("   jpegquality:<number>  Quality for saving JPEG images (0 to 100)\n");
@@ -102,6 +178,8 @@ static int PlotFun(int State, int Iter, num Delta,
     int Width, int Height, int NumChannels, void *ParamPtr);
 static int ParseParam(programparams *Param, int argc, const char *argv[]);
 static int PhiRescale(image *Phi);
+static int ParsePhiInit(programparams *Param, const char *Value);
+static void *DecodeBuffer(void *Ws, int Buffer, size_t Size);
 
 
 int WriteBinary(image Phi, const char *File)
@@ -172,13 +250,111 @@ Catch:
 }
 
 
+/* Write the ROI bounding box as a JSON object */
+int WriteRoi(const chanveseroi *Roi, int Width, int Height, const char *File)
+{
+    FILE *Fp;
+    int Success;
+    
+    if(!(Fp = fopen(File, "wt")))
+    {
+        fprintf(stderr, "Unable to write \"%s\".\n", File);
+        return 0;
+    }
+    
+    fprintf(Fp, "{\"x\": %d, \"y\": %d, \"width\": %d, \"height\": %d, "
+        "\"area\": %ld, \"components\": %ld, "
+        "\"image_width\": %d, \"image_height\": %d}\n",
+        Roi->x, Roi->y, Roi->Width, Roi->Height, Roi->Area,
+        Roi->NumComponents, Width, Height);
+    Success = !ferror(Fp);
+    
+    if(fclose(Fp) || !Success)
+    {
+        fprintf(stderr, "Error writing \"%s\".\n", File);
+        return 0;
+    }
+    
+    printf("ROI written to \"%s\".\n", File);
+    return 1;
+}
+
+
+/* Crop the RGB source image to the ROI and write it */
+int WriteRoiCrop(const chanveseroi *Roi, int Width, int Height,
+    const char *SourceFile, const char *File, int JpegQuality)
+{
+    unsigned char *Image = NULL;
+    int SourceWidth, SourceHeight, Factor, x0, y0, CropWidth, CropHeight;
+    int j, Success = 0;
+    
+    if(!Roi->Area)
+    {
+        fprintf(stderr, "The segmentation is empty, no ROI to crop.\n");
+        return 0;
+    }
+    
+    if(!(Image = (unsigned char *)ReadImage(&SourceWidth, &SourceHeight,
+        SourceFile, IMAGEIO_U8 | IMAGEIO_RGB)))
+        goto Catch;
+    
+    /* The input may have been decoded at 1/2, 1/4, or 1/8 size */
+    for(Factor = 1; Factor <= 8; Factor *= 2)
+        if((SourceWidth + Factor - 1)/Factor == Width
+            && (SourceHeight + Factor - 1)/Factor == Height)
+            break;
+    
+    if(Factor > 8)
+    {
+        fprintf(stderr, "Size mismatch: "
+            "roisource (%dx%d) does not match image size (%dx%d).\n",
+            SourceWidth, SourceHeight, Width, Height);
+        goto Catch;
+    }
+    
+    /* Scale the ROI to the source */
+    x0 = Factor*Roi->x;
+    y0 = Factor*Roi->y;
+    CropWidth = Factor*Roi->Width;
+    CropHeight = Factor*Roi->Height;
+    
+    if(CropWidth > SourceWidth - x0)
+        CropWidth = SourceWidth - x0;
+    if(CropHeight > SourceHeight - y0)
+        CropHeight = SourceHeight - y0;
+    
+    /* Pack the rows of the ROI at the start of the image, in place */
+    for(j = 0; j < CropHeight; j++)
+        memmove(Image + 3*((long)CropWidth)*j,
+            Image + 3*(((long)SourceWidth)*(y0 + j) + x0),
+            3*CropWidth);
+    
+    if(!WriteImage(Image, CropWidth, CropHeight, File,
+        IMAGEIO_U8 | IMAGEIO_RGB, JpegQuality))
+    {
+        fprintf(stderr, "Error writing \"%s\".\n", File);
+        goto Catch;
+    }
+    
+    printf("Cropped ROI written to \"%s\".\n", File);
+    Success = 1;
+Catch:
+    if(Image)
+        free(Image);
+    return Success;
+}
+
+
 int main(int argc, char *argv[])
 {
     programparams Param;
     plotparam PlotParam;
+    chanvesetrace *Trace = NULL;
+    chanveseworkspace *Ws = NULL;
+    chanveseroi Roi;
     image f = NullImage;
     num c1[3], c2[3];
-    int Status = 1;
+    int Success, PhiInWorkspace = 0, Status = 1;
     
     PlotParam.Plot = NULL;
     PlotParam.Delays = NULL;
@@ -186,8 +362,19 @@ int main(int argc, char *argv[])
     if(!ParseParam(&Param, argc, (const char **)argv))
         goto Catch;
     
+    /* The workspace holds the image, Phi, and the scratch memory of the
+       Phi initialization and of ChanVese */
+    if(!(Ws = ChanVeseNewWorkspace()))
+    {
+        fprintf(stderr, "Out of memory.\n");
+        goto Catch;
+    }
+    
+    ChanVeseSetWorkspace(Param.Opt, Ws);
+    
     /* Read the input image */
-    if(!ReadImageObj(&f, Param.InputFile))
+    if(!ReadImageObjBuffered(&f, Param.InputFile, Param.DecodeScale,
+        DecodeBuffer, (void *)Ws))
         goto Catch;
     
     if(Param.Phi.Data &&
@@ -205,10 +392,33 @@ int main(int argc, char *argv[])
     
     ChanVeseSetPlotFun(Param.Opt, PlotFun, (void *)&PlotParam);
     
+    if(Param.TraceFile || Param.ProgressMs > 0)
+    {
+        if(!(Trace = ChanVeseNewTrace((Param.TraceFile) ?
+            Param.TraceLength : 0, Param.ProgressMs)))
+        {
+            fprintf(stderr, "Out of memory.\n");
+            goto Catch;
+        }
+        
+        ChanVeseSetTrace(Param.Opt, Trace);
+    }
+    
     printf("Segmentation parameters\n");
     printf("f         : [%d x %d %s]\n",
         f.Width, f.Height, (f.NumChannels == 1) ? "grayscale" : "RGB");
-    printf("phi0      : %s\n", (Param.Phi.Data) ? "custom" : "default");
+    
+    if(Param.Phi.Data)
+        printf("phi0      : custom\n");
+    else if(Param.PhiInit == PHI0_BOX)
+        printf("phi0      : box %g\n", Param.PhiFraction);
+    else if(Param.PhiInit == PHI0_ELLIPSE)
+        printf("phi0      : ellipse %g\n", Param.PhiFraction);
+    else if(Param.PhiInit == PHI0_OTSU)
+        printf("phi0      : otsu\n");
+    else
+        printf("phi0      : default\n");
+    
     ChanVesePrintOpt(Param.Opt);
 #ifdef NUM_SINGLE
     printf("datatype  : single precision float\n");
@@ -219,13 +429,37 @@ int main(int argc, char *argv[])
     
     if(!Param.Phi.Data)
     {
-        if(!AllocImageObj(&Param.Phi, f.Width, f.Height, 1))
+        Param.Phi.Width = f.Width;
+        Param.Phi.Height = f.Height;
+        Param.Phi.NumChannels = 1;
+        PhiInWorkspace = 1;
+        
+        if(!(Param.Phi.Data = ChanVeseWorkspacePhi(Ws, f.Width, f.Height)))
         {
             fprintf(stderr, "Out of memory.");
             goto Catch;
         }
         
-        ChanVeseInitPhi(Param.Phi.Data, Param.Phi.Width, Param.Phi.Height);
+        if(Param.PhiInit == PHI0_BOX)
+            Success = ChanVeseInitPhiBox(Param.Phi.Data,
+                f.Width, f.Height, Param.PhiFraction);
+        else if(Param.PhiInit == PHI0_ELLIPSE)
+            Success = ChanVeseInitPhiEllipse(Param.Phi.Data,
+                f.Width, f.Height, Param.PhiFraction);
+        else if(Param.PhiInit == PHI0_OTSU)
+            Success = ChanVeseInitPhiOtsu(Param.Phi.Data, f.Data,
+                f.Width, f.Height, f.NumChannels);
+        else
+        {
+            ChanVeseInitPhi(Param.Phi.Data, Param.Phi.Width, Param.Phi.Height);
+            Success = 1;
+        }
+        
+        if(!Success)
+        {
+            fprintf(stderr, "Out of memory.\n");
+            goto Catch;
+        }
     }
 
     /* Perform the segmentation */
@@ -250,6 +484,35 @@ int main(int argc, char *argv[])
     
     if(Param.OutputFile2 && !WriteBinary(Param.Phi, Param.OutputFile2))
         goto Catch;
+    
+    if(Param.RoiFile || Param.RoiCropFile)
+    {
+        if(!ChanVeseLargestRegion(&Roi, Param.Phi.Data,
+            f.Width, f.Height, 8))
+        {
+            fprintf(stderr, "Out of memory.\n");
+            goto Catch;
+        }
+        
+        printf("ROI       : [%d x %d] at (%d, %d), %ld pixels, "
+            "%ld components\n", Roi.Width, Roi.Height, Roi.x, Roi.y,
+            Roi.Area, Roi.NumComponents);
+        
+        if(Param.RoiFile
+            && !WriteRoi(&Roi, f.Width, f.Height, Param.RoiFile))
+            goto Catch;
+        
+        if(Param.RoiCropFile && !WriteRoiCrop(&Roi, f.Width, f.Height,
+            (Param.RoiSourceFile) ? Param.RoiSourceFile : Param.InputFile,
+            Param.RoiCropFile, Param.JpegQuality))
+            goto Catch;
+    }
+    
+    if(Param.TraceFile && !ChanVeseWriteTrace(Trace, Param.TraceFile))
+    {
+        fprintf(stderr, "Error writing \"%s\".\n", Param.TraceFile);
+        goto Catch;
+    }
         
     if(!WriteAnimation(&PlotParam, f.Width, f.Height, Param.OutputFile))
         goto Catch;
@@ -260,13 +523,35 @@ Catch:
         free(PlotParam.Plot);
     if(PlotParam.Delays)
         free(PlotParam.Delays);
-    FreeImageObj(Param.Phi);
-    FreeImageObj(f);
+    if(!PhiInWorkspace)
+        FreeImageObj(Param.Phi);
+    ChanVeseFreeTrace(Trace);
     ChanVeseFreeOpt(Param.Opt);
+    ChanVeseFreeWorkspace(Ws);
     return Status;
 }
 
 
+/* Buffer function for ReadImageBuffered, decoding into the workspace */
+static void *DecodeBuffer(void *Ws, int Buffer, size_t Size)
+{
+    switch(Buffer)
+    {
+    case IMAGEIO_BUFFER_IMAGE:
+        Buffer = CHANVESE_BUFFER_IMAGE;
+        break;
+    case IMAGEIO_BUFFER_RGBA:
+        Buffer = CHANVESE_BUFFER_DECODE;
+        break;
+    default:
+        Buffer = CHANVESE_BUFFER_DECODE_ROW;
+        break;
+    }
+    
+    return ChanVeseWorkspaceBuffer((chanveseworkspace *)Ws, Buffer, Size);
+}
+
+
 /* Plot callback function */
 static int PlotFun(int State, int Iter, ATTRIBUTE_UNUSED num Delta,
     ATTRIBUTE_UNUSED const num *c1, ATTRIBUTE_UNUSED const num *c2,
@@ -285,16 +570,7 @@ static int PlotFun(int State, int Iter, ATTRIBUTE_UNUSED num Delta,
     switch(State)
     {
     case 0:
-        /* We print to stderr so that messages are displayed on the console
-           immediately, during the TvRestore computation.  If we use stdout,
-           messages might be buffered and not displayed until after TvRestore
-           completes, which would defeat the point of having this real-time
-           plot callback. */
-        if(NumChannels == 1)
-            fprintf(stderr, "   Iteration %4d     Delta %7.4f     c1 = %6.4f     c2 = %6.4f\r",
-                Iter, Delta, *c1, *c2);
-        else
-            fprintf(stderr, "   Iteration %4d     Delta %7.4f\r", Iter, Delta);
+        /* The progress is printed by the trace, at a limited rate */
         break;
     case 1: /* Converged successfully */
         fprintf(stderr, "Converged in %d iterations.                                            \n",
@@ -303,6 +579,14 @@ static int PlotFun(int State, int Iter, ATTRIBUTE_UNUSED num Delta,
     case 2: /* Maximum iterations exceeded */
         fprintf(stderr, "Maximum number of iterations exceeded.                                 \n");
         break;
+    case 3: /* Converged, Phi stopped changing sign */
+        fprintf(stderr, "Sign changes stopped after %d iterations.                              \n",
+            Iter);
+        break;
+    case 4: /* Deadline reached */
+        fprintf(stderr, "Deadline reached after %d iterations.                                  \n",
+            Iter);
+        break;
     }
     
     if(State == 0 && (Iter % PlotParam->IterPerFrame) > 0)
@@ -389,15 +673,26 @@ static int ParseParam(programparams *Param, int argc, const char *argv[])
     const char *Option, *Value;
     num NumValue;
     char TokenBuf[256];
-    int k, kread, Skip;
+    int k, kread, Skip, Status;
     
     
     /* Set parameter defaults */
     Param->InputFile = NULL;
     Param->OutputFile = NULL;
+    Param->OutputFile2 = NULL;
     Param->JpegQuality = 85;
     Param->Phi = NullImage;
+    Param->PhiInit = PHI0_DEFAULT;
+    Param->PhiFraction = 2.0/3.0;
+    Param->Backend = CHANVESE_BACKEND_LEVELSET;
     Param->Opt = NULL;
+    Param->TraceFile = NULL;
+    Param->TraceLength = 10000;
+    Param->ProgressMs = 250;
+    Param->RoiFile = NULL;
+    Param->RoiCropFile = NULL;
+    Param->RoiSourceFile = NULL;
+    Param->DecodeScale = 0;
     Param->IterPerFrame = 10;
     
     if(!(Param->Opt = ChanVeseNewOpt()))
@@ -459,6 +754,30 @@ static int ParseParam(programparams *Param, int argc, const char *argv[])
             else
                 return 0;
         }
+        else if(!strcmp(Option, "fliptol"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Sign change tolerance must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetFlipTol(Param->Opt, NumValue);
+        }
+        else if(!strcmp(Option, "flipwindow"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Sign change window must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetFlipWindow(Param->Opt, (int)NumValue);
+        }
         else if(!strcmp(Option, "mu"))
         {
             if(CliGetNum(&NumValue, Value, Option))
@@ -501,6 +820,300 @@ static int ParseParam(programparams *Param, int argc, const char *argv[])
             else
                 return 0;
         }
+        else if(!strcmp(Option, "backend"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            else if(!strcmp(Value, "levelset"))
+                Param->Backend = CHANVESE_BACKEND_LEVELSET;
+            else if(!strcmp(Value, "sparsefield"))
+                Param->Backend = CHANVESE_BACKEND_SPARSEFIELD;
+            else if(!strcmp(Value, "primaldual"))
+                Param->Backend = CHANVESE_BACKEND_PRIMALDUAL;
+            else if(!strcmp(Value, "graphcut"))
+                Param->Backend = CHANVESE_BACKEND_GRAPHCUT;
+            else
+            {
+                fprintf(stderr, "Unknown backend \"%s\".\n", Value);
+                return 0;
+            }
+            
+            ChanVeseSetBackend(Param->Opt, Param->Backend);
+        }
+        else if(!strcmp(Option, "connectivity"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue != 4 && NumValue != 8)
+            {
+                fprintf(stderr, "Connectivity must be 4 or 8.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetConnectivity(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "dataterm"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            else if(!strcmp(Value, "direct"))
+                ChanVeseSetDataTerm(Param->Opt, CHANVESE_DATA_DIRECT);
+            else if(!strcmp(Value, "moments"))
+                ChanVeseSetDataTerm(Param->Opt, CHANVESE_DATA_MOMENTS);
+            else
+            {
+                fprintf(stderr, "Unknown data term \"%s\".\n", Value);
+                return 0;
+            }
+        }
+        else if(!strcmp(Option, "sweep"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            else if(!strcmp(Value, "serial"))
+                ChanVeseSetSweep(Param->Opt, CHANVESE_SWEEP_SERIAL);
+            else if(!strcmp(Value, "redblack"))
+                ChanVeseSetSweep(Param->Opt, CHANVESE_SWEEP_REDBLACK);
+            else if(!strcmp(Value, "tiled"))
+                ChanVeseSetSweep(Param->Opt, CHANVESE_SWEEP_TILED);
+            else
+            {
+                fprintf(stderr, "Unknown sweep \"%s\".\n", Value);
+                return 0;
+            }
+        }
+        else if(!strcmp(Option, "threads"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Number of threads must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetNumThreads(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "tilesize"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 1)
+            {
+                fprintf(stderr, "Tile size must be positive.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetTileSize(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "tiledepth"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 1)
+            {
+                fprintf(stderr, "Tile depth must be positive.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetTileDepth(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "reinit"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Reinit interval must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetReinit(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "band"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0 || NumValue > 254)
+            {
+                fprintf(stderr, "Band must be between 0 and 254.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetBand(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "levels"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 1)
+            {
+                fprintf(stderr, "Number of levels must be positive.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetLevels(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "stoplevel"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Stop level must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetStopLevel(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "refineiter"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Refinement iterations must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetRefineIter(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "deadline"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Deadline must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetDeadline(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "keepbest"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue != 0 && NumValue != 1)
+            {
+                fprintf(stderr, "keepbest must be 0 or 1.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetKeepBest(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "maxside"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Maximum side must be nonnegative.\n");
+                return 0;
+            }
+            else
+                ChanVeseSetMaxSide(Param->Opt, (int)NumValue);
+        }
+        else if(!strcmp(Option, "decodescale"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            
+            if(!strcmp(Value, "1") || !strcmp(Value, "1/1"))
+                Param->DecodeScale = 0;
+            else if(!strcmp(Value, "1/2"))
+                Param->DecodeScale = IMAGEIO_SCALE_1_2;
+            else if(!strcmp(Value, "1/4"))
+                Param->DecodeScale = IMAGEIO_SCALE_1_4;
+            else if(!strcmp(Value, "1/8"))
+                Param->DecodeScale = IMAGEIO_SCALE_1_8;
+            else if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 1 || NumValue > MAX_IMAGE_SIZE)
+            {
+                fprintf(stderr, "Decode scale must be 1/2, 1/4, 1/8, "
+                    "or a side length from 1 to %d.\n", MAX_IMAGE_SIZE);
+                return 0;
+            }
+            else
+                Param->DecodeScale = IMAGEIO_SCALE_SIDE((int)NumValue);
+        }
+        else if(!strcmp(Option, "progress"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue < 0)
+            {
+                fprintf(stderr, "Progress interval must be nonnegative.\n");
+                return 0;
+            }
+            else
+                Param->ProgressMs = (int)NumValue;
+        }
+        else if(!strcmp(Option, "trace"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            
+            Param->TraceFile = Value;
+        }
+        else if(!strcmp(Option, "tracelen"))
+        {
+            if(!CliGetNum(&NumValue, Value, Option))
+                return 0;
+            else if(NumValue <= 0)
+            {
+                fprintf(stderr, "Trace length must be positive.\n");
+                return 0;
+            }
+            else
+                Param->TraceLength = (int)NumValue;
+        }
+        else if(!strcmp(Option, "roi"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            
+            Param->RoiFile = Value;
+        }
+        else if(!strcmp(Option, "roicrop"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            
+            Param->RoiCropFile = Value;
+        }
+        else if(!strcmp(Option, "roisource"))
+        {
+            if(!Value)
+            {
+                fprintf(stderr, "Expected a value for option %s.\n", Option);
+                return 0;
+            }
+            
+            Param->RoiSourceFile = Value;
+        }
         else if(!strcmp(Option, "phi0"))
         {
             if(!Value)
@@ -512,7 +1125,14 @@ static int ParseParam(programparams *Param, int argc, const char *argv[])
             if(Param->Phi.Data)
                 FreeImageObj(Param->Phi);
             
-            if(!(ReadMatrixFromFile(&Param->Phi, Value, PhiRescale)))
+            Param->Phi = NullImage;
+            
+            Param->PhiInit = PHI0_DEFAULT;
+            
+            if(!(Status = ParsePhiInit(Param, Value)))
+                return 0;
+            else if(Status < 0
+                && !(ReadMatrixFromFile(&Param->Phi, Value, PhiRescale)))
                 return 0;
         }
         else if(!strcmp(Option, "jpegquality"))
@@ -564,7 +1184,52 @@ static int ParseParam(programparams *Param, int argc, const char *argv[])
         PrintHelpMessage();
         return 0;
     }
+    
+    /* The sparse-field front only moves locally and does not get anywhere
+       from the default pattern of small squares */
+    if(Param->Backend == CHANVESE_BACKEND_SPARSEFIELD
+        && Param->PhiInit == PHI0_DEFAULT && !Param->Phi.Data)
+        Param->PhiInit = PHI0_OTSU;
+
+    return 1;
+}
+
 
+/* Parse phi0:box:<fraction>, phi0:ellipse:<fraction>, or phi0:otsu.
+   Returns 1 on success, 0 on an invalid fraction, or -1 if Value is not one
+   of these, so that it is read as a file. */
+static int ParsePhiInit(programparams *Param, const char *Value)
+{
+    const char *Fraction = NULL;
+    char *End;
+    
+    if(!strncmp(Value, "box", 3) && (Value[3] == ':' || !Value[3]))
+    {
+        Param->PhiInit = PHI0_BOX;
+        Fraction = Value + 3;
+    }
+    else if(!strncmp(Value, "ellipse", 7) && (Value[7] == ':' || !Value[7]))
+    {
+        Param->PhiInit = PHI0_ELLIPSE;
+        Fraction = Value + 7;
+    }
+    else if(!strcmp(Value, "otsu"))
+        Param->PhiInit = PHI0_OTSU;
+    else
+        return -1;
+    
+    if(Fraction && *Fraction)
+    {
+        Param->PhiFraction = strtod(Fraction + 1, &End);
+        
+        if(*End || End == Fraction + 1
+            || Param->PhiFraction <= 0 || Param->PhiFraction > 1)
+        {
+            fprintf(stderr, "phi0 fraction must be in (0,1].\n");
+            return 0;
+        }
+    }
+    
     return 1;
 }
 
@@ -0,0 +1,83 @@
+/**
+ * @file chanveseopt.h
+ * @brief ChanVese options struct, shared by the solver backends
+ *
+ * This header is internal to the Chan-Vese library.  Programs using the
+ * library should include chanvese.h and treat chanveseopt as opaque.
+ */
+#ifndef _CHANVESEOPT_H_
+#define _CHANVESEOPT_H_
+
+#include "chanvese.h"
+#include "workspace.h"
+
+/** @brief Options handling for ChanVese */
+struct chanvesestruct
+{
+    num Tol;
+    num FlipTol;
+    int FlipWindow;
+    int MaxIter;
+    num Mu;
+    num Nu;
+    num Lambda1;
+    num Lambda2;
+    num dt;
+    int Reinit;
+    int Backend;
+    int Connectivity;
+    int DataTerm;
+    int Sweep;
+    int NumThreads;
+    int TileSize;
+    int TileDepth;
+    int Band;
+    int NumLevels;
+    int StopLevel;
+    int RefineIter;
+    int Deadline;
+    int KeepBest;
+    int MaxSide;
+    chanveseworkspace *Workspace;
+    chanvesetrace *Trace;
+    int (*PlotFun)(int, int, num, const num*, const num*, const num*,
+        int, int, int, void*);
+    void *PlotParam;
+};
+
+/** @brief Sign change convergence test (see ChanVeseSetFlipWindow) */
+typedef struct
+{
+    /** @brief Number of sign changes in each of the last Window iterations */
+    long *History;
+    /** @brief Number of sign changes in the last Window iterations */
+    double Sum;
+    /** @brief The test passes when Sum is at most MaxFlips */
+    double MaxFlips;
+    int Window;
+} fliptest;
+
+int FlipTestInit(fliptest *Test, const chanveseopt *Opt, long NumPixels,
+    workspace *Ws);
+int FlipTestUpdate(fliptest *Test, int Iter, double Flips);
+
+int DeadlineReached(const chanveseopt *Opt, unsigned long StartTime);
+
+int TraceBegin(chanvesetrace *Trace, int NumChannels);
+void TraceSetLevel(chanvesetrace *Trace, int Level);
+void TraceRecord(chanvesetrace *Trace, int Iter, double Delta,
+    const num *c1, const num *c2, double Flips);
+void TraceClearProgress(chanvesetrace *Trace);
+void TraceEnd(chanvesetrace *Trace, int Status);
+
+int SparseFieldChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws);
+int PrimalDualChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws);
+int GraphCutChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws);
+
+#endif /* _CHANVESEOPT_H_ */
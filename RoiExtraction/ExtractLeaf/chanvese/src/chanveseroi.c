@@ -0,0 +1,173 @@
+/**
+ * @file chanveseroi.c
+ * @brief Largest connected region of a segmentation and its bounding box
+ *
+ * The pixels with Phi >= 0 are labeled into connected components with a
+ * union-find forest over the pixel indices.  In the raster scan, each
+ * inside pixel is merged with its inside neighbors that were already
+ * visited, always making the smaller root the parent.  Each root is then
+ * the first pixel of its component in raster order and every parent
+ * precedes its children, so a second scan in raster order can replace the
+ * parents with consecutive labels in place.
+ */
+
+#include <limits.h>
+
+#include "basic.h"
+#include "chanvese.h"
+
+/** @brief Parent of pixels outside of the segmentation */
+#define ROI_OUTSIDE     (-1)
+
+
+/** @brief Find the root of a pixel, with path compression */
+static int FindRoot(int *Parent, int n)
+{
+    int Root = n, Next;
+    
+    while(Parent[Root] != Root)
+        Root = Parent[Root];
+    
+    while(Parent[n] != Root)
+    {
+        Next = Parent[n];
+        Parent[n] = Root;
+        n = Next;
+    }
+    
+    return Root;
+}
+
+
+/** @brief Merge the components of pixels a and b */
+static void Union(int *Parent, int a, int b)
+{
+    a = FindRoot(Parent, a);
+    b = FindRoot(Parent, b);
+    
+    if(a < b)
+        Parent[b] = a;
+    else
+        Parent[a] = b;
+}
+
+
+/**
+ * @brief Find the largest connected region of a segmentation
+ * @param Roi where to store the bounding box of the region
+ * @param Phi the level set, the region is where Phi >= 0
+ * @param Width, Height the size of Phi
+ * @param Connectivity 4 or 8, the pixel neighborhood
+ * @return 1 on success, 0 on failure
+ *
+ * The region is the connected component of Phi >= 0 with the most pixels.
+ * Its bounding box, number of pixels, and the number of components are
+ * stored in Roi.  If Phi < 0 everywhere, Roi->Area and the size of the box
+ * are zero.
+ */
+int ChanVeseLargestRegion(chanveseroi *Roi, const num *Phi,
+    int Width, int Height, int Connectivity)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    int *Parent = NULL;
+    long *Area = NULL;
+    int i, j, n, x0, x1, y0 = 0, y1, Label;
+    int NumLabels = 0, Largest = 0, Success = 0;
+    
+    if(!Roi || !Phi || Width <= 0 || Height <= 0 || NumPixels > INT_MAX
+        || (Connectivity != 4 && Connectivity != 8))
+        return 0;
+    
+    Roi->x = Roi->y = Roi->Width = Roi->Height = 0;
+    Roi->Area = Roi->NumComponents = 0;
+    
+    if(!(Parent = (int *)Malloc(sizeof(int)*NumPixels)))
+        goto Catch;
+    
+    /* Merge each inside pixel with its previously visited neighbors */
+    for(j = 0, n = 0; j < Height; j++)
+        for(i = 0; i < Width; i++, n++)
+        {
+            if(Phi[n] < 0)
+            {
+                Parent[n] = ROI_OUTSIDE;
+                continue;
+            }
+            
+            Parent[n] = n;
+            
+            if(i > 0 && Parent[n - 1] != ROI_OUTSIDE)
+                Union(Parent, n, n - 1);
+            
+            if(j > 0)
+            {
+                if(Parent[n - Width] != ROI_OUTSIDE)
+                    Union(Parent, n, n - Width);
+                
+                if(Connectivity == 8)
+                {
+                    if(i > 0 && Parent[n - Width - 1] != ROI_OUTSIDE)
+                        Union(Parent, n, n - Width - 1);
+                    if(i < Width - 1 && Parent[n - Width + 1] != ROI_OUTSIDE)
+                        Union(Parent, n, n - Width + 1);
+                }
+            }
+        }
+    
+    /* Replace parents with labels, parents always come first */
+    for(n = 0; n < NumPixels; n++)
+        if(Parent[n] == n)
+            Parent[n] = NumLabels++;
+        else if(Parent[n] != ROI_OUTSIDE)
+            Parent[n] = Parent[Parent[n]];
+    
+    if(NumLabels > 0)
+    {
+        if(!(Area = (long *)Malloc(sizeof(long)*NumLabels)))
+            goto Catch;
+        
+        for(Label = 0; Label < NumLabels; Label++)
+            Area[Label] = 0;
+        
+        for(n = 0; n < NumPixels; n++)
+            if(Parent[n] != ROI_OUTSIDE)
+                Area[Parent[n]]++;
+        
+        for(Label = 1; Label < NumLabels; Label++)
+            if(Area[Label] > Area[Largest])
+                Largest = Label;
+        
+        /* Bounding box of the largest component */
+        x0 = Width;
+        x1 = y1 = -1;
+        
+        for(j = 0, n = 0; j < Height; j++)
+            for(i = 0; i < Width; i++, n++)
+                if(Parent[n] == Largest)
+                {
+                    if(i < x0)
+                        x0 = i;
+                    if(i > x1)
+                        x1 = i;
+                    if(y1 < 0)
+                        y0 = j;
+                    
+                    y1 = j;
+                }
+        
+        Roi->x = x0;
+        Roi->y = y0;
+        Roi->Width = x1 - x0 + 1;
+        Roi->Height = y1 - y0 + 1;
+        Roi->Area = Area[Largest];
+        Roi->NumComponents = NumLabels;
+    }
+    
+    Success = 1;
+Catch:
+    if(Area)
+        Free(Area);
+    if(Parent)
+        Free(Parent);
+    return Success;
+}
@@ -0,0 +1,166 @@
+/**
+ * @file chanvesesimd.h
+ * @brief Vectorized row update for red-black Chan-Vese sweeps
+ *
+ * This file is not a normal header.  It is included by chanvese.c once for
+ * each supported instruction set to define a row update kernel, with the
+ * following macros defined before each inclusion:
+ *
+ * @li KERNEL_NAME      name of the function to define
+ * @li KERNEL_TARGET    function attribute selecting the instruction set
+ * @li VNUM, VWIDTH     vector type holding VWIDTH num elements
+ * @li VLOAD, VSTORE    unaligned load and store
+ * @li VSET1            broadcast a scalar to all elements
+ * @li VADD, VSUB, VMUL, VDIV, VSQRT  elementwise arithmetic
+ * @li VBLEND(a,b,m)    select b where mask m is set, a elsewhere
+ * @li VAND, VXOR       bitwise and, exclusive or
+ * @li VCMPGE           elementwise >= comparison mask
+ * @li VEVENMASK, VODDMASK  masks selecting the even or odd elements
+ *
+ * If Sweep->Data is set, the data term is read from it instead of being
+ * computed from f, and f is only used for the region sums.
+ */
+
+/**
+ * @brief Vectorized red-black update of the interior of a row
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param j the row to update, 0 < j < Height - 1
+ * @param i0, i1 range of pixels to update, 0 < i0 <= i1 < Width
+ * @param Color update pixels (i,j) with (i + j) % 2 == Color
+ * @param Acc accumulators for the row (see chanvesespan.h)
+ * @param iEnd set to the first pixel that was not processed
+ *
+ * The kernel processes VWIDTH pixels at a time.  The update is computed for
+ * all pixels of a vector, but only the pixels of the requested color are
+ * stored.  Since their neighbors have the other color and are not modified
+ * during this half-sweep, the result is the same as updating them one at a
+ * time.  The caller should process the remaining pixels [*iEnd, i1) with the
+ * scalar code.  NumChannels must be at most SIMD_MAX_CHANNELS.
+ */
+static KERNEL_TARGET void KERNEL_NAME(const sweepdata *Sweep,
+    int j, int i0, int i1, int Color, double *Acc, int *iEnd)
+{
+    const long Width = Sweep->Width;
+    const long NumPixels = Sweep->NumPixels;
+    const int NumChannels = Sweep->NumChannels;
+    const VNUM Eps = VSET1(DIVIDE_EPS), One = VSET1(1), Half = VSET1(0.5);
+    const VNUM Zero = VSET1(0), MinusOne = VSET1(-1);
+    const VNUM Mu = VSET1(Sweep->Mu), Nu = VSET1(Sweep->Nu);
+    const VNUM Lambda1 = VSET1(Sweep->Lambda1);
+    const VNUM Lambda2 = VSET1(Sweep->Lambda2);
+    const VNUM DeltaScale = VSET1((num)(Sweep->dt/M_PI));
+    const VNUM Mask = (((i0 + j + Color) & 1) == 0) ? VEVENMASK : VODDMASK;
+    num *PhiPtr = Sweep->Phi + Width*j + i0;
+    const num *fPtr = Sweep->f + Width*j + i0;
+    const num *DataPtr = (Sweep->Data) ? Sweep->Data + Width*j + i0 : NULL;
+    const num *fPtr2;
+    num Temp[VWIDTH];
+    VNUM Phi, PhiL, PhiR, PhiU, PhiD, PhiX, PhiY, Delta;
+    VNUM IDivL, IDivR, IDivU, IDivD, Dist1, Dist2, Diff, DiffSum, Force;
+    VNUM c1, c2, Temp1, Inside, Flipped, Sign;
+    VNUM Count1, Flips, Sum1[SIMD_MAX_CHANNELS];
+    int i, k, Channel;
+    
+    DiffSum = Count1 = Flips = Zero;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+        Sum1[Channel] = Zero;
+    
+    for(i = i0; i + VWIDTH <= i1;
+        i += VWIDTH, PhiPtr += VWIDTH, fPtr += VWIDTH)
+    {
+        Phi = VLOAD(PhiPtr);
+        PhiL = VLOAD(PhiPtr - 1);
+        PhiR = VLOAD(PhiPtr + 1);
+        PhiU = VLOAD(PhiPtr - Width);
+        PhiD = VLOAD(PhiPtr + Width);
+        
+        Delta = VDIV(DeltaScale, VADD(One, VMUL(Phi, Phi)));
+        PhiX = VSUB(PhiR, Phi);
+        PhiY = VMUL(VSUB(PhiD, PhiU), Half);
+        IDivR = VDIV(One, VSQRT(VADD(Eps,
+            VADD(VMUL(PhiX, PhiX), VMUL(PhiY, PhiY)))));
+        PhiX = VSUB(Phi, PhiL);
+        IDivL = VDIV(One, VSQRT(VADD(Eps,
+            VADD(VMUL(PhiX, PhiX), VMUL(PhiY, PhiY)))));
+        PhiX = VMUL(VSUB(PhiR, PhiL), Half);
+        PhiY = VSUB(PhiD, Phi);
+        IDivD = VDIV(One, VSQRT(VADD(Eps,
+            VADD(VMUL(PhiX, PhiX), VMUL(PhiY, PhiY)))));
+        PhiY = VSUB(Phi, PhiU);
+        IDivU = VDIV(One, VSQRT(VADD(Eps,
+            VADD(VMUL(PhiX, PhiX), VMUL(PhiY, PhiY)))));
+        
+        Force = VMUL(Mu,
+            VADD(VADD(VMUL(PhiR, IDivR), VMUL(PhiL, IDivL)),
+                VADD(VMUL(PhiD, IDivD), VMUL(PhiU, IDivU))));
+        
+        if(DataPtr)
+            Force = VADD(VSUB(Force, Nu), VLOAD(DataPtr + (i - i0)));
+        else
+        {
+            Dist1 = Dist2 = VSET1(0);
+            
+            for(Channel = 0, fPtr2 = fPtr; Channel < NumChannels;
+                Channel++, fPtr2 += NumPixels)
+            {
+                c1 = VSET1(Sweep->c1[Channel]);
+                c2 = VSET1(Sweep->c2[Channel]);
+                Temp1 = VLOAD(fPtr2);
+                PhiX = VSUB(Temp1, c1);
+                PhiY = VSUB(Temp1, c2);
+                Dist1 = VADD(Dist1, VMUL(PhiX, PhiX));
+                Dist2 = VADD(Dist2, VMUL(PhiY, PhiY));
+            }
+            
+            Force = VADD(VSUB(Force, VADD(Nu, VMUL(Lambda1, Dist1))),
+                VMUL(Lambda2, Dist2));
+        }
+        
+        /* Semi-implicit update, stored only for pixels of the given color */
+        Temp1 = VDIV(VADD(Phi, VMUL(Delta, Force)),
+            VADD(One, VMUL(VMUL(Delta, Mu),
+                VADD(VADD(IDivR, IDivL), VADD(IDivD, IDivU)))));
+        Temp1 = VBLEND(Phi, Temp1, Mask);
+        VSTORE(PhiPtr, Temp1);
+        Diff = VSUB(Temp1, Phi);
+        DiffSum = VADD(DiffSum, VMUL(Diff, Diff));
+        
+        /* Count the sign changes and update the region sums with the
+           pixels that entered (+1) or left (-1) the inside */
+        Inside = VCMPGE(Temp1, Zero);
+        Flipped = VAND(VXOR(Inside, VCMPGE(Phi, Zero)), Mask);
+        Flips = VADD(Flips, VAND(Flipped, One));
+        Sign = VAND(Flipped, VBLEND(MinusOne, One, Inside));
+        Count1 = VADD(Count1, Sign);
+        
+        for(Channel = 0, fPtr2 = fPtr; Channel < NumChannels;
+            Channel++, fPtr2 += NumPixels)
+            Sum1[Channel] = VADD(Sum1[Channel], VMUL(Sign, VLOAD(fPtr2)));
+    }
+    
+    VSTORE(Temp, DiffSum);
+    
+    for(k = 0; k < VWIDTH; k++)
+        Acc[ACC_PHIDIFF] += Temp[k];
+    
+    VSTORE(Temp, Flips);
+    
+    for(k = 0; k < VWIDTH; k++)
+        Acc[ACC_FLIPS] += Temp[k];
+    
+    VSTORE(Temp, Count1);
+    
+    for(k = 0; k < VWIDTH; k++)
+        Acc[ACC_COUNT1] += Temp[k];
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+    {
+        VSTORE(Temp, Sum1[Channel]);
+        
+        for(k = 0; k < VWIDTH; k++)
+            Acc[ACC_SUM1 + Channel] += Temp[k];
+    }
+    
+    *iEnd = i;
+}
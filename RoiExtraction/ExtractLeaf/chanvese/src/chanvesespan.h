@@ -0,0 +1,152 @@
+/**
+ * @file chanvesespan.h
+ * @brief Scalar span update for Chan-Vese sweeps
+ *
+ * This file is not a normal header.  It is included by chanvese.c once for
+ * each specialized number of channels to define a span update kernel, with
+ * the following macros defined before each inclusion:
+ *
+ * @li SPAN_NAME        name of the function to define
+ * @li SPAN_CHANNELS    number of channels, or undefined for a kernel that
+ *                      reads the number of channels from the sweep
+ *
+ * With SPAN_CHANNELS defined, the loops over the channels have a constant
+ * trip count, so the compiler unrolls them and keeps c1 and c2 in
+ * registers, and the kernel has no per-pixel test of the number of
+ * channels.  The arithmetic is the same in all of the kernels, so they give
+ * identical results.
+ */
+
+/**
+ * @brief Semi-implicit update of a span of pixels in one row of Phi
+ * @param Sweep the level set, image, and parameters of the current sweep
+ * @param j the row to update
+ * @param i0, i1 range of pixels [i0, i1) to update
+ * @param Color which pixels to update
+ * @param Acc accumulators (see ACC_PHIDIFF, ACC_FLIPS, ACC_COUNT1, ACC_SUM1)
+ *
+ * With Color = -1, every pixel of the span is updated from left to right in
+ * place, so that the update of a pixel uses the already updated value of its
+ * left neighbor (Gauss-Seidel ordering).  With Color = 0 or 1, only the
+ * pixels (i,j) with (i + j) % 2 == Color are updated (red-black ordering).
+ * Since the neighbors of these pixels all have the other color, rows may
+ * then be updated in any order or concurrently.
+ *
+ * The squared changes in Phi, the number of sign changes, and the changes
+ * in the count and sums of f of the inside region are added to Acc, so that
+ * the convergence tests and the region averages for the next iteration are
+ * obtained without another pass over Phi and f.
+ */
+static void SPAN_NAME(const sweepdata *Sweep, int j, int i0, int i1,
+    int Color, double *Acc)
+{
+    const int Width = Sweep->Width;
+    const long NumPixels = Sweep->NumPixels;
+#ifdef SPAN_CHANNELS
+    const int NumChannels = SPAN_CHANNELS;
+    num c1[SPAN_CHANNELS], c2[SPAN_CHANNELS];
+#else
+    const int NumChannels = Sweep->NumChannels;
+    const num *c1 = Sweep->c1, *c2 = Sweep->c2;
+#endif
+    const num Mu = Sweep->Mu, Nu = Sweep->Nu, dt = Sweep->dt;
+    const num Lambda1 = Sweep->Lambda1, Lambda2 = Sweep->Lambda2;
+    const num *fPtr, *fPtr2, *DataPtr = NULL;
+    num *PhiPtr;
+    double PhiDiff, PhiDiffNorm = 0;
+    num PhiLast, Delta, PhiX, PhiY, IDivU, IDivD, IDivL, IDivR;
+    num Temp1, Temp2, Dist1, Dist2, Force;
+    long Count1 = 0, Flips = 0;
+    int i, iStep, Channel, Sign;
+    int iu, id, il, ir;
+    
+#ifdef SPAN_CHANNELS
+    /* Local copies, which the stores to Phi cannot alias */
+    for(Channel = 0; Channel < SPAN_CHANNELS; Channel++)
+    {
+        c1[Channel] = Sweep->c1[Channel];
+        c2[Channel] = Sweep->c2[Channel];
+    }
+#endif
+    
+    if(Color < 0)
+    {
+        i = i0;
+        iStep = 1;
+    }
+    else
+    {
+        i = i0 + ((i0 + j + Color) & 1);
+        iStep = 2;
+    }
+    
+    PhiPtr = Sweep->Phi + ((long)Width)*j + i;
+    fPtr = Sweep->f + ((long)Width)*j + i;
+    iu = (j == 0) ? 0 : -Width;
+    id = (j == Sweep->Height - 1) ? 0 : Width;
+    
+    if(Sweep->Data)
+        DataPtr = Sweep->Data + ((long)Width)*j + i - iStep;
+    
+    for(; i < i1; i += iStep, PhiPtr += iStep, fPtr += iStep)
+    {
+        il = (i == 0) ? 0 : -1;
+        ir = (i == Width - 1) ? 0 : 1;
+        
+        Delta = dt/(M_PI*(1 + PhiPtr[0]*PhiPtr[0]));
+        PhiX = PhiPtr[ir] - PhiPtr[0];
+        PhiY = (PhiPtr[id] - PhiPtr[iu])/2;
+        IDivR = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
+        PhiX = PhiPtr[0] - PhiPtr[il];
+        IDivL = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
+        PhiX = (PhiPtr[ir] - PhiPtr[il])/2;
+        PhiY =  PhiPtr[id] - PhiPtr[0];
+        IDivD = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
+        PhiY = PhiPtr[0] - PhiPtr[iu];
+        IDivU = (num)(1/sqrt(DIVIDE_EPS + PhiX*PhiX + PhiY*PhiY));
+        
+        Dist1 = Dist2 = 0;
+        
+        if(DataPtr)
+            DataPtr += iStep;
+        else
+            for(Channel = 0, fPtr2 = fPtr; Channel < NumChannels;
+                Channel++, fPtr2 += NumPixels)
+            {
+                Temp1 = fPtr2[0] - c1[Channel];
+                Temp2 = fPtr2[0] - c2[Channel];
+                Dist1 += Temp1*Temp1;
+                Dist2 += Temp2*Temp2;
+            }
+        
+        /* Semi-implicit update of phi at the current point */
+        PhiLast = PhiPtr[0];
+        Force = Mu*(PhiPtr[ir]*IDivR + PhiPtr[il]*IDivL
+            + PhiPtr[id]*IDivD + PhiPtr[iu]*IDivU) - Nu;
+        
+        if(DataPtr)
+            Force += DataPtr[0];
+        else
+            Force = Force - Lambda1*Dist1 + Lambda2*Dist2;
+        
+        PhiPtr[0] = (PhiPtr[0] + Delta*Force) /
+            (1 + Delta*Mu*(IDivR + IDivL + IDivD + IDivU));
+        PhiDiff = (PhiPtr[0] - PhiLast);
+        PhiDiffNorm += PhiDiff * PhiDiff;
+        
+        if((PhiPtr[0] >= 0) != (PhiLast >= 0))
+        {
+            Sign = (PhiPtr[0] >= 0) ? 1 : -1;
+            Flips++;
+            Count1 += Sign;
+            
+            for(Channel = 0, fPtr2 = fPtr; Channel < NumChannels;
+                Channel++, fPtr2 += NumPixels)
+                Acc[ACC_SUM1 + Channel] += Sign*fPtr2[0];
+        }
+    }
+    
+    Acc[ACC_PHIDIFF] += PhiDiffNorm;
+    Acc[ACC_FLIPS] += Flips;
+    Acc[ACC_COUNT1] += Count1;
+}
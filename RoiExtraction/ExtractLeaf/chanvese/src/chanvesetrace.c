@@ -0,0 +1,338 @@
+/**
+ * @file chanvesetrace.c
+ * @brief Convergence trace and rate-limited progress for ChanVese
+ *
+ * A trace records Delta, the region averages c1 and c2, and the number of
+ * sign changes of every iteration in a ring buffer that keeps the last
+ * Capacity iterations.  The buffer is allocated when a segmentation starts,
+ * so that recording an iteration only copies a few numbers.  Optionally,
+ * the progress is printed to stderr at most once every ProgressMs
+ * milliseconds.  After the segmentation, ChanVeseWriteTrace dumps the
+ * recorded iterations as CSV or JSON.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "basic.h"
+#include "chanveseopt.h"
+
+/** @brief Number of doubles in an entry before c1 and c2 */
+#define TRACE_HEADER    5
+
+/** @brief Offsets of the fields of a trace entry */
+#define TRACE_LEVEL     0
+#define TRACE_ITER      1
+#define TRACE_MS        2
+#define TRACE_DELTA     3
+#define TRACE_FLIPS     4
+
+struct chanvesetracestruct
+{
+    /** @brief Ring buffer of Capacity entries of Stride doubles */
+    double *Entry;
+    /** @brief Number of doubles allocated for Entry */
+    long EntrySize;
+    /** @brief Maximum number of entries kept */
+    int Capacity;
+    /** @brief Number of doubles per entry, TRACE_HEADER + 2*NumChannels */
+    int Stride;
+    int NumChannels;
+    /** @brief Number of iterations recorded since TraceBegin */
+    long Count;
+    /** @brief Current pyramid level */
+    int Level;
+    /** @brief Return value of ChanVese */
+    int Status;
+    /** @brief Minimum interval between progress lines, 0 for none */
+    int ProgressMs;
+    /** @brief Length of the progress line on stderr, 0 if none is shown */
+    int ProgressWidth;
+    unsigned long StartTime;
+    unsigned long LastProgress;
+};
+
+
+/**
+ * @brief Create a new trace
+ * @param Capacity number of iterations to keep, the last ones are kept
+ * @param ProgressMs print the progress to stderr at most once every
+ *    ProgressMs milliseconds, or 0 for no progress
+ * @return the trace, or NULL on failure
+ *
+ * The trace is used with ChanVeseSetTrace.  It is the caller's
+ * responsibility to call ChanVeseFreeTrace when done.
+ */
+chanvesetrace *ChanVeseNewTrace(int Capacity, int ProgressMs)
+{
+    chanvesetrace *Trace;
+    
+    if(Capacity < 0 || ProgressMs < 0
+        || !(Trace = (chanvesetrace *)Malloc(
+            sizeof(struct chanvesetracestruct))))
+        return NULL;
+    
+    Trace->Entry = NULL;
+    Trace->EntrySize = 0;
+    Trace->Capacity = Capacity;
+    Trace->Stride = TRACE_HEADER;
+    Trace->NumChannels = 0;
+    Trace->Count = 0;
+    Trace->Level = 0;
+    Trace->Status = 0;
+    Trace->ProgressMs = ProgressMs;
+    Trace->ProgressWidth = 0;
+    Trace->StartTime = Trace->LastProgress = 0;
+    return Trace;
+}
+
+
+/** @brief Free a trace */
+void ChanVeseFreeTrace(chanvesetrace *Trace)
+{
+    if(Trace)
+    {
+        if(Trace->Entry)
+            Free(Trace->Entry);
+        
+        Free(Trace);
+    }
+}
+
+
+/**
+ * @brief Start recording a segmentation
+ * @param Trace the trace, or NULL
+ * @param NumChannels number of channels of the image
+ * @return 1 on success, 0 on failure
+ *
+ * The previous records are discarded.  The ring buffer is only reallocated
+ * when it is too small for NumChannels.
+ */
+int TraceBegin(chanvesetrace *Trace, int NumChannels)
+{
+    long Size;
+    
+    if(!Trace)
+        return 1;
+    
+    Trace->Stride = TRACE_HEADER + 2*NumChannels;
+    Size = ((long)Trace->Capacity)*Trace->Stride;
+    
+    if(Size > Trace->EntrySize)
+    {
+        if(Trace->Entry)
+            Free(Trace->Entry);
+        
+        Trace->EntrySize = 0;
+        
+        if(!(Trace->Entry = (double *)Malloc(sizeof(double)*Size)))
+            return 0;
+        
+        Trace->EntrySize = Size;
+    }
+    
+    Trace->NumChannels = NumChannels;
+    Trace->Count = 0;
+    Trace->Level = 0;
+    Trace->Status = 0;
+    Trace->StartTime = Trace->LastProgress = Clock();
+    return 1;
+}
+
+
+/** @brief Set the pyramid level of the following records */
+void TraceSetLevel(chanvesetrace *Trace, int Level)
+{
+    if(Trace)
+        Trace->Level = Level;
+}
+
+
+/**
+ * @brief Record an iteration
+ * @param Trace the trace, or NULL
+ * @param Iter the iteration
+ * @param Delta the change in this iteration, as passed to the plot function
+ * @param c1, c2 the region averages after the iteration
+ * @param Flips number of pixels that changed sign in this iteration
+ */
+void TraceRecord(chanvesetrace *Trace, int Iter, double Delta,
+    const num *c1, const num *c2, double Flips)
+{
+    const unsigned long Now = (Trace) ? Clock() : 0;
+    double *Entry;
+    int Channel;
+    
+    if(!Trace)
+        return;
+    
+    if(Trace->Capacity > 0)
+    {
+        Entry = Trace->Entry
+            + (Trace->Count % Trace->Capacity)*Trace->Stride;
+        Entry[TRACE_LEVEL] = Trace->Level;
+        Entry[TRACE_ITER] = Iter;
+        Entry[TRACE_MS] = (double)(Now - Trace->StartTime);
+        Entry[TRACE_DELTA] = Delta;
+        Entry[TRACE_FLIPS] = Flips;
+        
+        for(Channel = 0; Channel < Trace->NumChannels; Channel++)
+        {
+            Entry[TRACE_HEADER + Channel] = c1[Channel];
+            Entry[TRACE_HEADER + Trace->NumChannels + Channel] = c2[Channel];
+        }
+    }
+    
+    Trace->Count++;
+    
+    if(Trace->ProgressMs > 0
+        && Now - Trace->LastProgress >= (unsigned long)Trace->ProgressMs)
+    {
+        Trace->LastProgress = Now;
+        
+        if(Trace->NumChannels == 1)
+            Trace->ProgressWidth = fprintf(stderr,
+                "   Iteration %4d     Delta %7.4f     "
+                "c1 = %6.4f     c2 = %6.4f\r", Iter, Delta, *c1, *c2);
+        else
+            Trace->ProgressWidth = fprintf(stderr,
+                "   Iteration %4d     Delta %7.4f\r", Iter, Delta);
+    }
+}
+
+
+/**
+ * @brief Erase the progress line from stderr
+ *
+ * The backends call this before reporting the final state to the plotting
+ * function, so that its message does not need to overwrite the progress.
+ */
+void TraceClearProgress(chanvesetrace *Trace)
+{
+    if(Trace && Trace->ProgressWidth > 0)
+    {
+        fprintf(stderr, "%*s\r", Trace->ProgressWidth, "");
+        Trace->ProgressWidth = 0;
+    }
+}
+
+
+/** @brief Record the return value of ChanVese */
+void TraceEnd(chanvesetrace *Trace, int Status)
+{
+    if(Trace)
+        Trace->Status = Status;
+}
+
+
+/** @brief Write the recorded iterations as CSV */
+static void WriteTraceCsv(FILE *File, const chanvesetrace *Trace,
+    long First, long Count)
+{
+    const double *Entry;
+    long k;
+    int Channel;
+    
+    fprintf(File, "level,iter,ms,delta,flips");
+    
+    for(Channel = 0; Channel < Trace->NumChannels; Channel++)
+        fprintf(File, ",c1_%d", Channel);
+    for(Channel = 0; Channel < Trace->NumChannels; Channel++)
+        fprintf(File, ",c2_%d", Channel);
+    
+    fprintf(File, "\n");
+    
+    for(k = First; k < First + Count; k++)
+    {
+        Entry = Trace->Entry + (k % Trace->Capacity)*Trace->Stride;
+        fprintf(File, "%d,%d,%.0f,%.6g,%.0f", (int)Entry[TRACE_LEVEL],
+            (int)Entry[TRACE_ITER], Entry[TRACE_MS], Entry[TRACE_DELTA],
+            Entry[TRACE_FLIPS]);
+        
+        for(Channel = 0; Channel < 2*Trace->NumChannels; Channel++)
+            fprintf(File, ",%.6g", Entry[TRACE_HEADER + Channel]);
+        
+        fprintf(File, "\n");
+    }
+}
+
+
+/** @brief Write the recorded iterations as JSON */
+static void WriteTraceJson(FILE *File, const chanvesetrace *Trace,
+    long First, long Count)
+{
+    const double *Entry;
+    long k;
+    int Channel;
+    
+    fprintf(File, "{\"status\": %d, \"iterations\": %ld, \"dropped\": %ld, "
+        "\"channels\": %d,\n \"trace\": [", Trace->Status, Trace->Count,
+        First, Trace->NumChannels);
+    
+    for(k = First; k < First + Count; k++)
+    {
+        Entry = Trace->Entry + (k % Trace->Capacity)*Trace->Stride;
+        fprintf(File, "%s\n  {\"level\": %d, \"iter\": %d, \"ms\": %.0f, "
+            "\"delta\": %.6g, \"flips\": %.0f, \"c1\": [",
+            (k == First) ? "" : ",", (int)Entry[TRACE_LEVEL],
+            (int)Entry[TRACE_ITER], Entry[TRACE_MS], Entry[TRACE_DELTA],
+            Entry[TRACE_FLIPS]);
+        
+        for(Channel = 0; Channel < Trace->NumChannels; Channel++)
+            fprintf(File, "%s%.6g", (Channel) ? ", " : "",
+                Entry[TRACE_HEADER + Channel]);
+        
+        fprintf(File, "], \"c2\": [");
+        
+        for(Channel = 0; Channel < Trace->NumChannels; Channel++)
+            fprintf(File, "%s%.6g", (Channel) ? ", " : "",
+                Entry[TRACE_HEADER + Trace->NumChannels + Channel]);
+        
+        fprintf(File, "]}");
+    }
+    
+    fprintf(File, "\n ]}\n");
+}
+
+
+/**
+ * @brief Write a trace to a file
+ * @param Trace the trace
+ * @param FileName the output file, JSON if it ends with ".json", otherwise
+ *    CSV with a header line
+ * @return 1 on success, 0 on failure
+ *
+ * One line or object is written per recorded iteration, oldest first, with
+ * the pyramid level, the iteration, the milliseconds since the start of the
+ * segmentation, Delta, the number of sign changes, and c1 and c2.  If more
+ * than Capacity iterations were run, only the last Capacity are written;
+ * the JSON output gives the total number of iterations and the number that
+ * were dropped.
+ */
+int ChanVeseWriteTrace(const chanvesetrace *Trace, const char *FileName)
+{
+    const size_t Length = (FileName) ? strlen(FileName) : 0;
+    FILE *File;
+    long First, Count;
+    int Success;
+    
+    if(!Trace || !FileName || !(File = fopen(FileName, "wt")))
+        return 0;
+    
+    Count = (Trace->Count < Trace->Capacity) ?
+        Trace->Count : Trace->Capacity;
+    First = Trace->Count - Count;
+    
+    if(Length >= 5 && !strcmp(FileName + Length - 5, ".json"))
+        WriteTraceJson(File, Trace, First, Count);
+    else
+        WriteTraceCsv(File, Trace, First, Count);
+    
+    Success = !ferror(File);
+    
+    if(fclose(File))
+        Success = 0;
+    
+    return Success;
+}
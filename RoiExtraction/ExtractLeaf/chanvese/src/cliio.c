@@ -42,14 +42,42 @@ void FreeImageObj(image f)
 
 int ReadImageObj(image *f, const char *FileName)
 {
-    if(!f || !(f->Data = (num *)ReadImage(&f->Width, &f->Height, FileName,
-         IMAGEIO_NUM | IMAGEIO_RGB | IMAGEIO_PLANAR)))
+    return ReadImageObjScaled(f, FileName, 0);
+}
+
+
+/**
+ * @brief Read an image, JPEG is decoded at reduced size
+ * @param Scale one of the IMAGEIO_SCALE options, or 0 for full size
+ */
+int ReadImageObjScaled(image *f, const char *FileName, unsigned Scale)
+{
+    return ReadImageObjBuffered(f, FileName, Scale, NULL, NULL);
+}
+
+
+/**
+ * @brief Read an image into buffers provided by the caller
+ * @param Scale one of the IMAGEIO_SCALE options, or 0 for full size
+ * @param GetBuffer, BufferParam buffer function, see ReadImageBuffered
+ *
+ * If GetBuffer is not NULL, f->Data belongs to the caller of GetBuffer and
+ * must not be freed with FreeImageObj.
+ */
+int ReadImageObjBuffered(image *f, const char *FileName, unsigned Scale,
+    imagebufferfun GetBuffer, void *BufferParam)
+{
+    int UseColor;
+    
+    if(!f || !(f->Data = (num *)ReadImageBuffered(&f->Width, &f->Height,
+        &UseColor, FileName, IMAGEIO_NUM | IMAGEIO_RGB | IMAGEIO_PLANAR
+        | Scale, GetBuffer, BufferParam)))
     {
         *f = NullImage;
         return 0;
     }
     
-    f->NumChannels = (IsGrayscale(f->Data, f->Width, f->Height)) ? 1:3;
+    f->NumChannels = (UseColor) ? 3:1;
     return 1;
 }
 
@@ -321,7 +349,7 @@ int CliGetNum(num *Value, const char *String, const char *Param)
 int ReadMatrixFromTextFile(image *f, const char *FileName)
 {
     FILE *File;
-    num *Dest = NULL;
+    num *Dest = NULL, *NewDest;
     double Value;
     long DestNumEl = 0, DestCapacity = 64;
     int c, Line = 1, Col = 0, NumRows = 0, NumCols = 0;
@@ -415,14 +443,18 @@ int ReadMatrixFromTextFile(image *f, const char *FileName)
             /* Put Value into Dest */
             if(DestNumEl == DestCapacity)
             {
-                /* Increase Dest capacity by 10% */
-                DestCapacity += DestCapacity/10 + 1;
+                /* Double Dest capacity, so that reading n values takes
+                   O(log n) reallocations and O(n) copying */
+                DestCapacity *= 2;
                 
-                if(!(Dest = (num *)realloc(Dest, sizeof(num)*DestCapacity)))
+                if(!(NewDest = (num *)realloc(Dest,
+                    sizeof(num)*DestCapacity)))
                 {
                     fprintf(stderr, "Memory allocation failed.\n");
                     goto Catch;
                 }
+                
+                Dest = NewDest;
             }
             
             Dest[DestNumEl++] = (num)Value;
@@ -32,6 +32,9 @@ typedef struct
 int AllocImageObj(image *f, int Width, int Height, int NumChannels);
 void FreeImageObj(image f);
 int ReadImageObj(image *f, const char *FileName);
+int ReadImageObjScaled(image *f, const char *FileName, unsigned Scale);
+int ReadImageObjBuffered(image *f, const char *FileName, unsigned Scale,
+    imagebufferfun GetBuffer, void *BufferParam);
 int ReadImageObjGrayscale(image *f, const char *FileName);
 int WriteImageObj(image f, const char *FileName, int JpegQuality);
 
@@ -0,0 +1,234 @@
+/**
+ * @file edt.c
+ * @brief Signed distance reinitialization of a level set
+ *
+ * EdtSignedDistance replaces a level set function with the signed Euclidean
+ * distance to its zero level set, keeping the sign of every pixel.  The
+ * distances are computed exactly in linear time with the separable distance
+ * transform of Felzenszwalb and Huttenlocher,
+ *
+ *    P. Felzenszwalb and D. Huttenlocher, "Distance Transforms of Sampled
+ *    Functions," Theory of Computing, vol. 8, pp. 415-428, 2012.
+ *
+ * A first pass along the columns finds the distance from each pixel to the
+ * nearest pixel of the opposite sign in the same column.  A second pass along
+ * the rows takes the lower envelope of the parabolas (x - q)^2 + d(q)^2 to
+ * obtain the squared Euclidean distance.
+ */
+
+#include <math.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "basic.h"
+#include "edt.h"
+
+/** @brief Distance of pixels with no seed in their column */
+#define EDT_INF     ((num)1e20)
+
+
+/** @brief Workspace for the distance transform */
+struct edtstruct
+{
+    /** @brief Distance to the nearest seed in the same column */
+    num *Dist;
+    /** @brief Squared distances and parabola intersections, for each thread */
+    double *Buffer;
+    /** @brief Parabola locations, for each thread */
+    int *Index;
+    int Width;
+    int Height;
+    int NumThreads;
+};
+
+
+/**
+ * @brief Allocate a workspace for the distance transform
+ * @param Width, Height the image dimensions
+ * @param NumThreads number of threads to use (ignored without OpenMP)
+ * @param Ws workspace the memory is allocated from
+ * @return the workspace, or NULL on failure
+ *
+ * The memory is returned to Ws by the caller's WorkspaceRelease.
+ */
+edt *EdtNew(int Width, int Height, int NumThreads, workspace *Ws)
+{
+    edt *Edt;
+    
+    if(Width <= 0 || Height <= 0
+        || !(Edt = (edt *)WorkspaceAlloc(Ws, sizeof(struct edtstruct))))
+        return NULL;
+
+#ifdef _OPENMP
+    Edt->NumThreads = (NumThreads > 0) ? NumThreads : 1;
+#else
+    (void)NumThreads;
+    Edt->NumThreads = 1;
+#endif
+    Edt->Width = Width;
+    Edt->Height = Height;
+    
+    if(!(Edt->Dist = (num *)WorkspaceAlloc(Ws,
+            sizeof(num)*((long)Width)*Height))
+        || !(Edt->Buffer = (double *)WorkspaceAlloc(Ws, sizeof(double)
+            *(2*Width + 1)*Edt->NumThreads))
+        || !(Edt->Index = (int *)WorkspaceAlloc(Ws, sizeof(int)
+            *Width*Edt->NumThreads)))
+        return NULL;
+    
+    return Edt;
+}
+
+
+/**
+ * @brief Distance to the nearest seed along the columns
+ * @param Dist output distances
+ * @param Phi the level set
+ * @param Width, Height the image dimensions
+ * @param i0, i1 range of columns to process
+ * @param Inside if nonzero, the seeds are the pixels with Phi < 0,
+ *    otherwise the pixels with Phi >= 0
+ *
+ * The columns are processed a row at a time for memory locality.
+ */
+static void ColumnPass(num *Dist, const num *Phi, int Width, int Height,
+    int i0, int i1, int Inside)
+{
+    const long Stride = Width;
+    long Row;
+    int i, j;
+    
+    for(i = i0; i < i1; i++)
+        Dist[i] = ((Phi[i] < 0) == Inside) ? 0 : EDT_INF;
+    
+    for(j = 1, Row = Stride; j < Height; j++, Row += Stride)
+        for(i = i0; i < i1; i++)
+            Dist[Row + i] = ((Phi[Row + i] < 0) == Inside) ?
+                0 : Dist[Row - Stride + i] + 1;
+    
+    for(j = Height - 2, Row = Stride*j; j >= 0; j--, Row -= Stride)
+        for(i = i0; i < i1; i++)
+            if(Dist[Row + Stride + i] + 1 < Dist[Row + i])
+                Dist[Row + i] = Dist[Row + Stride + i] + 1;
+}
+
+
+/**
+ * @brief Squared Euclidean distance along a row, and update of Phi
+ * @param PhiRow the row of the level set
+ * @param DistRow the column distances of the row
+ * @param Width number of pixels in the row
+ * @param Inside if nonzero, update the pixels with Phi >= 0,
+ *    otherwise the pixels with Phi < 0
+ * @param f, z, v workspace with Width, Width + 1, and Width elements
+ *
+ * The squared distance at x is min_q (x - q)^2 + DistRow[q]^2, the lower
+ * envelope of one parabola per pixel.  Pixels with no seed in their column
+ * do not contribute a parabola.
+ */
+static void RowPass(num *PhiRow, const num *DistRow, int Width, int Inside,
+    double *f, double *z, int *v)
+{
+    double s = 0, d;
+    int q, k = -1;
+    
+    for(q = 0; q < Width; q++)
+    {
+        if(DistRow[q] >= EDT_INF)
+            continue;
+        
+        f[q] = ((double)DistRow[q]) * DistRow[q];
+        
+        /* Remove the parabolas hidden by the parabola at q */
+        while(k >= 0)
+        {
+            s = ((f[q] + ((double)q)*q) - (f[v[k]] + ((double)v[k])*v[k]))
+                / (2.0*(q - v[k]));
+            
+            if(s > z[k])
+                break;
+            
+            k--;
+        }
+        
+        k++;
+        v[k] = q;
+        z[k] = (k > 0) ? s : -HUGE_VAL;
+    }
+    
+    if(k < 0)
+        return;
+    
+    z[k + 1] = HUGE_VAL;
+    
+    for(q = 0, k = 0; q < Width; q++)
+    {
+        while(z[k + 1] < q)
+            k++;
+        
+        if((PhiRow[q] >= 0) == Inside)
+        {
+            d = sqrt((q - v[k])*(double)(q - v[k]) + f[v[k]]);
+            PhiRow[q] = (num)(Inside ? d - 0.5 : 0.5 - d);
+        }
+    }
+}
+
+
+/**
+ * @brief Replace Phi with the signed distance to its zero level set
+ * @param Edt workspace from EdtNew for the dimensions of Phi
+ * @param Phi the level set, modified in place
+ *
+ * A pixel with Phi >= 0 gets the distance to the nearest pixel with Phi < 0,
+ * minus one half, and vice versa with a negative sign, so that the zero
+ * level set lies halfway between pixels of opposite signs.  The sign of
+ * each pixel is kept, so the segmentation is not changed.  If all pixels
+ * have the same sign, Phi is not modified.
+ */
+void EdtSignedDistance(edt *Edt, num *Phi)
+{
+    const long NumPixels = ((long)Edt->Width) * ((long)Edt->Height);
+    const int Width = Edt->Width, Height = Edt->Height;
+    const int NumThreads = Edt->NumThreads;
+    long n, NumInside = 0;
+    int Inside, Part, j;
+    
+    for(n = 0; n < NumPixels; n++)
+        if(Phi[n] >= 0)
+            NumInside++;
+    
+    if(NumInside == 0 || NumInside == NumPixels)
+        return;
+    
+    /* Distances of the pixels inside, then of the pixels outside */
+    for(Inside = 1; Inside >= 0; Inside--)
+    {
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(NumThreads)
+#endif
+        for(Part = 0; Part < NumThreads; Part++)
+            ColumnPass(Edt->Dist, Phi, Width, Height,
+                (int)((((long)Width)*Part)/NumThreads),
+                (int)((((long)Width)*(Part + 1))/NumThreads), Inside);
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(NumThreads)
+#endif
+        for(j = 0; j < Height; j++)
+        {
+#ifdef _OPENMP
+            const int Thread = omp_get_thread_num();
+#else
+            const int Thread = 0;
+#endif
+            double *Buffer = Edt->Buffer + ((long)(2*Width + 1))*Thread;
+            
+            RowPass(Phi + ((long)Width)*j, Edt->Dist + ((long)Width)*j,
+                Width, Inside, Buffer, Buffer + Width,
+                Edt->Index + ((long)Width)*Thread);
+        }
+    }
+}
@@ -0,0 +1,16 @@
+/**
+ * @file edt.h
+ * @brief Signed distance reinitialization of a level set
+ */
+#ifndef _EDT_H_
+#define _EDT_H_
+
+#include "num.h"
+#include "workspace.h"
+
+typedef struct edtstruct edt;
+
+edt *EdtNew(int Width, int Height, int NumThreads, workspace *Ws);
+void EdtSignedDistance(edt *Edt, num *Phi);
+
+#endif /* _EDT_H_ */
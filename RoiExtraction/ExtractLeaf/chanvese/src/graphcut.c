@@ -0,0 +1,154 @@
+/**
+ * @file graphcut.c
+ * @brief Graph-cut backend for Chan-Vese segmentation
+ *
+ * For fixed region averages c1 and c2, the Chan-Vese energy
+ *
+ *    mu Length(C) + nu Area(inside(C))
+ *       + lambda1 int_inside |f - c1|^2 + lambda2 int_outside |f - c2|^2
+ *
+ * with the length measured by the Cauchy-Crofton formula on a grid
+ * neighborhood is minimized exactly by a minimum cut.  The boundary length
+ * is approximated by the sum over cut edges of weights
+ *
+ *    w_k = mu dphi_k / (2 |e_k|),
+ *
+ * where e_k is the edge vector and dphi_k the angle between consecutive
+ * edge directions, so pi/4 for the axis edges of the 4-neighborhood and
+ * pi/8 and pi/(8 sqrt(2)) for the axis and diagonal edges of the
+ * 8-neighborhood.  This backend alternates minimum cuts computed with
+ * maxflow.c and updates of c1 and c2, which typically converges in a few
+ * outer iterations.
+ *
+ * Y. Boykov and V. Kolmogorov, "Computing geodesics and minimal surfaces
+ * via graph cuts," International Conference on Computer Vision, 2003.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "basic.h"
+#include "chanveseopt.h"
+#include "maxflow.h"
+
+
+/**
+ * @brief Chan-Vese segmentation by graph cuts
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @param Ws workspace for the scratch memory
+ * @return the final state as for ChanVese, 0 on failure
+ *
+ * Each iteration computes the segmentation minimizing the energy for the
+ * current c1 and c2 and then updates c1 and c2.  The Delta passed to the
+ * plotting function and compared to Tol is the fraction of pixels that
+ * changed label, so Tol = 0 iterates until the segmentation is stationary.
+ * On return, Phi is +1 inside and -1 outside of the segmentation.
+ */
+int GraphCutChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    const size_t Mark = WorkspaceMark(Ws);
+    maxflow *Graph;
+    fliptest FlipTest;
+    const unsigned long StartTime = Clock();
+    unsigned char *Label;
+    num *c1, *c2, *TrCap;
+    const num *fPtr;
+    num Dist1, Dist2, Temp;
+    double Delta = 1000;
+    long n, Flips;
+    int Iter, Channel, State = CHANVESE_MAXITER, Success = 0;
+    
+    if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(TrCap = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Label = (unsigned char *)WorkspaceAlloc(Ws, NumPixels))
+        || !(Graph = (Opt->Connectivity == 4) ?
+            MaxflowNew(Width, Height, 4, (num)(Opt->Mu*M_PI_4), 0, Ws) :
+            MaxflowNew(Width, Height, 8, (num)(Opt->Mu*M_PI_8),
+                (num)(Opt->Mu*M_PI_8*M_1_SQRT2), Ws))
+        || !FlipTestInit(&FlipTest, Opt, NumPixels, Ws))
+        goto Done;
+    
+    RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+    Success = CHANVESE_MAXITER;
+    
+    if(Opt->PlotFun)
+        if(!Opt->PlotFun(0, 0, (num)Delta, c1, c2, Phi,
+                Width, Height, NumChannels, Opt->PlotParam))
+            goto Done;
+    
+    for(Iter = 1; Iter <= Opt->MaxIter; Iter++)
+    {
+        /* The source side is the inside of the curve: a pixel on the sink
+           side cuts its source edge with the outside cost, and a pixel on
+           the source side cuts its sink edge with the inside cost. */
+        for(n = 0; n < NumPixels; n++)
+        {
+            Dist1 = Dist2 = 0;
+            
+            for(Channel = 0, fPtr = f + n; Channel < NumChannels;
+                Channel++, fPtr += NumPixels)
+            {
+                Temp = *fPtr - c1[Channel];
+                Dist1 += Temp*Temp;
+                Temp = *fPtr - c2[Channel];
+                Dist2 += Temp*Temp;
+            }
+            
+            TrCap[n] = Opt->Lambda2*Dist2 - Opt->Nu - Opt->Lambda1*Dist1;
+        }
+        
+        MaxflowSolve(Graph, TrCap, Label);
+        
+        for(n = 0, Flips = 0; n < NumPixels; n++)
+        {
+            if((Phi[n] >= 0) != Label[n])
+                Flips++;
+            
+            Phi[n] = (Label[n]) ? 1 : -1;
+        }
+        
+        RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+        Delta = ((double)Flips)/NumPixels;
+        TraceRecord(Opt->Trace, Iter, Delta, c1, c2, (double)Flips);
+        
+        if(Delta <= Opt->Tol)
+        {
+            State = CHANVESE_CONVERGED;
+            break;
+        }
+        
+        if(FlipTestUpdate(&FlipTest, Iter, (double)Flips))
+        {
+            State = CHANVESE_NOFLIPS;
+            break;
+        }
+        
+        if(DeadlineReached(Opt, StartTime))
+        {
+            State = CHANVESE_DEADLINE;
+            break;
+        }
+        
+        if(Opt->PlotFun)
+            if(!Opt->PlotFun(0, Iter, (num)Delta, c1, c2, Phi,
+                    Width, Height, NumChannels, Opt->PlotParam))
+                goto Done;
+    }
+    
+    Success = State;
+    TraceClearProgress(Opt->Trace);
+    
+    if(Opt->PlotFun)
+        Opt->PlotFun(State, (Iter <= Opt->MaxIter) ? Iter:Opt->MaxIter,
+            (num)Delta, c1, c2, Phi, Width, Height, NumChannels,
+            Opt->PlotParam);
+
+Done:
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
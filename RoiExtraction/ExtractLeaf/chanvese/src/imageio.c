@@ -54,6 +54,14 @@
 #include <setjmp.h>
 #endif
 
+#if defined(__GNUC__) && defined(__x86_64__)
+/* Compile vectorized conversions, selected at runtime by CpuFeatures.  They
+   are bit-identical to the scalar code only with SSE floating-point math, so
+   they are not used with the x87 math of 32-bit builds. */
+#define IMAGEIO_SIMD
+#include <immintrin.h>
+#endif
+
 /** @brief Buffer size to use for BMP file I/O */
 #define FILE_BUFFER_CAPACITY    (1024*4)
 
@@ -210,64 +218,284 @@ static void WriteDWordLE(uint32_t dw, FILE *File)
 }
 
 
+/**
+ * @brief Destination of the image readers
+ *
+ * The readers decode each row as RGBA U8 into the row returned by SinkRow and
+ * then call SinkPutRow.  If the requested format is not RGBA U8 and the reader
+ * decodes row by row, each row is converted directly into the requested
+ * format, so that there is no intermediate RGBA copy of the whole image.
+ * Otherwise, the RGBA image is converted when it is complete by SinkFinish.
+ * In both cases, the sink notes whether any pixel has color.
+ */
+typedef struct
+{
+    /** @brief Requested format, or 0 for RGBA U8 */
+    unsigned Format;
+    /** @brief Image data in the requested format */
+    void *Image;
+    /** @brief RGBA U8 data, a single row if ByRow is set */
+    uint32_t *Rgba;
+    /** @brief Image dimensions */
+    int Width, Height;
+    /** @brief Nonzero if rows are converted as they are decoded */
+    int ByRow;
+    /** @brief Reduction factor requested for JPEG decoding, 1, 2, 4, or 8 */
+    int ScaleDenom;
+    /** @brief If positive, reduce JPEG as far as keeping this side length */
+    int ScaleSide;
+    /** @brief Set to 1 once a pixel is found whose RGB components differ */
+    int UseColor;
+    /** @brief If not NULL, provides the buffers instead of Malloc */
+    imagebufferfun GetBuffer;
+    /** @brief Parameter passed to GetBuffer */
+    void *BufferParam;
+} imagesink;
+
+static size_t FormatSize(int Width, int Height, unsigned Format);
+static void ConvertRowsToFormat(void *Dest, const uint32_t *Src,
+    int Width, int Height, int y0, int NumRows, unsigned Format);
+
+
+/** @brief Initialize an empty sink for the requested format */
+static void SinkInit(imagesink *Sink, unsigned Format,
+    imagebufferfun GetBuffer, void *BufferParam)
+{
+    Sink->Format = Format & ~(IMAGEIO_SCALE_MASK | IMAGEIO_SCALE_SIDE_MASK);
+    Sink->Image = NULL;
+    Sink->Rgba = NULL;
+    Sink->Width = Sink->Height = 0;
+    Sink->ByRow = 0;
+    Sink->ScaleDenom = 1 << ((Format & IMAGEIO_SCALE_MASK) >> 12);
+    Sink->ScaleSide = (int)((Format & IMAGEIO_SCALE_SIDE_MASK) >> 16);
+    Sink->UseColor = 0;
+    Sink->GetBuffer = GetBuffer;
+    Sink->BufferParam = BufferParam;
+}
+
+
+/**
+ * @brief Get a buffer of Size bytes for reading
+ * @param Buffer IMAGEIO_BUFFER_IMAGE, IMAGEIO_BUFFER_RGBA, or IMAGEIO_BUFFER_ROW
+ *
+ * The buffer is allocated with Malloc, or taken from GetBuffer if it is set,
+ * in which case it belongs to the caller of ReadImageBuffered.
+ */
+static void *SinkBuffer(imagesink *Sink, int Buffer, size_t Size)
+{
+    if(!Size)
+        return NULL;
+    else if(Sink->GetBuffer)
+        return Sink->GetBuffer(Sink->BufferParam, Buffer, Size);
+    else
+        return Malloc(Size);
+}
+
+
+/** @brief Release a buffer obtained from SinkBuffer */
+static void SinkRelease(imagesink *Sink, void *Ptr)
+{
+    if(Ptr && !Sink->GetBuffer)
+        Free(Ptr);
+}
+
+
+/** @brief Free the sink data */
+static void SinkFree(imagesink *Sink)
+{
+    if(Sink->Image != Sink->Rgba)
+        SinkRelease(Sink, Sink->Image);
+    
+    SinkRelease(Sink, Sink->Rgba);
+    Sink->Image = NULL;
+    Sink->Rgba = NULL;
+}
+
+
+/**
+ * @brief Allocate the sink for an image of size Width x Height
+ * @param ByRow nonzero if the reader will decode the rows in a single pass
+ * @return 1 on success, 0 on failure
+ */
+static int SinkAlloc(imagesink *Sink, int Width, int Height, int ByRow)
+{
+    Sink->Width = Width;
+    Sink->Height = Height;
+    Sink->ByRow = (ByRow && Sink->Format);
+    
+    if(Sink->ByRow)
+    {
+        if(!(Sink->Image = SinkBuffer(Sink, IMAGEIO_BUFFER_IMAGE,
+                FormatSize(Width, Height, Sink->Format)))
+            || !(Sink->Rgba = (uint32_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_RGBA,
+                sizeof(uint32_t)*((size_t)Width))))
+        {
+            SinkFree(Sink);
+            return 0;
+        }
+    }
+    else if(!(Sink->Rgba = (uint32_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_RGBA,
+        sizeof(uint32_t)*((size_t)Width)*((size_t)Height))))
+        return 0;
+    
+    return 1;
+}
+
+
+/** @brief Get the RGBA U8 destination for row y */
+static uint32_t *SinkRow(imagesink *Sink, int y)
+{
+    return (Sink->ByRow) ? Sink->Rgba
+        : Sink->Rgba + ((size_t)Sink->Width)*((size_t)y);
+}
+
+
+/** @brief Set UseColor if any of the pixels has color */
+static void SinkCheckColor(imagesink *Sink, const uint32_t *Src, size_t NumPixels)
+{
+    const uint8_t *Pixel = (const uint8_t *)Src;
+    size_t n;
+    
+    if(!Sink->UseColor)
+        for(n = 0; n < NumPixels; n++, Pixel += 4)
+            if(Pixel[0] != Pixel[1] || Pixel[0] != Pixel[2])
+            {
+                Sink->UseColor = 1;
+                break;
+            }
+}
+
+
+/** @brief Finish row y, which has been decoded into SinkRow(Sink, y) */
+static void SinkPutRow(imagesink *Sink, int y)
+{
+    if(Sink->ByRow)
+    {
+        SinkCheckColor(Sink, Sink->Rgba, (size_t)Sink->Width);
+        ConvertRowsToFormat(Sink->Image, Sink->Rgba,
+            Sink->Width, Sink->Height, y, 1, Sink->Format);
+    }
+}
+
+
+/**
+ * @brief Finish reading, converting the RGBA data if necessary
+ * @return pointer to the image in the requested format, or NULL on failure
+ */
+static void *SinkFinish(imagesink *Sink)
+{
+    if(Sink->Rgba && !Sink->ByRow)
+    {
+        SinkCheckColor(Sink, Sink->Rgba,
+            ((size_t)Sink->Width)*((size_t)Sink->Height));
+        
+        if(!Sink->Format)
+            Sink->Image = Sink->Rgba;
+        else if((Sink->Image = SinkBuffer(Sink, IMAGEIO_BUFFER_IMAGE,
+            FormatSize(Sink->Width, Sink->Height, Sink->Format))))
+            ConvertRowsToFormat(Sink->Image, Sink->Rgba,
+                Sink->Width, Sink->Height, 0, Sink->Height, Sink->Format);
+    }
+    
+    if(Sink->Rgba != Sink->Image)
+        SinkRelease(Sink, Sink->Rgba);
+    
+    Sink->Rgba = NULL;
+    return Sink->Image;
+}
+
+
+/**
+ * @brief Read one row of BMP data, including the padding
+ *
+ * As when reading byte by byte with getc, bytes past the end of the file are
+ * read as 0xFF, so that truncated files are decoded the same way.
+ */
+static void ReadBmpRow(uint8_t *Row, size_t RowSize, FILE *File)
+{
+    size_t Count = fread(Row, 1, RowSize, File);
+    
+    if(Count < RowSize)
+        memset(Row + Count, 0xFF, RowSize - Count);
+}
+
+
 /** @brief Internal function for reading 1-bit BMP */
-static int ReadBmp1Bit(uint32_t *Image, int Width, int Height, FILE *File, const uint32_t *Palette)
+static int ReadBmp1Bit(imagesink *Sink, FILE *File, const uint32_t *Palette)
 {
-    int RowPadding = (-(Width+7)/8)&3;
-    int x, y, Bit;
+    const int Width = Sink->Width;
+    const size_t RowSize = (((size_t)Width + 7)/8 + 3) & ~((size_t)3);
+    const uint8_t *RowPtr;
+    uint32_t *Image;
+    uint8_t *Row;
+    int x, y, Bit, Success = 0;
     unsigned Code;
     
-    Image += ((long int)Width)*((long int)Height - 1);
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
     
-    for(y = Height; y; y--, Image -= Width)
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
         
-        for(x = 0; x < Width;)
+        ReadBmpRow(Row, RowSize, File);
+        
+        for(x = 0, RowPtr = Row, Image = SinkRow(Sink, y); x < Width; RowPtr++)
         {
-            Code = getc(File);
+            Code = *RowPtr;
             
             for(Bit = 7; Bit >= 0 && x < Width; Bit--, Code <<= 1)
                 Image[x++] = Palette[(Code & 0x80) ? 1:0];
         }
         
-        for(x = RowPadding; x; x--)
-            getc(File); /* Skip padding bytes at the end of the row */
+        SinkPutRow(Sink, y);
     }
     
-    return 1;
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 
 /** @brief Internal function for reading 4-bit BMP */
-static int ReadBmp4Bit(uint32_t *Image, int Width, int Height, FILE *File, const uint32_t *Palette)
+static int ReadBmp4Bit(imagesink *Sink, FILE *File, const uint32_t *Palette)
 {
-    int RowPadding = (-(Width+1)/2)&3;
-    int x, y;
+    const int Width = Sink->Width;
+    const size_t RowSize = (((size_t)Width + 1)/2 + 3) & ~((size_t)3);
+    const uint8_t *RowPtr;
+    uint32_t *Image;
+    uint8_t *Row;
+    int x, y, Success = 0;
     unsigned Code;
-
-    Image += ((long int)Width)*((long int)Height - 1);
     
-    for(y = Height; y; y--, Image -= Width)
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
+    
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
         
-        for(x = 0; x < Width;)
+        ReadBmpRow(Row, RowSize, File);
+        
+        for(x = 0, RowPtr = Row, Image = SinkRow(Sink, y); x < Width; RowPtr++)
         {
-            Code = getc(File);
+            Code = *RowPtr;
             Image[x++] = Palette[(Code & 0xF0) >> 4];
             
             if(x < Width)
                 Image[x++] = Palette[Code & 0x0F];
         }
         
-        for(x = RowPadding; x; x--)
-            getc(File); /* Skip padding bytes at the end of the row */
+        SinkPutRow(Sink, y);
     }
     
-    return 1;
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 
@@ -370,26 +598,34 @@ static int ReadBmp4BitRle(uint32_t *Image, int Width, int Height, FILE *File, co
 
 
 /** @brief Internal function for reading 8-bit BMP */
-static int ReadBmp8Bit(uint32_t *Image, int Width, int Height, FILE *File, const uint32_t *Palette)
+static int ReadBmp8Bit(imagesink *Sink, FILE *File, const uint32_t *Palette)
 {
-    int RowPadding = (-Width)&3;
-    int x, y;
+    const int Width = Sink->Width;
+    const size_t RowSize = ((size_t)Width + 3) & ~((size_t)3);
+    uint32_t *Image;
+    uint8_t *Row;
+    int x, y, Success = 0;
     
-    Image += ((long int)Width)*((long int)Height - 1);
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
     
-    for(y = Height; y; y--, Image -= Width)
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
         
-        for(x = 0; x < Width; x++)
-            Image[x] = Palette[getc(File) & 0xFF];
+        ReadBmpRow(Row, RowSize, File);
         
-        for(x = RowPadding; x; x--)
-            getc(File); /* Skip padding bytes at the end of the row */
+        for(x = 0, Image = SinkRow(Sink, y); x < Width; x++)
+            Image[x] = Palette[Row[x]];
+        
+        SinkPutRow(Sink, y);
     }
     
-    return 1;
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 
@@ -465,34 +701,44 @@ static int ReadBmp8BitRle(uint32_t *Image, int Width, int Height, FILE *File, co
 
 
 /** @brief Internal function for reading 24-bit BMP */
-static int ReadBmp24Bit(uint32_t *Image, int Width, int Height, FILE *File)
+static int ReadBmp24Bit(imagesink *Sink, FILE *File)
 {
-    uint8_t *ImagePtr = (uint8_t *)Image;
-    int RowPadding = (-3*Width)&3;
-    int x, y;
-
+    const int RowBytes = 4*Sink->Width;
+    const size_t RowSize = (3*(size_t)Sink->Width + 3) & ~((size_t)3);
+    uint8_t *ImagePtr;
+    const uint8_t *RowPtr;
+    uint8_t *Row;
+    int x, y, Success = 0;
     
-    Width <<= 2;
-    ImagePtr += ((long int)Width)*((long int)Height - 1);
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
     
-    for(y = Height; y; y--, ImagePtr -= Width)
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
+        
+        ReadBmpRow(Row, RowSize, File);
+        
+        ImagePtr = (uint8_t *)SinkRow(Sink, y);
         
-        for(x = 0; x < Width; x += 4)
+        /* Swizzle BGR to RGBA.  The loop has no dependencies between
+           pixels, so that the compiler can vectorize it. */
+        for(x = 0, RowPtr = Row; x < RowBytes; x += 4, RowPtr += 3)
         {
-            ImagePtr[x+3] = 255;        /* Set alpha            */
-            ImagePtr[x+2] = getc(File); /* Read blue component  */
-            ImagePtr[x+1] = getc(File); /* Read green component */
-            ImagePtr[x+0] = getc(File); /* Read red component   */
+            ImagePtr[x+0] = RowPtr[2];  /* Red   */
+            ImagePtr[x+1] = RowPtr[1];  /* Green */
+            ImagePtr[x+2] = RowPtr[0];  /* Blue  */
+            ImagePtr[x+3] = 255;        /* Alpha */
         }
         
-        for(x = RowPadding; x; x--)
-            getc(File); /* Skip padding bytes at the end of the row */
+        SinkPutRow(Sink, y);
     }
     
-    return 1;
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 /** @brief Internal function for determining bit shifts in bitfield BMP */
@@ -536,31 +782,38 @@ static void GetMaskShifts(uint32_t Mask, int *LeftShift, int *RightShift)
 }
 
 /** @brief Internal function for reading 16-bit BMP */
-static int ReadBmp16Bit(uint32_t *Image, int Width, int Height, FILE *File,
+static int ReadBmp16Bit(imagesink *Sink, FILE *File,
     uint32_t RedMask, uint32_t GreenMask, uint32_t BlueMask, uint32_t AlphaMask)
 {
-    uint8_t *ImagePtr = (uint8_t *)Image;
+    const int RowBytes = 4*Sink->Width;
+    const size_t RowSize = (2*(size_t)Sink->Width + 3) & ~((size_t)3);
+    uint8_t *ImagePtr;
+    const uint8_t *RowPtr;
+    uint8_t *Row;
     uint32_t Code;
-    int RowPadding = (-2*Width)&3;
     int RedLeftShift, GreenLeftShift, BlueLeftShift, AlphaLeftShift;
     int RedRightShift, GreenRightShift, BlueRightShift, AlphaRightShift;
-    int x, y;
+    int x, y, Success = 0;
+    
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
     
     GetMaskShifts(RedMask, &RedLeftShift, &RedRightShift);
     GetMaskShifts(GreenMask, &GreenLeftShift, &GreenRightShift);
     GetMaskShifts(BlueMask, &BlueLeftShift, &BlueRightShift);
     GetMaskShifts(AlphaMask, &AlphaLeftShift, &AlphaRightShift);
-    Width <<= 2;
-    ImagePtr += ((long int)Width)*((long int)Height - 1);
     
-    for(y = Height; y; y--, ImagePtr -= Width)
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
+        
+        ReadBmpRow(Row, RowSize, File);
         
-        for(x = 0; x < Width; x += 4)
+        for(x = 0, RowPtr = Row, ImagePtr = (uint8_t *)SinkRow(Sink, y);
+            x < RowBytes; x += 4, RowPtr += 2)
         {
-            Code = ReadWordLE(File);
+            Code = RowPtr[0] | ((uint32_t)RowPtr[1] << 8);
             /* By the Windows 4.x BMP specification, color component masks must be contiguous
             [http://www.fileformat.info/format/bmp/egff.htm].  So we can decode the bitfields
             by bitwise AND with the mask and applying a bitshift.*/
@@ -570,39 +823,50 @@ static int ReadBmp16Bit(uint32_t *Image, int Width, int Height, FILE *File,
             ImagePtr[x+0] = ((Code & RedMask  ) >> RedRightShift  ) << RedLeftShift;
         }
         
-        for(x = RowPadding; x; x--)
-            getc(File); /* Skip padding bytes at the end of the row */
+        SinkPutRow(Sink, y);
     }
-
-    return 1;
+    
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 
 /** @brief Internal function for reading 32-bit BMP */
-static int ReadBmp32Bit(uint32_t *Image, int Width, int Height, FILE *File,
+static int ReadBmp32Bit(imagesink *Sink, FILE *File,
     uint32_t RedMask, uint32_t GreenMask, uint32_t BlueMask, uint32_t AlphaMask)
 {
+    const int RowBytes = 4*Sink->Width;
+    const size_t RowSize = 4*(size_t)Sink->Width;
     uint8_t *ImagePtr;
+    const uint8_t *RowPtr;
+    uint8_t *Row;
     uint32_t Code;
     int RedLeftShift, GreenLeftShift, BlueLeftShift, AlphaLeftShift;
     int RedRightShift, GreenRightShift, BlueRightShift, AlphaRightShift;
-    int x, y;
+    int x, y, Success = 0;
+    
+    if(!(Row = (uint8_t *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW, RowSize)))
+        return 0;
     
     GetMaskShifts(RedMask, &RedLeftShift, &RedRightShift);
     GetMaskShifts(GreenMask, &GreenLeftShift, &GreenRightShift);
     GetMaskShifts(BlueMask, &BlueLeftShift, &BlueRightShift);
     GetMaskShifts(AlphaMask, &AlphaLeftShift, &AlphaRightShift);
-    Width <<= 2;
-    ImagePtr = (uint8_t *)Image + ((long int)Width)*((long int)Height - 1);
     
-    for(y = Height; y; y--, ImagePtr -= Width)
+    for(y = Sink->Height - 1; y >= 0; y--)
     {
         if(feof(File))
-            return 0;
+            goto Catch;
         
-        for(x = 0; x < Width; x += 4)
+        ReadBmpRow(Row, RowSize, File);
+        
+        for(x = 0, RowPtr = Row, ImagePtr = (uint8_t *)SinkRow(Sink, y);
+            x < RowBytes; x += 4, RowPtr += 4)
         {
-            Code = ReadDWordLE(File);
+            Code = RowPtr[0] | ((uint32_t)RowPtr[1] << 8)
+                | ((uint32_t)RowPtr[2] << 16) | ((uint32_t)RowPtr[3] << 24);
             /* By the Windows 4.x BMP specification, color component masks must be contiguous
             [http://www.fileformat.info/format/bmp/egff.htm].  So we can decode the bitfields
             by bitwise AND with the mask and applying a bitshift.*/
@@ -611,16 +875,20 @@ static int ReadBmp32Bit(uint32_t *Image, int Width, int Height, FILE *File,
             ImagePtr[x+1] = ((Code & GreenMask) >> GreenRightShift) << GreenLeftShift;
             ImagePtr[x+0] = ((Code & RedMask  ) >> RedRightShift  ) << RedLeftShift;
         }
+        
+        SinkPutRow(Sink, y);
     }
-
-    return 1;
+    
+    Success = 1;
+Catch:
+    SinkRelease(Sink, Row);
+    return Success;
 }
 
 /**
 * @brief Read a BMP (Windows Bitmap) image file as RGBA data
 *
-* @param Image, Width, Height pointers to be filled with the pointer
-*        to the image data and the image dimensions.
+* @param Sink the destination for the image data
 * @param File stdio FILE pointer pointing to the beginning of the BMP file
 *
 * @return 1 on success, 0 on failure
@@ -629,18 +897,16 @@ static int ReadBmp32Bit(uint32_t *Image, int Width, int Height, FILE *File,
 * \c ReadBmp, the caller should open \c File as a FILE pointer in binary read
 * mode.  When \c ReadBmp is complete, the caller should close \c File.
 */
-static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
+static int ReadBmp(imagesink *Sink, FILE *File)
 {
-    uint32_t *Palette = NULL;
+    uint32_t Palette[256];
     uint8_t *PalettePtr;
     long int ImageDataOffset, InfoSize;
     unsigned i, NumPlanes, BitsPerPixel, Compression, NumColors;
     uint32_t RedMask, GreenMask, BlueMask, AlphaMask;
-    int Success = 0, Os2Bmp;
+    int Width, Height, Success = 0, Os2Bmp;
     uint8_t Magic[2];
     
-    *Image = NULL;
-    *Width = *Height = 0;
     fseek(File, 0, SEEK_SET);
 
     Magic[0] = getc(File);
@@ -665,8 +931,8 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
     
     if((Os2Bmp = (InfoSize == 12)))  /* This is an OS/2 V1 infoheader */
     {
-        *Width = (int)ReadWordLE(File);
-        *Height = (int)ReadWordLE(File);
+        Width = (int)ReadWordLE(File);
+        Height = (int)ReadWordLE(File);
         NumPlanes = (unsigned)ReadWordLE(File);
         BitsPerPixel = (unsigned)ReadWordLE(File);
         Compression = 0;
@@ -678,8 +944,8 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
     }
     else
     {
-        *Width = abs((int)ReadDWordLE(File));
-        *Height = abs((int)ReadDWordLE(File));
+        Width = abs((int)ReadDWordLE(File));
+        Height = abs((int)ReadDWordLE(File));
         NumPlanes = (unsigned)ReadWordLE(File);
         BitsPerPixel = (unsigned)ReadWordLE(File);
         Compression = (unsigned)ReadDWordLE(File);
@@ -693,7 +959,7 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
     }
     
     /* Check for problems or unsupported compression modes */
-    if(*Width > MAX_IMAGE_SIZE || *Height > MAX_IMAGE_SIZE)
+    if(Width > MAX_IMAGE_SIZE || Height > MAX_IMAGE_SIZE)
     {
         ErrorMessage("Image dimensions exceed MAX_IMAGE_SIZE.\n");
         goto Catch;
@@ -702,8 +968,8 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
     if(feof(File) || NumPlanes != 1 || Compression > 3)
         goto Catch;
     
-    /* Allocate the image data */
-    if(!(*Image = (uint32_t *)Malloc(sizeof(uint32_t)*((long int)*Width)*((long int)*Height))))
+    /* Allocate the image data, the RLE modes may jump between rows */
+    if(!SinkAlloc(Sink, Width, Height, Compression == 0 || Compression == 3))
         goto Catch;
     
     /* Read palette */
@@ -711,12 +977,9 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
     {
         fseek(File, 14 + InfoSize, SEEK_SET);
         
-        if(!NumColors)
+        if(!NumColors || NumColors > 256)
             NumColors = 1 << BitsPerPixel;
         
-        if(!(Palette = (uint32_t *)Malloc(sizeof(uint32_t)*256)))
-            goto Catch;
-        
         for(i = 0, PalettePtr = (uint8_t *)Palette; i < NumColors; i++)
         {
             PalettePtr[3] = 255;          /* Set alpha            */
@@ -746,44 +1009,44 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
             switch(BitsPerPixel)
             {
             case 1: /* Read 1-bit uncompressed indexed data */
-                Success = ReadBmp1Bit(*Image, *Width, *Height, File, Palette);
+                Success = ReadBmp1Bit(Sink, File, Palette);
                 break;
             case 4: /* Read 4-bit uncompressed indexed data */
-                Success = ReadBmp4Bit(*Image, *Width, *Height, File, Palette);
+                Success = ReadBmp4Bit(Sink, File, Palette);
                 break;
             case 8: /* Read 8-bit uncompressed indexed data */
-                Success = ReadBmp8Bit(*Image, *Width, *Height, File, Palette);
+                Success = ReadBmp8Bit(Sink, File, Palette);
                 break;
             case 24: /* Read 24-bit BGR image data */
-                Success = ReadBmp24Bit(*Image, *Width, *Height, File);
+                Success = ReadBmp24Bit(Sink, File);
                 break;
             case 16: /* Read 16-bit data */
-                Success = ReadBmp16Bit(*Image, *Width, *Height, File,
+                Success = ReadBmp16Bit(Sink, File,
                     0x001F << 10, 0x001F << 5, 0x0001F, 0);
                 break;
             case 32: /* Read 32-bit BGRA image data */
-                Success = ReadBmp32Bit(*Image, *Width, *Height, File,
+                Success = ReadBmp32Bit(Sink, File,
                     0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
                 break;
             }
             break;
         case 1: /* 8-bit RLE */
             if(BitsPerPixel == 8)
-                Success = ReadBmp8BitRle(*Image, *Width, *Height, File, Palette);
+                Success = ReadBmp8BitRle(Sink->Rgba, Width, Height, File, Palette);
             break;
         case 2: /* 4-bit RLE */
             if(BitsPerPixel == 4)
-                Success = ReadBmp4BitRle(*Image, *Width, *Height, File, Palette);
+                Success = ReadBmp4BitRle(Sink->Rgba, Width, Height, File, Palette);
             break;
         case 3: /* Bitfields data */
             switch(BitsPerPixel)
             {
             case 16: /* Read 16-bit bitfields data */
-                Success = ReadBmp16Bit(*Image, *Width, *Height, File,
+                Success = ReadBmp16Bit(Sink, File,
                     RedMask, GreenMask, BlueMask, AlphaMask);
                 break;
             case 32: /* Read 32-bit bitfields data */
-                Success = ReadBmp32Bit(*Image, *Width, *Height, File,
+                Success = ReadBmp32Bit(Sink, File,
                     RedMask, GreenMask, BlueMask, AlphaMask);
                 break;
             }
@@ -794,11 +1057,8 @@ static int ReadBmp(uint32_t **Image, int *Width, int *Height, FILE *File)
         ErrorMessage("Error reading BMP data.\n");
     
 Catch:	/* There was a problem, clean up and exit */
-    if(Palette)
-        Free(Palette);
-    
-    if(!Success && *Image)
-        Free(*Image);
+    if(!Success)
+        SinkFree(Sink);
     
     return Success;
 }
@@ -829,8 +1089,10 @@ static int WriteBmp(const uint32_t *Image, int Width, int Height, FILE *File)
 {
     const uint8_t *ImagePtr = (uint8_t *)Image;
     uint32_t *Palette = NULL;
-    uint32_t Pixel;
+    uint8_t *Row = NULL, *RowPtr;
+    uint32_t Pixel, LastPixel = 0;
     long int ImageSize;
+    size_t RowSize;
     int UsePalette, NumColors, UseColor, UseAlpha;
     int x, y, i, RowPadding, Success = 0;
 
@@ -861,6 +1123,14 @@ static int WriteBmp(const uint32_t *Image, int Width, int Height, FILE *File)
         ImageSize = (3*Width + RowPadding)*((long int)Height);
     }
     
+    /* Buffer for one row of the file, the padding bytes stay zero */
+    RowSize = ((UsePalette) ? Width : 3*Width) + RowPadding;
+    
+    if(!(Row = (uint8_t *)Malloc(RowSize)))
+        goto Catch;
+    
+    memset(Row, 0, RowSize);
+    
     /*** Write the header ***/
     
     /* Write the BMP header */
@@ -911,33 +1181,40 @@ static int WriteBmp(const uint32_t *Image, int Width, int Height, FILE *File)
     Width <<= 2;
     ImagePtr += ((long int)Width)*((long int)Height - 1);
             
-    for(y = Height; y; y--, ImagePtr -= Width)
+    for(y = Height, i = 0; y; y--, ImagePtr -= Width)
     {
         if(UsePalette)
         {   /* 8-bit palette image data */
-            for(x = 0; x < Width; x += 4)
+            for(x = 0, RowPtr = Row; x < Width; x += 4, RowPtr++)
             {
                 Pixel = *((uint32_t *)(ImagePtr + x));
                 
-                for(i = 0; i < NumColors; i++)
-                    if(Pixel == Palette[i])
-                        break;
+                /* Runs of the same color are common, only search the
+                   palette when the color changes */
+                if(Pixel != LastPixel || (x == 0 && y == Height))
+                {
+                    for(i = 0; i < NumColors; i++)
+                        if(Pixel == Palette[i])
+                            break;
+                    
+                    LastPixel = Pixel;
+                }
                 
-                putc(i, File);
+                *RowPtr = i;
             }
         }
         else
-        {   /* 24-bit RGB image data */
-            for(x = 0; x < Width; x += 4)
+        {   /* 24-bit RGB image data, swizzle RGBA to BGR */
+            for(x = 0, RowPtr = Row; x < Width; x += 4, RowPtr += 3)
             {
-                putc(ImagePtr[x+2], File);  /* Write blue component  */
-                putc(ImagePtr[x+1], File);  /* Write green component */
-                putc(ImagePtr[x+0], File);  /* Write red component   */
+                RowPtr[0] = ImagePtr[x+2];  /* Blue  */
+                RowPtr[1] = ImagePtr[x+1];  /* Green */
+                RowPtr[2] = ImagePtr[x+0];  /* Red   */
             }
         }
         
-        for(x = RowPadding; x; x--)         /* Write row padding */
-            putc(0, File);
+        if(fwrite(Row, 1, RowSize, File) != RowSize)
+            break;
     }
     
     if(ferror(File))
@@ -948,6 +1225,8 @@ static int WriteBmp(const uint32_t *Image, int Width, int Height, FILE *File)
     
     Success = 1;
 Catch:
+    if(Row)
+        Free(Row);
     if(Palette)
         Free(Palette);
     return Success;
@@ -979,8 +1258,7 @@ METHODDEF(void) JerrExit(j_common_ptr cinfo)
 /**
 * @brief Read a JPEG (Joint Picture Experts Group) image file as RGBA data
 *
-* @param Image, Width, Height pointers to be filled with the pointer
-*        to the image data and the image dimensions.
+* @param Sink the destination for the image data
 * @param File stdio FILE pointer pointing to the beginning of the BMP file
 *
 * @return 1 on success, 0 on failure
@@ -989,16 +1267,15 @@ METHODDEF(void) JerrExit(j_common_ptr cinfo)
 * \c ReadJpeg, the caller should open \c File as a FILE pointer in binary read
 * mode.  When \c ReadJpeg is complete, the caller should close \c File.
 */
-static int ReadJpeg(uint32_t **Image, int *Width, int *Height, FILE *File)
+static int ReadJpeg(imagesink *Sink, FILE *File)
 {
     struct jpeg_decompress_struct cinfo;
     hooked_jerr Jerr;
     JSAMPARRAY Buffer;
     uint8_t *ImagePtr;
-    unsigned i, RowSize;
+    unsigned i, RowSize, Side, Denom;
+    int y;
     
-    *Image = 0;
-    *Width = *Height = 0;
     cinfo.err = jpeg_std_error(&Jerr.pub);
     Jerr.pub.error_exit = JerrExit;
     
@@ -1009,20 +1286,34 @@ static int ReadJpeg(uint32_t **Image, int *Width, int *Height, FILE *File)
     jpeg_stdio_src(&cinfo, File);
     jpeg_read_header(&cinfo, 1);
     cinfo.out_color_space = JCS_RGB;   /* Ask for RGB image data */
+    
+    /* Reduce the size in the inverse DCT if requested */
+    Denom = (unsigned)Sink->ScaleDenom;
+    
+    if(Sink->ScaleSide > 0)
+    {
+        Side = (cinfo.image_width > cinfo.image_height) ?
+            cinfo.image_width : cinfo.image_height;
+        
+        Denom = 8;
+        
+        while(Denom > 1 && (Side + Denom - 1)/Denom < (unsigned)Sink->ScaleSide)
+            Denom /= 2;
+    }
+    
+    cinfo.scale_num = 1;
+    cinfo.scale_denom = Denom;
     jpeg_start_decompress(&cinfo);
-    *Width = (int)cinfo.output_width;
-    *Height = (int)cinfo.output_height;
     
-    if(*Width > MAX_IMAGE_SIZE || *Height > MAX_IMAGE_SIZE)
+    if(cinfo.output_width > MAX_IMAGE_SIZE || cinfo.output_height > MAX_IMAGE_SIZE)
     {
         ErrorMessage("Image dimensions exceed MAX_IMAGE_SIZE.\n");
         jpeg_abort_decompress(&cinfo);
         goto Catch;
     }
     
-    /* Allocate image memory */
-    if(!(*Image = (uint32_t *)Malloc(sizeof(uint32_t)
-        *((size_t)*Width)*((size_t)*Height))))
+    /* Allocate image memory, the scanlines are read in a single pass */
+    if(!SinkAlloc(Sink, (int)cinfo.output_width, (int)cinfo.output_height, 1))
     {
         jpeg_abort_decompress(&cinfo);
         goto Catch;
@@ -1032,9 +1323,12 @@ static int ReadJpeg(uint32_t **Image, int *Width, int *Height, FILE *File)
     RowSize = cinfo.output_width * cinfo.output_components;
     Buffer = (*cinfo.mem->alloc_sarray) ((j_common_ptr) &cinfo,
         JPOOL_IMAGE, RowSize, 1);
-    ImagePtr = (uint8_t *)*Image;
     
     while(cinfo.output_scanline < cinfo.output_height)
+    {
+        y = (int)cinfo.output_scanline;
+        ImagePtr = (uint8_t *)SinkRow(Sink, y);
+        
         for(jpeg_read_scanlines(&cinfo, Buffer, 1), i = 0; i < RowSize; i += 3)
         {
             *(ImagePtr++) = Buffer[0][i];   /* Red   */
@@ -1042,16 +1336,16 @@ static int ReadJpeg(uint32_t **Image, int *Width, int *Height, FILE *File)
             *(ImagePtr++) = Buffer[0][i+2]; /* Blue  */
             *(ImagePtr++) = 0xFF;
         }
+        
+        SinkPutRow(Sink, y);
+    }
 
     jpeg_finish_decompress(&cinfo);
     jpeg_destroy_decompress(&cinfo);
     return 1;
     
 Catch:
-    if(*Image)
-        Free(*Image);
-    
-    *Width = *Height = 0;
+    SinkFree(Sink);
     jpeg_destroy_decompress(&cinfo);
     return 0;
 }
@@ -1142,8 +1436,7 @@ Catch:
 /**
 * @brief Read a PNG (Portable Network Graphics) image file as RGBA data
 *
-* @param Image, Width, Height pointers to be filled with the pointer
-*        to the image data and the image dimensions.
+* @param Sink the destination for the image data
 * @param File stdio FILE pointer pointing to the beginning of the PNG file
 *
 * @return 1 on success, 0 on failure
@@ -1152,7 +1445,7 @@ Catch:
 * \c ReadPng, the caller should open \c File as a FILE pointer in binary read
 * mode.  When \c ReadPng is complete, the caller should close \c File.
 */
-static int ReadPng(uint32_t **Image, int *Width, int *Height, FILE *File)
+static int ReadPng(imagesink *Sink, FILE *File)
 {
     png_bytep *RowPointers;
     png_byte Header[8];
@@ -1162,9 +1455,6 @@ static int ReadPng(uint32_t **Image, int *Width, int *Height, FILE *File)
     int BitDepth, ColorType, InterlaceType;
     unsigned Row;
     
-    *Image = 0;
-    *Width = *Height = 0;
-    
     /* Check that file is a PNG file */
     if(fread(Header, 1, 8, File) != 8 || png_sig_cmp(Header, 0, 8))
         return 0;
@@ -1188,9 +1478,6 @@ static int ReadPng(uint32_t **Image, int *Width, int *Height, FILE *File)
     png_read_info(Png, Info);
     png_get_IHDR(Png, Info, &PngWidth, &PngHeight, &BitDepth, &ColorType,
         &InterlaceType, (int*)NULL, (int*)NULL);
-    *Width = (int)PngWidth;
-    *Height = (int)PngHeight;
-    
     /* Tell libpng to convert everything to 32-bit RGBA */
     if(ColorType == PNG_COLOR_TYPE_PALETTE)
         png_set_palette_to_rgb(Png);
@@ -1207,27 +1494,40 @@ static int ReadPng(uint32_t **Image, int *Width, int *Height, FILE *File)
     png_set_interlace_handling(Png);
     png_read_update_info(Png, Info);
     
-    /* Allocate image memory and row pointers */
-    if(!(*Image = (uint32_t *)Malloc(sizeof(uint32_t)
-        *((size_t)*Width)*((size_t)*Height)))
-        || !(RowPointers = (png_bytep *)Malloc(sizeof(png_bytep)
-        *PngHeight)))
+    /* Allocate image memory, interlaced images need more than one pass */
+    if(!SinkAlloc(Sink, (int)PngWidth, (int)PngHeight,
+        InterlaceType == PNG_INTERLACE_NONE))
         goto Catch;
+    
+    if(Sink->ByRow)
+    {
+        /* Read the image data one row at a time */
+        for(Row = 0; Row < PngHeight; Row++)
+        {
+            png_read_row(Png, (png_bytep)SinkRow(Sink, (int)Row), NULL);
+            SinkPutRow(Sink, (int)Row);
+        }
+    }
+    else
+    {
+        /* Allocate row pointers */
+        if(!(RowPointers = (png_bytep *)SinkBuffer(Sink, IMAGEIO_BUFFER_ROW,
+            sizeof(png_bytep)*PngHeight)))
+            goto Catch;
 
-    for(Row = 0; Row < PngHeight; Row++)
-        RowPointers[Row] = (png_bytep)(*Image + PngWidth*Row);
+        for(Row = 0; Row < PngHeight; Row++)
+            RowPointers[Row] = (png_bytep)SinkRow(Sink, (int)Row);
+        
+        /* Read the image data */
+        png_read_image(Png, RowPointers);
+        SinkRelease(Sink, RowPointers);
+    }
     
-    /* Read the image data */
-    png_read_image(Png, RowPointers);
-    Free(RowPointers);
     png_destroy_read_struct(&Png, &Info, (png_infopp)NULL);
     return 1;
     
 Catch:
-    if(*Image)
-        Free(*Image);
-    
-    *Width = *Height = 0;
+    SinkFree(Sink);
     png_destroy_read_struct(&Png, &Info, (png_infopp)NULL);
     return 0;
 }
@@ -1388,24 +1688,19 @@ Catch:
 /**
 * @brief Read a TIFF (Tagged Information File Format) image file as RGBA data
 *
-* @param Image, Width, Height pointers to be filled with the pointer
-*        to the image data and the image dimensions.
-* @param File stdio FILE pointer pointing to the beginning of the PNG file
+* @param Sink the sink receiving the image
+* @param FileName the file name, opened by libtiff
+* @param Directory which image of the file to read
 *
 * @return 1 on success, 0 on failure
 *
-* This function is called by \c ReadImage to read TIFF images.  Before calling
-* \c ReadTiff, the caller should open \c File as a FILE pointer in binary read
-* mode.  When \c ReadTiff is complete, the caller should close \c File.
+* This function is called by \c ReadImage to read TIFF images.  The whole
+* image is decoded as RGBA and converted to the requested format afterwards.
 */
-static int ReadTiff(uint32_t **Image, int *Width, int *Height,
-    const char *FileName, unsigned Directory)
+static int ReadTiff(imagesink *Sink, const char *FileName, unsigned Directory)
 {
     TIFF *Tiff;
     uint32 ImageWidth, ImageHeight;
-
-    *Image = 0;
-    *Width = *Height = 0;
     
     if(!(Tiff = TIFFOpen(FileName, "r")))
     {
@@ -1416,30 +1711,26 @@ static int ReadTiff(uint32_t **Image, int *Width, int *Height,
     TIFFSetDirectory(Tiff, Directory);
     TIFFGetField(Tiff, TIFFTAG_IMAGEWIDTH, &ImageWidth);
     TIFFGetField(Tiff, TIFFTAG_IMAGELENGTH, &ImageHeight);
-    *Width = (int)ImageWidth;
-    *Height = (int)ImageHeight;
     
-    if(*Width > MAX_IMAGE_SIZE || *Height > MAX_IMAGE_SIZE)
+    if(ImageWidth > MAX_IMAGE_SIZE || ImageHeight > MAX_IMAGE_SIZE)
     {
         ErrorMessage("Image dimensions exceed MAX_IMAGE_SIZE.\n");
         goto Catch;
     }
     
-    if(!(*Image = (uint32_t *)Malloc(sizeof(uint32_t)*ImageWidth*ImageHeight)))
+    if(!SinkAlloc(Sink, (int)ImageWidth, (int)ImageHeight, 0))
         goto Catch;
     
     if(!TIFFReadRGBAImageOriented(Tiff, ImageWidth, ImageHeight,
-        (uint32 *)*Image, ORIENTATION_TOPLEFT, 1))
+        (uint32 *)Sink->Rgba, ORIENTATION_TOPLEFT, 1))
         goto Catch;
     
     TIFFClose(Tiff);
     return 1;
     
 Catch:
-    if(*Image)
-        Free(*Image);
-    
-    *Width = *Height = 0;
+    SinkFree(Sink);
+    Sink->Width = Sink->Height = 0;
     TIFFClose(Tiff);
     return 0;
 }
@@ -1504,9 +1795,283 @@ static int WriteTiff(const uint32_t *Image, int Width, int Height,
 #endif /* USE_LIBTIFF */
 
 
-/** @brief Convert from RGBA U8 to a specified format */
-static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
-    unsigned Format)
+#ifdef IMAGEIO_SIMD
+/* AVX2 kernels, 8 floats at a time */
+#define KERNEL_NAME(Name)   Name##Avx2F
+#define KERNEL_TARGET       __attribute__((target("avx2")))
+#define VTYPE               float
+#define VLITERAL(x)         x##f
+#define VNUM                __m256
+#define VWIDTH              8
+#define VLOAD               _mm256_loadu_ps
+#define VSTORE              _mm256_storeu_ps
+#define VSET1               _mm256_set1_ps
+#define VADD                _mm256_add_ps
+#define VMUL                _mm256_mul_ps
+#define VDIV                _mm256_div_ps
+#define VMIN                _mm256_min_ps
+#define VMAX                _mm256_max_ps
+#define VFROMINT            _mm256_cvtepi32_ps
+#define VTOINT              _mm256_cvttps_epi32
+#define VPIX                __m256i
+#define VPIXLOAD(p)         _mm256_loadu_si256((const __m256i *)(p))
+#define VPIXSTORE(p,v)      _mm256_storeu_si256((__m256i *)(p), v)
+#define VPIXSET1            _mm256_set1_epi32
+#define VPIXAND             _mm256_and_si256
+#define VPIXOR              _mm256_or_si256
+#define VPIXSRL             _mm256_srl_epi32
+#define VPIXSLL             _mm256_sll_epi32
+#include "imageiosimd.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VTYPE
+#undef VLITERAL
+#undef VNUM
+#undef VWIDTH
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VMUL
+#undef VDIV
+#undef VMIN
+#undef VMAX
+#undef VFROMINT
+#undef VTOINT
+#undef VPIX
+#undef VPIXLOAD
+#undef VPIXSTORE
+#undef VPIXSET1
+#undef VPIXAND
+#undef VPIXOR
+#undef VPIXSRL
+#undef VPIXSLL
+
+/* AVX2 kernels, 4 doubles at a time */
+#define KERNEL_NAME(Name)   Name##Avx2D
+#define KERNEL_TARGET       __attribute__((target("avx2")))
+#define VTYPE               double
+#define VLITERAL(x)         x
+#define VNUM                __m256d
+#define VWIDTH              4
+#define VLOAD               _mm256_loadu_pd
+#define VSTORE              _mm256_storeu_pd
+#define VSET1               _mm256_set1_pd
+#define VADD                _mm256_add_pd
+#define VMUL                _mm256_mul_pd
+#define VDIV                _mm256_div_pd
+#define VMIN                _mm256_min_pd
+#define VMAX                _mm256_max_pd
+#define VFROMINT            _mm256_cvtepi32_pd
+#define VTOINT              _mm256_cvttpd_epi32
+#define VPIX                __m128i
+#define VPIXLOAD(p)         _mm_loadu_si128((const __m128i *)(p))
+#define VPIXSTORE(p,v)      _mm_storeu_si128((__m128i *)(p), v)
+#define VPIXSET1            _mm_set1_epi32
+#define VPIXAND             _mm_and_si128
+#define VPIXOR              _mm_or_si128
+#define VPIXSRL             _mm_srl_epi32
+#define VPIXSLL             _mm_sll_epi32
+#include "imageiosimd.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VTYPE
+#undef VLITERAL
+#undef VNUM
+#undef VWIDTH
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VMUL
+#undef VDIV
+#undef VMIN
+#undef VMAX
+#undef VFROMINT
+#undef VTOINT
+#undef VPIX
+#undef VPIXLOAD
+#undef VPIXSTORE
+#undef VPIXSET1
+#undef VPIXAND
+#undef VPIXOR
+#undef VPIXSRL
+#undef VPIXSLL
+
+/* SSE4.1 kernels, 4 floats at a time */
+#define KERNEL_NAME(Name)   Name##Sse41F
+#define KERNEL_TARGET       __attribute__((target("sse4.1")))
+#define VTYPE               float
+#define VLITERAL(x)         x##f
+#define VNUM                __m128
+#define VWIDTH              4
+#define VLOAD               _mm_loadu_ps
+#define VSTORE              _mm_storeu_ps
+#define VSET1               _mm_set1_ps
+#define VADD                _mm_add_ps
+#define VMUL                _mm_mul_ps
+#define VDIV                _mm_div_ps
+#define VMIN                _mm_min_ps
+#define VMAX                _mm_max_ps
+#define VFROMINT            _mm_cvtepi32_ps
+#define VTOINT              _mm_cvttps_epi32
+#define VPIX                __m128i
+#define VPIXLOAD(p)         _mm_loadu_si128((const __m128i *)(p))
+#define VPIXSTORE(p,v)      _mm_storeu_si128((__m128i *)(p), v)
+#define VPIXSET1            _mm_set1_epi32
+#define VPIXAND             _mm_and_si128
+#define VPIXOR              _mm_or_si128
+#define VPIXSRL             _mm_srl_epi32
+#define VPIXSLL             _mm_sll_epi32
+#include "imageiosimd.h"
+#undef KERNEL_NAME
+#undef KERNEL_TARGET
+#undef VTYPE
+#undef VLITERAL
+#undef VNUM
+#undef VWIDTH
+#undef VLOAD
+#undef VSTORE
+#undef VSET1
+#undef VADD
+#undef VMUL
+#undef VDIV
+#undef VMIN
+#undef VMAX
+#undef VFROMINT
+#undef VTOINT
+#undef VPIX
+#undef VPIXLOAD
+#undef VPIXSTORE
+#undef VPIXSET1
+#undef VPIXAND
+#undef VPIXOR
+#undef VPIXSRL
+#undef VPIXSLL
+
+/* SSE4.1 kernels, 2 doubles at a time */
+#define KERNEL_NAME(Name)   Name##Sse41D
+#define KERNEL_TARGET       __attribute__((target("sse4.1")))
+#define VTYPE               double
+#define VLITERAL(x)         x
+#define VNUM                __m128d
+#define VWIDTH              2
+#define VLOAD               _mm_loadu_pd
+#define VSTORE              _mm_storeu_pd
+#define VSET1               _mm_set1_pd
+#define VADD                _mm_add_pd
+#define VMUL                _mm_mul_pd
+#define VDIV                _mm_div_pd
+#define VMIN                _mm_min_pd
+#define VMAX                _mm_max_pd
+#define VFROMINT            _mm_cvtepi32_pd
+#define VTOINT              _mm_cvttpd_epi32
+#define VPIX                __m128i
+#define VPIXLOAD(p)         _mm_loadl_epi64((const __m128i *)(p))
+#define VPIXSTORE(p,v)      _mm_storel_epi64((__m128i *)(p), v)
+#define VPIXSET1            _mm_set1_epi32
+#define VPIXAND             _mm_and_si128
+#define VPIXOR              _mm_or_si128
+#define VPIXSRL             _mm_srl_epi32
+#define VPIXSLL             _mm_sll_epi32
+#include "imageiosimd.h"
+#endif /* IMAGEIO_SIMD */
+
+
+/** @brief Vectorized conversion kernels, NULL where not available */
+typedef struct
+{
+    int (*RgbaToPlanesF)(float *, float *, float *,
+        const uint32_t *, int, const int *);
+    int (*RgbaToPlanesD)(double *, double *, double *,
+        const uint32_t *, int, const int *);
+    int (*RgbaToGrayF)(float *, const uint32_t *, int);
+    int (*RgbaToGrayD)(double *, const uint32_t *, int);
+    int (*PlanesToRgbaF)(uint32_t *, const float *, const float *,
+        const float *, int, const int *);
+    int (*PlanesToRgbaD)(uint32_t *, const double *, const double *,
+        const double *, int, const int *);
+} convertkernels;
+
+
+/**
+ * @brief Select the conversion kernels for the CPU
+ * @param Kernels the kernels to set
+ * @param PixelStride distance between consecutive pixels of a row
+ *
+ * The kernels are selected for the instruction sets supported by the CPU.
+ * They only handle consecutive pixels, so they are all set to NULL if
+ * PixelStride is not 1 and the caller then uses the scalar code.
+ */
+static void SelectConvertKernels(convertkernels *Kernels, int PixelStride)
+{
+#ifdef IMAGEIO_SIMD
+    unsigned Features = (PixelStride == 1) ? CpuFeatures() : 0;
+    
+    if(Features & CPU_AVX2)
+    {
+        Kernels->RgbaToPlanesF = RgbaToPlanesAvx2F;
+        Kernels->RgbaToPlanesD = RgbaToPlanesAvx2D;
+        Kernels->RgbaToGrayF = RgbaToGrayAvx2F;
+        Kernels->RgbaToGrayD = RgbaToGrayAvx2D;
+        Kernels->PlanesToRgbaF = PlanesToRgbaAvx2F;
+        Kernels->PlanesToRgbaD = PlanesToRgbaAvx2D;
+        return;
+    }
+    else if(Features & CPU_SSE41)
+    {
+        Kernels->RgbaToPlanesF = RgbaToPlanesSse41F;
+        Kernels->RgbaToPlanesD = RgbaToPlanesSse41D;
+        Kernels->RgbaToGrayF = RgbaToGraySse41F;
+        Kernels->RgbaToGrayD = RgbaToGraySse41D;
+        Kernels->PlanesToRgbaF = PlanesToRgbaSse41F;
+        Kernels->PlanesToRgbaD = PlanesToRgbaSse41D;
+        return;
+    }
+#else
+    (void)PixelStride;
+#endif
+
+    Kernels->RgbaToPlanesF = NULL;
+    Kernels->RgbaToPlanesD = NULL;
+    Kernels->RgbaToGrayF = NULL;
+    Kernels->RgbaToGrayD = NULL;
+    Kernels->PlanesToRgbaF = NULL;
+    Kernels->PlanesToRgbaD = NULL;
+}
+
+
+/** @brief Size in bytes of a Width x Height image in a specified format */
+static size_t FormatSize(int Width, int Height, unsigned Format)
+{
+    const size_t NumPixels = ((size_t)Width)*((size_t)Height);
+    const size_t NumChannels = (Format & IMAGEIO_GRAYSCALE) ?
+        1 : ((Format & IMAGEIO_STRIP_ALPHA) ? 3 : 4);
+    
+    switch(Format & (IMAGEIO_U8 | IMAGEIO_SINGLE | IMAGEIO_DOUBLE))
+    {
+    case IMAGEIO_U8:
+        return sizeof(uint8_t)*NumChannels*NumPixels;
+    case IMAGEIO_SINGLE:
+        return sizeof(float)*NumChannels*NumPixels;
+    case IMAGEIO_DOUBLE:
+        return sizeof(double)*NumChannels*NumPixels;
+    default:
+        return 0;
+    }
+}
+
+
+/**
+ * @brief Convert rows of RGBA U8 to a specified format
+ * @param Dest destination image of size Width x Height in the format
+ * @param Src RGBA U8 data of rows y0 to y0 + NumRows - 1
+ *
+ * Only the destination elements of the given rows are written, so that an
+ * image can be converted by parts as it is decoded.
+ */
+static void ConvertRowsToFormat(void *Dest, const uint32_t *Src,
+    int Width, int Height, int y0, int NumRows, unsigned Format)
 {
     const int NumPixels = Width*Height;
     const int NumChannels = (Format & IMAGEIO_GRAYSCALE) ?
@@ -1514,9 +2079,10 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
     const int ChannelStride = (Format & IMAGEIO_PLANAR) ? NumPixels : 1;
     const int ChannelStride2 = 2*ChannelStride;
     const int ChannelStride3 = 3*ChannelStride;
-    double *DestD;
-    float *DestF;
-    uint8_t *DestU8;
+    double *DestD = (double *)Dest;
+    float *DestF = (float *)Dest;
+    uint8_t *DestU8 = (uint8_t *)Dest;
+    convertkernels Kernels;
     uint32_t Pixel;
     int Order[4] = {0, 1, 2, 3};
     int i, x, y, PixelStride, RowStride;
@@ -1532,6 +2098,8 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
     else
         RowStride = Width*PixelStride;
     
+    SelectConvertKernels(&Kernels, PixelStride);
+    
     if(Format & IMAGEIO_BGRFLIP)
     {
         Order[0] = 2;
@@ -1549,13 +2117,10 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
     switch(Format & (IMAGEIO_U8 | IMAGEIO_SINGLE | IMAGEIO_DOUBLE))
     {
     case IMAGEIO_U8:  /* Destination type is uint8_t */
-        if(!(DestU8  = (uint8_t *)Malloc(sizeof(uint8_t)*NumChannels*NumPixels)))
-            return NULL;
-        
         switch(NumChannels)
         {
         case 1: /* Convert RGBA U8 to grayscale U8 */
-            for(y = 0; y < Height; y++, Src += Width)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
                 for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
@@ -1565,7 +2130,7 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
                 }
             break;
         case 3: /* Convert RGBA U8 to RGB (or BGR) U8 */
-            for(y = 0; y < Height; y++, Src += Width)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
                 for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
@@ -1575,7 +2140,7 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
                 }
             break;
         case 4: /* Convert RGBA U8 to RGBA (or BGRA, ARGB, or ABGR) U8 */
-            for(y = 0; y < Height; y++, Src += Width)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
                 for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
@@ -1586,35 +2151,45 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
                 }
             break;
         }
-        return DestU8;
+        break;
     case IMAGEIO_SINGLE:  /* Destination type is float */
-        if(!(DestF = (float *)Malloc(sizeof(float)*NumChannels*NumPixels)))
-            return NULL;
-        
         switch(NumChannels)
         {
         case 1: /* Convert RGBA U8 to grayscale float */
-            for(y = 0; y < Height; y++, Src += Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
+            {
+                i = RowStride*y;
+                x = (Kernels.RgbaToGrayF) ?
+                    Kernels.RgbaToGrayF(DestF + i, Src, Width) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
                     DestF[i] = 1.172549019607843070675535e-3f*((uint8_t *)&Pixel)[0]
                         + 2.301960784313725357840079e-3f*((uint8_t *)&Pixel)[1]
                         + 4.470588235294117808150007e-4f*((uint8_t *)&Pixel)[2];
                 }
+            }
             break;
         case 3: /* Convert RGBA U8 to RGB (or BGR) float */
-            for(y = 0; y < Height; y++, Src += Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
+            {
+                i = RowStride*y;
+                x = (Kernels.RgbaToPlanesF) ? Kernels.RgbaToPlanesF(DestF + i,
+                    DestF + i + ChannelStride, DestF + i + ChannelStride2,
+                    Src, Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
                     DestF[i] = ((uint8_t *)&Pixel)[Order[0]]/255.0f;
                     DestF[i + ChannelStride] = ((uint8_t *)&Pixel)[Order[1]]/255.0f;
                     DestF[i + ChannelStride2] = ((uint8_t *)&Pixel)[Order[2]]/255.0f;
                 }
+            }
             break;
         case 4: /* Convert RGBA U8 to RGBA (or BGRA, ARGB, or ABGR) float */
-            for(y = 0; y < Height; y++, Src += Width)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
                 for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
@@ -1625,35 +2200,45 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
                 }
             break;
         }
-        return DestF;
+        break;
     case IMAGEIO_DOUBLE:  /* Destination type is double */
-        if(!(DestD = (double *)Malloc(sizeof(double)*NumChannels*NumPixels)))
-            return NULL;
-        
         switch(NumChannels)
         {
         case 1: /* Convert RGBA U8 to grayscale double */
-            for(y = 0; y < Height; y++, Src += Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
+            {
+                i = RowStride*y;
+                x = (Kernels.RgbaToGrayD) ?
+                    Kernels.RgbaToGrayD(DestD + i, Src, Width) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
                     DestD[i] = 1.172549019607843070675535e-3*((uint8_t *)&Pixel)[0]
                         + 2.301960784313725357840079e-3*((uint8_t *)&Pixel)[1]
                         + 4.470588235294117808150007e-4*((uint8_t *)&Pixel)[2];
                 }
+            }
             break;
         case 3: /* Convert RGBA U8 to RGB (or BGR) double */
-            for(y = 0; y < Height; y++, Src += Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
+            {
+                i = RowStride*y;
+                x = (Kernels.RgbaToPlanesD) ? Kernels.RgbaToPlanesD(DestD + i,
+                    DestD + i + ChannelStride, DestD + i + ChannelStride2,
+                    Src, Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
                     DestD[i] = ((uint8_t *)&Pixel)[Order[0]]/255.0;
                     DestD[i + ChannelStride] = ((uint8_t *)&Pixel)[Order[1]]/255.0;
                     DestD[i + ChannelStride2] = ((uint8_t *)&Pixel)[Order[2]]/255.0;
                 }
+            }
             break;
         case 4: /* Convert RGBA U8 to RGBA (or BGRA, ARGB, or ABGR) double */
-            for(y = 0; y < Height; y++, Src += Width)
+            for(y = y0; y < y0 + NumRows; y++, Src += Width)
                 for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
                 {
                     Pixel = Src[x];
@@ -1664,9 +2249,7 @@ static void *ConvertToFormat(uint32_t *Src, int Width, int Height,
                 }
             break;
         }
-        return DestD;
-    default:
-        return NULL;
+        break;
     }
 }
 
@@ -1685,6 +2268,7 @@ static uint32_t *ConvertFromFormat(void *Src, int Width, int Height,
     float *SrcF = (float *)Src;
     uint8_t *SrcU8 = (uint8_t *)Src;
     uint8_t *Dest, *DestPtr;
+    convertkernels Kernels;
     int Order[4] = {0, 1, 2, 3};
     int i, x, y, PixelStride, RowStride;
     
@@ -1703,6 +2287,8 @@ static uint32_t *ConvertFromFormat(void *Src, int Width, int Height,
     else
         RowStride = Width*PixelStride;
     
+    SelectConvertKernels(&Kernels, PixelStride);
+    
     if(Format & IMAGEIO_BGRFLIP)
     {
         Order[0] = 2;
@@ -1759,23 +2345,37 @@ static uint32_t *ConvertFromFormat(void *Src, int Width, int Height,
         {
         case 1: /* Convert grayscale float to RGBA U8 */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            {
+                i = RowStride*y;
+                x = (Kernels.PlanesToRgbaF) ? Kernels.PlanesToRgbaF(
+                    (uint32_t *)DestPtr, SrcF + i, SrcF + i, SrcF + i,
+                    Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     DestPtr[4*x] =
                     DestPtr[4*x + 1] =
                     DestPtr[4*x + 2] = ROUNDCLAMPF(SrcF[i]);
                     DestPtr[4*x + 3] = 255;
                 }
+            }
             break;
         case 3: /* Convert RGBA U8 to RGB (or BGR) float */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            {
+                i = RowStride*y;
+                x = (Kernels.PlanesToRgbaF) ? Kernels.PlanesToRgbaF(
+                    (uint32_t *)DestPtr, SrcF + i, SrcF + i + ChannelStride,
+                    SrcF + i + ChannelStride2, Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     DestPtr[4*x + Order[0]] = ROUNDCLAMPF(SrcF[i]);
                     DestPtr[4*x + Order[1]] = ROUNDCLAMPF(SrcF[i + ChannelStride]);
                     DestPtr[4*x + Order[2]] = ROUNDCLAMPF(SrcF[i + ChannelStride2]);
                     DestPtr[4*x + 3] = 255;
                 }
+            }
             break;
         case 4: /* Convert RGBA U8 to RGBA (or BGRA, ARGB, or ABGR) float */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
@@ -1794,23 +2394,37 @@ static uint32_t *ConvertFromFormat(void *Src, int Width, int Height,
         {
         case 1: /* Convert grayscale double to RGBA U8 */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            {
+                i = RowStride*y;
+                x = (Kernels.PlanesToRgbaD) ? Kernels.PlanesToRgbaD(
+                    (uint32_t *)DestPtr, SrcD + i, SrcD + i, SrcD + i,
+                    Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     DestPtr[4*x] =
                     DestPtr[4*x + 1] =
                     DestPtr[4*x + 2] = ROUNDCLAMP(SrcD[i]);
                     DestPtr[4*x + 3] = 255;
                 }
+            }
             break;
         case 3: /* Convert RGB (or BGR) double to RGBA U8 */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
-                for(x = 0, i = RowStride*y; x < Width; x++, i += PixelStride)
+            {
+                i = RowStride*y;
+                x = (Kernels.PlanesToRgbaD) ? Kernels.PlanesToRgbaD(
+                    (uint32_t *)DestPtr, SrcD + i, SrcD + i + ChannelStride,
+                    SrcD + i + ChannelStride2, Width, Order) : 0;
+                
+                for(i += x; x < Width; x++, i += PixelStride)
                 {
                     DestPtr[4*x + Order[0]] = ROUNDCLAMP(SrcD[i]);
                     DestPtr[4*x + Order[1]] = ROUNDCLAMP(SrcD[i + ChannelStride]);
                     DestPtr[4*x + Order[2]] = ROUNDCLAMP(SrcD[i + ChannelStride2]);
                     DestPtr[4*x + 3] = 255;;
                 }
+            }
             break;
         case 4: /* Convert RGBA (or BGRA, ARGB, or ABGR) double to RGBA U8 */
             for(y = 0; y < Height; y++, DestPtr += 4*Width)
@@ -1928,6 +2542,19 @@ int IdentifyImageType(char *Type, const char *FileName)
 *  - IMAGEIO_PLANAR:        planar order instead of interleaved components
 *  - IMAGEIO_COLUMNMAJOR:   column major order instead of row major order
 *
+* and optionally one of the reduced size options, which only affect JPEG
+*
+*  - IMAGEIO_SCALE_1_2:     half the width and height
+*  - IMAGEIO_SCALE_1_4:     a quarter of the width and height
+*  - IMAGEIO_SCALE_1_8:     an eighth of the width and height
+*  - IMAGEIO_SCALE_SIDE(n): the smallest of these sizes for which the larger
+*                           side is at least n pixels
+*
+* With these options, libjpeg computes the reduced image directly in the
+* inverse DCT, which is several times faster than decoding at full size.  The
+* reduced dimensions are rounded up, for instance ceil(Width/4).  Other formats
+* are always read at full size.
+*
 @code
     uint32_t *Image;
     int Width, Height;
@@ -1973,12 +2600,72 @@ int IdentifyImageType(char *Type, const char *FileName)
 void *ReadImage(int *Width, int *Height,
     const char *FileName, unsigned Format)
 {
-    void *Image = NULL;
-    uint32_t *ImageU8 = NULL;
+    return ReadImageDetectColor(Width, Height, NULL, FileName, Format);
+}
+
+
+/**
+* @brief Read an image file and detect whether it is grayscale
+*
+* @param Width, Height pointers to be filled with the image dimensions
+* @param UseColor if not NULL, set to 1 if any pixel has different red, green,
+*        and blue components and to 0 if the image is grayscale
+* @param FileName the image file name
+* @param Format specifies the desired format for the image (see ReadImage)
+*
+* @return Pointer to the image data, or null on failure
+*
+* The result is the same as with \c ReadImage.  For BMP, JPEG, and
+* noninterlaced PNG images, the rows are converted to \c Format as they are
+* decoded, so that no RGBA copy of the whole image is made.  The grayscale
+* detection is done on the RGBA data along the way, so that the caller does
+* not need another pass over the converted image.
+*/
+void *ReadImageDetectColor(int *Width, int *Height, int *UseColor,
+    const char *FileName, unsigned Format)
+{
+    return ReadImageBuffered(Width, Height, UseColor, FileName, Format,
+        NULL, NULL);
+}
+
+
+/**
+* @brief Read an image file into buffers provided by the caller
+*
+* @param Width, Height, UseColor, FileName, Format as for
+*        \c ReadImageDetectColor
+* @param GetBuffer function providing the buffers, or NULL to use Malloc
+* @param BufferParam parameter passed to \c GetBuffer
+*
+* @return Pointer to the image data, or null on failure
+*
+* Instead of allocating memory, the reader calls \c GetBuffer(BufferParam,
+* Buffer, Size) for each buffer it needs, where \c Buffer is
+*
+*  - IMAGEIO_BUFFER_IMAGE:  the image in the requested format, which is
+*                           returned
+*  - IMAGEIO_BUFFER_RGBA:   RGBA U8 data of a row or of the whole image
+*  - IMAGEIO_BUFFER_ROW:    file data of a row, or the row pointers of an
+*                           interlaced PNG image
+*
+* and \c Size is the size in bytes.  Each buffer is requested at most once,
+* and the returned image must not be freed.  A caller that keeps the buffers
+* across calls, growing them as needed, reads a sequence of images with no
+* allocation for the image data.  libjpeg and libpng still allocate their
+* own decoder state.
+*/
+void *ReadImageBuffered(int *Width, int *Height, int *UseColor,
+    const char *FileName, unsigned Format,
+    imagebufferfun GetBuffer, void *BufferParam)
+{
+    imagesink Sink;
+    void *Image;
     FILE *File;
     char Type[8];
     
     
+    *Width = *Height = 0;
+    SinkInit(&Sink, Format, GetBuffer, BufferParam);
     IdentifyImageType(Type, FileName);
     
     if(!(File = fopen(FileName, "rb")))
@@ -1989,13 +2676,13 @@ void *ReadImage(int *Width, int *Height,
     
     if(!strcmp(Type, "BMP"))
     {
-        if(!ReadBmp(&ImageU8, Width, Height, File))
+        if(!ReadBmp(&Sink, File))
             ErrorMessage("Failed to read \"%s\".\n", FileName);
     }
     else if(!strcmp(Type, "JPEG"))
     {
 #ifdef USE_LIBJPEG
-        if(!(ReadJpeg(&ImageU8, Width, Height, File)))
+        if(!(ReadJpeg(&Sink, File)))
             ErrorMessage("Failed to read \"%s\".\n", FileName);
 #else
         ErrorMessage("File \"%s\" is a JPEG image.\n"
@@ -2006,7 +2693,7 @@ void *ReadImage(int *Width, int *Height,
     else if(!strcmp(Type, "PNG"))
     {
 #ifdef USE_LIBPNG
-        if(!(ReadPng(&ImageU8, Width, Height, File)))
+        if(!(ReadPng(&Sink, File)))
             ErrorMessage("Failed to read \"%s\".\n", FileName);
 #else
         ErrorMessage("File \"%s\" is a PNG image.\n"
@@ -2019,7 +2706,7 @@ void *ReadImage(int *Width, int *Height,
 #ifdef USE_LIBTIFF
         fclose(File);
         
-        if(!(ReadTiff(&ImageU8, Width, Height, FileName, 0)))
+        if(!(ReadTiff(&Sink, FileName, 0)))
             ErrorMessage("Failed to read \"%s\".\n", FileName);
         
         File = NULL;
@@ -2042,13 +2729,14 @@ void *ReadImage(int *Width, int *Height,
     if(File)
         fclose(File);
     
-    if(ImageU8 && Format)
+    if((Image = SinkFinish(&Sink)))
     {
-        Image = ConvertToFormat(ImageU8, *Width, *Height, Format);
-        Free(ImageU8);
+        *Width = Sink.Width;
+        *Height = Sink.Height;
+        
+        if(UseColor)
+            *UseColor = Sink.UseColor;
     }
-    else
-        Image = ImageU8;
     
     return Image;
 }
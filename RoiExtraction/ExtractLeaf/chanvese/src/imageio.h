@@ -60,6 +60,17 @@
 #define IMAGEIO_BGRA          (IMAGEIO_BGRFLIP)
 #define IMAGEIO_ARGB          (IMAGEIO_AFLIP)
 #define IMAGEIO_ABGR          (IMAGEIO_BGRFLIP | IMAGEIO_AFLIP)
+#define IMAGEIO_SCALE_1_2     0x1000
+#define IMAGEIO_SCALE_1_4     0x2000
+#define IMAGEIO_SCALE_1_8     0x3000
+#define IMAGEIO_SCALE_MASK    0x3000
+#define IMAGEIO_SCALE_SIDE(Side)  (((unsigned)(Side) & 0x3FFF) << 16)
+#define IMAGEIO_SCALE_SIDE_MASK   0x3FFF0000
+
+/* Buffers requested by ReadImageBuffered */
+#define IMAGEIO_BUFFER_IMAGE  0
+#define IMAGEIO_BUFFER_RGBA   1
+#define IMAGEIO_BUFFER_ROW    2
 
 #endif /* DOXYGEN */
 
@@ -84,11 +95,21 @@
 #define _CRT_SECURE_NO_WARNINGS
 #endif
 
+/** @brief Function providing a buffer of Size bytes to ReadImageBuffered */
+typedef void *(*imagebufferfun)(void *Param, int Buffer, size_t Size);
+
 int IdentifyImageType(char *Type, const char *FileName);
 
 void *ReadImage(int *Width, int *Height,
     const char *FileName, unsigned Format);
 
+void *ReadImageDetectColor(int *Width, int *Height, int *UseColor,
+    const char *FileName, unsigned Format);
+
+void *ReadImageBuffered(int *Width, int *Height, int *UseColor,
+    const char *FileName, unsigned Format,
+    imagebufferfun GetBuffer, void *BufferParam);
+
 int WriteImage(void *Image, int Width, int Height,
     const char *FileName, unsigned Format, int Quality);
     
@@ -0,0 +1,138 @@
+/**
+ * @file imageiosimd.h
+ * @brief Vectorized pixel format conversions
+ *
+ * This file is not a normal header.  It is included by imageio.c once for
+ * each supported instruction set and floating-point type to define the
+ * conversion kernels, with the following macros defined before each
+ * inclusion:
+ *
+ * @li KERNEL_NAME(Name)  name of the kernel Name for this inclusion
+ * @li KERNEL_TARGET      function attribute selecting the instruction set
+ * @li VTYPE              the floating-point type, float or double
+ * @li VLITERAL(x)        floating-point literal x of type VTYPE
+ * @li VNUM, VWIDTH       vector type holding VWIDTH VTYPE elements
+ * @li VLOAD, VSTORE      unaligned load and store
+ * @li VSET1              broadcast a scalar to all elements
+ * @li VADD, VMUL, VDIV, VMIN, VMAX  elementwise arithmetic
+ * @li VFROMINT, VTOINT   conversion from and to 32-bit integers, VTOINT
+ *                        truncates toward zero like a C cast
+ * @li VPIX               integer vector type holding VWIDTH 32-bit pixels
+ * @li VPIXLOAD, VPIXSTORE  unaligned load and store of VWIDTH pixels
+ * @li VPIXSET1, VPIXAND, VPIXOR  integer broadcast, and, or
+ * @li VPIXSRL, VPIXSLL   shifts of 32-bit integers by a count in a __m128i
+ *
+ * Each kernel converts the first pixels of a row, a multiple of VWIDTH, and
+ * returns how many pixels it converted.  The caller should convert the
+ * remaining pixels with the scalar code.  The kernels perform the same
+ * operations in the same order as the scalar code, so the results are
+ * bit-identical.
+ */
+
+/**
+ * @brief Convert RGBA U8 pixels to three planes with values in [0,1]
+ * @param Dest0, Dest1, Dest2 destination planes
+ * @param Src RGBA U8 pixels
+ * @param Width number of pixels
+ * @param Order Destk receives component Order[k] of each pixel
+ * @return the number of pixels converted
+ */
+static KERNEL_TARGET int KERNEL_NAME(RgbaToPlanes)(VTYPE *Dest0,
+    VTYPE *Dest1, VTYPE *Dest2, const uint32_t *Src, int Width,
+    const int *Order)
+{
+    const VNUM Scale = VSET1(VLITERAL(255.0));
+    const VPIX Mask = VPIXSET1(0xFF);
+    const __m128i Shift0 = _mm_cvtsi32_si128(8*Order[0]);
+    const __m128i Shift1 = _mm_cvtsi32_si128(8*Order[1]);
+    const __m128i Shift2 = _mm_cvtsi32_si128(8*Order[2]);
+    VPIX Pixel;
+    int x;
+    
+    for(x = 0; x + VWIDTH <= Width; x += VWIDTH)
+    {
+        Pixel = VPIXLOAD(Src + x);
+        VSTORE(Dest0 + x, VDIV(VFROMINT(
+            VPIXAND(VPIXSRL(Pixel, Shift0), Mask)), Scale));
+        VSTORE(Dest1 + x, VDIV(VFROMINT(
+            VPIXAND(VPIXSRL(Pixel, Shift1), Mask)), Scale));
+        VSTORE(Dest2 + x, VDIV(VFROMINT(
+            VPIXAND(VPIXSRL(Pixel, Shift2), Mask)), Scale));
+    }
+    
+    return x;
+}
+
+
+/**
+ * @brief Convert RGBA U8 pixels to grayscale with values in [0,1]
+ * @param Dest destination
+ * @param Src RGBA U8 pixels
+ * @param Width number of pixels
+ * @return the number of pixels converted
+ */
+static KERNEL_TARGET int KERNEL_NAME(RgbaToGray)(VTYPE *Dest,
+    const uint32_t *Src, int Width)
+{
+    const VNUM WeightR = VSET1(VLITERAL(1.172549019607843070675535e-3));
+    const VNUM WeightG = VSET1(VLITERAL(2.301960784313725357840079e-3));
+    const VNUM WeightB = VSET1(VLITERAL(4.470588235294117808150007e-4));
+    const VPIX Mask = VPIXSET1(0xFF);
+    const __m128i Shift8 = _mm_cvtsi32_si128(8);
+    const __m128i Shift16 = _mm_cvtsi32_si128(16);
+    VPIX Pixel;
+    int x;
+    
+    for(x = 0; x + VWIDTH <= Width; x += VWIDTH)
+    {
+        Pixel = VPIXLOAD(Src + x);
+        VSTORE(Dest + x, VADD(VADD(
+            VMUL(WeightR, VFROMINT(VPIXAND(Pixel, Mask))),
+            VMUL(WeightG, VFROMINT(VPIXAND(VPIXSRL(Pixel, Shift8), Mask)))),
+            VMUL(WeightB, VFROMINT(VPIXAND(VPIXSRL(Pixel, Shift16), Mask)))));
+    }
+    
+    return x;
+}
+
+
+/**
+ * @brief Convert three planes with values in [0,1] to RGBA U8 pixels
+ * @param Dest destination RGBA U8 pixels
+ * @param Src0, Src1, Src2 source planes, the same plane for grayscale
+ * @param Width number of pixels
+ * @param Order Srck is stored in component Order[k] of each pixel
+ * @return the number of pixels converted
+ *
+ * The values are rounded and clamped as with ROUNDCLAMPF and ROUNDCLAMP.
+ * Clamping the value to [0,1] before rounding gives the same result as
+ * clamping after.  The operands of VMIN and VMAX are ordered so that NaN
+ * becomes 0 as with the scalar conversion on x86.  The alpha component is
+ * set to 255.
+ */
+static KERNEL_TARGET int KERNEL_NAME(PlanesToRgba)(uint32_t *Dest,
+    const VTYPE *Src0, const VTYPE *Src1, const VTYPE *Src2, int Width,
+    const int *Order)
+{
+    const VNUM Zero = VSET1(VLITERAL(0.0)), One = VSET1(VLITERAL(1.0));
+    const VNUM Scale = VSET1(VLITERAL(255.0)), Half = VSET1(VLITERAL(0.5));
+    const VPIX Alpha = VPIXSLL(VPIXSET1(0xFF), _mm_cvtsi32_si128(24));
+    const __m128i Shift0 = _mm_cvtsi32_si128(8*Order[0]);
+    const __m128i Shift1 = _mm_cvtsi32_si128(8*Order[1]);
+    const __m128i Shift2 = _mm_cvtsi32_si128(8*Order[2]);
+    VPIX Pixel;
+    int x;
+    
+    for(x = 0; x + VWIDTH <= Width; x += VWIDTH)
+    {
+        Pixel = VPIXOR(Alpha, VPIXSLL(VTOINT(VADD(VMUL(Scale,
+            VMAX(VMIN(One, VLOAD(Src0 + x)), Zero)), Half)), Shift0));
+        Pixel = VPIXOR(Pixel, VPIXSLL(VTOINT(VADD(VMUL(Scale,
+            VMAX(VMIN(One, VLOAD(Src1 + x)), Zero)), Half)), Shift1));
+        Pixel = VPIXOR(Pixel, VPIXSLL(VTOINT(VADD(VMUL(Scale,
+            VMAX(VMIN(One, VLOAD(Src2 + x)), Zero)), Half)), Shift2));
+        VPIXSTORE(Dest + x, Pixel);
+    }
+    
+    return x;
+}
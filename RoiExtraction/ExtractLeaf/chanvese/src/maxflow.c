@@ -0,0 +1,501 @@
+/**
+ * @file maxflow.c
+ * @brief Boykov-Kolmogorov max-flow on a 4- or 8-connected pixel grid
+ *
+ * This file implements the augmenting path algorithm of Boykov and
+ * Kolmogorov for graphs whose nodes are the pixels of an image, with edges
+ * between neighboring pixels and edges from the source and to the sink.
+ * Two search trees, rooted at the source and at the sink, are grown and
+ * reused between augmentations, which makes the algorithm much faster than
+ * general purpose max-flow algorithms on the short paths of grid graphs.
+ *
+ * Y. Boykov and V. Kolmogorov, "An experimental comparison of
+ * min-cut/max-flow algorithms for energy minimization in vision," IEEE
+ * Transactions on Pattern Analysis and Machine Intelligence, 26(9),
+ * pp. 1124-1137, 2004.
+ *
+ * The graph is stored implicitly: node n is pixel n in row-major order,
+ * and edge k of node n goes to the neighbor n + Offset[k].  Edges come in
+ * opposite pairs k and k^1, so the reverse of edge k of node n is edge k^1
+ * of its neighbor.
+ */
+
+#include <stdlib.h>
+
+#include "basic.h"
+#include "maxflow.h"
+
+/** @brief Maximum number of neighbors */
+#define MF_MAX_EDGES    8
+/** @brief Parent of a node not in either tree */
+#define MF_FREE         -1
+/** @brief Parent of a node connected directly to the terminal of its tree */
+#define MF_TERMINAL     MF_MAX_EDGES
+/** @brief Parent of a node whose parent edge was saturated */
+#define MF_ORPHAN       (MF_MAX_EDGES + 1)
+/** @brief Next of a node not in the active queue */
+#define MF_INACTIVE     -1
+/** @brief Distance to the terminal for an invalid path */
+#define MF_INFINITE_D   0x7FFFFFFF
+
+
+/** @brief Grid graph and search trees */
+struct maxflowstruct
+{
+    /** @brief Residual capacity of edge k of node n is Cap[NumEdges*n + k] */
+    num *Cap;
+    /** @brief Residual terminal capacity, > 0 from source, < 0 to sink */
+    num *TrCap;
+    /** @brief Parent edge, MF_FREE, MF_TERMINAL, or MF_ORPHAN */
+    signed char *Parent;
+    /** @brief Nonzero for nodes in the sink tree */
+    unsigned char *IsSink;
+    /** @brief Bit k is set if node n has a neighbor in direction k */
+    unsigned char *Valid;
+    /** @brief Time stamp and distance to the terminal, see ProcessOrphan */
+    int *Ts;
+    int *Dist;
+    /** @brief Links of the active queue, a node points to itself at the end */
+    long *Next;
+    long QueueFirst;
+    long QueueLast;
+    /** @brief Circular queue of orphans */
+    long *Orphan;
+    long OrphanFirst;
+    long NumOrphans;
+    /** @brief Capacity of each edge direction */
+    num Weight[MF_MAX_EDGES];
+    long Offset[MF_MAX_EDGES];
+    long NumPixels;
+    int NumEdges;
+    int Time;
+};
+
+
+/**
+ * @brief Allocate a grid graph
+ * @param Width, Height the image dimensions
+ * @param Connectivity 4 or 8
+ * @param AxisWeight capacity of the horizontal and vertical edges
+ * @param DiagWeight capacity of the diagonal edges (8-connectivity only)
+ * @param Ws workspace the memory is allocated from
+ * @return the graph, or NULL on failure
+ *
+ * The memory is returned to Ws by the caller's WorkspaceRelease.
+ */
+maxflow *MaxflowNew(int Width, int Height, int Connectivity,
+    num AxisWeight, num DiagWeight, workspace *Ws)
+{
+    /* Edge directions, in opposite pairs */
+    static const int dx[MF_MAX_EDGES] = {1, -1, 0, 0, 1, -1, 1, -1};
+    static const int dy[MF_MAX_EDGES] = {0, 0, 1, -1, 1, -1, -1, 1};
+    const long NumPixels = ((long)Width) * ((long)Height);
+    maxflow *Graph;
+    long n;
+    int i, j, k;
+    
+    if(Width <= 0 || Height <= 0 || (Connectivity != 4 && Connectivity != 8)
+        || !(Graph = (maxflow *)WorkspaceAlloc(Ws,
+            sizeof(struct maxflowstruct))))
+        return NULL;
+    
+    Graph->NumEdges = Connectivity;
+    Graph->NumPixels = NumPixels;
+    
+    if(!(Graph->Cap = (num *)WorkspaceAlloc(Ws,
+            sizeof(num)*NumPixels*Connectivity))
+        || !(Graph->TrCap = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Graph->Parent = (signed char *)WorkspaceAlloc(Ws, NumPixels))
+        || !(Graph->IsSink = (unsigned char *)WorkspaceAlloc(Ws, NumPixels))
+        || !(Graph->Valid = (unsigned char *)WorkspaceAlloc(Ws, NumPixels))
+        || !(Graph->Ts = (int *)WorkspaceAlloc(Ws, sizeof(int)*NumPixels))
+        || !(Graph->Dist = (int *)WorkspaceAlloc(Ws, sizeof(int)*NumPixels))
+        || !(Graph->Next = (long *)WorkspaceAlloc(Ws,
+            sizeof(long)*NumPixels))
+        || !(Graph->Orphan = (long *)WorkspaceAlloc(Ws,
+            sizeof(long)*NumPixels)))
+        return NULL;
+    
+    for(k = 0; k < Connectivity; k++)
+    {
+        Graph->Weight[k] = (k < 4) ? AxisWeight : DiagWeight;
+        Graph->Offset[k] = dx[k] + ((long)Width)*dy[k];
+    }
+    
+    for(j = 0, n = 0; j < Height; j++)
+        for(i = 0; i < Width; i++, n++)
+        {
+            Graph->Valid[n] = 0;
+            
+            for(k = 0; k < Connectivity; k++)
+                if(0 <= i + dx[k] && i + dx[k] < Width
+                    && 0 <= j + dy[k] && j + dy[k] < Height)
+                    Graph->Valid[n] |= 1 << k;
+        }
+    
+    return Graph;
+}
+
+
+/** @brief Add node n to the end of the active queue if it is not in it */
+static void SetActive(maxflow *Graph, long n)
+{
+    if(Graph->Next[n] == MF_INACTIVE)
+    {
+        if(Graph->QueueLast >= 0)
+            Graph->Next[Graph->QueueLast] = n;
+        else
+            Graph->QueueFirst = n;
+        
+        Graph->Next[n] = n;
+        Graph->QueueLast = n;
+    }
+}
+
+
+/** @brief Remove and return the first active node in a tree, or -1 */
+static long NextActive(maxflow *Graph)
+{
+    long n;
+    
+    while((n = Graph->QueueFirst) >= 0)
+    {
+        if(Graph->Next[n] == n)
+            Graph->QueueFirst = Graph->QueueLast = -1;
+        else
+            Graph->QueueFirst = Graph->Next[n];
+        
+        Graph->Next[n] = MF_INACTIVE;
+        
+        if(Graph->Parent[n] != MF_FREE)
+            return n;
+    }
+    
+    return -1;
+}
+
+
+/** @brief Mark node n as an orphan */
+static void SetOrphan(maxflow *Graph, long n)
+{
+    long Index = Graph->OrphanFirst + Graph->NumOrphans;
+    
+    if(Index >= Graph->NumPixels)
+        Index -= Graph->NumPixels;
+    
+    Graph->Parent[n] = MF_ORPHAN;
+    Graph->Orphan[Index] = n;
+    Graph->NumOrphans++;
+}
+
+
+/**
+ * @brief Push flow along the path found between the trees
+ * @param Graph the graph
+ * @param s node in the source tree
+ * @param k edge from s to the node in the sink tree
+ * @return the amount of flow pushed
+ */
+static num Augment(maxflow *Graph, long s, int k)
+{
+    const int NumEdges = Graph->NumEdges;
+    num *Cap = Graph->Cap;
+    const long t = s + Graph->Offset[k];
+    num Bottleneck = Cap[NumEdges*s + k];
+    long n, p;
+    int e;
+    
+    /* Find the bottleneck capacity in the source tree */
+    for(n = s; (e = Graph->Parent[n]) != MF_TERMINAL; n = p)
+    {
+        p = n + Graph->Offset[e];
+        
+        if(Cap[NumEdges*p + (e^1)] < Bottleneck)
+            Bottleneck = Cap[NumEdges*p + (e^1)];
+    }
+    
+    if(Graph->TrCap[n] < Bottleneck)
+        Bottleneck = Graph->TrCap[n];
+    
+    /* and in the sink tree */
+    for(n = t; (e = Graph->Parent[n]) != MF_TERMINAL; n = p)
+    {
+        p = n + Graph->Offset[e];
+        
+        if(Cap[NumEdges*n + e] < Bottleneck)
+            Bottleneck = Cap[NumEdges*n + e];
+    }
+    
+    if(-Graph->TrCap[n] < Bottleneck)
+        Bottleneck = -Graph->TrCap[n];
+    
+    /* Push the flow */
+    Cap[NumEdges*t + (k^1)] += Bottleneck;
+    Cap[NumEdges*s + k] -= Bottleneck;
+    
+    for(n = s; (e = Graph->Parent[n]) != MF_TERMINAL; n = p)
+    {
+        p = n + Graph->Offset[e];
+        Cap[NumEdges*n + e] += Bottleneck;
+        
+        if((Cap[NumEdges*p + (e^1)] -= Bottleneck) <= 0)
+            SetOrphan(Graph, n);
+    }
+    
+    if((Graph->TrCap[n] -= Bottleneck) <= 0)
+        SetOrphan(Graph, n);
+    
+    for(n = t; (e = Graph->Parent[n]) != MF_TERMINAL; n = p)
+    {
+        p = n + Graph->Offset[e];
+        Cap[NumEdges*p + (e^1)] += Bottleneck;
+        
+        if((Cap[NumEdges*n + e] -= Bottleneck) <= 0)
+            SetOrphan(Graph, n);
+    }
+    
+    if((Graph->TrCap[n] += Bottleneck) >= 0)
+        SetOrphan(Graph, n);
+    
+    return Bottleneck;
+}
+
+
+/**
+ * @brief Find a new parent for an orphan, or remove it from its tree
+ * @param Graph the graph
+ * @param n the orphan
+ *
+ * A valid parent is a neighbor in the same tree with residual capacity
+ * toward the orphan (away from it in the sink tree) whose own path leads
+ * to the terminal.  Among the valid parents, the one closest to the
+ * terminal is chosen.  The distances found while checking the paths are
+ * cached with the time stamp Ts so that each path is walked only once per
+ * round of adoptions.
+ */
+static void ProcessOrphan(maxflow *Graph, long n)
+{
+    const int NumEdges = Graph->NumEdges;
+    const int IsSink = Graph->IsSink[n];
+    const num *Cap = Graph->Cap;
+    long m, q;
+    int k, e, d, MinDist = MF_INFINITE_D, MinEdge = MF_FREE;
+    
+    for(k = 0; k < NumEdges; k++)
+    {
+        if(!(Graph->Valid[n] & (1 << k)))
+            continue;
+        
+        m = n + Graph->Offset[k];
+        
+        if(Graph->Parent[m] == MF_FREE || Graph->IsSink[m] != IsSink
+            || (IsSink ? Cap[NumEdges*n + k]
+                : Cap[NumEdges*m + (k^1)]) <= 0)
+            continue;
+        
+        /* Check that m is connected to the terminal */
+        for(q = m, d = 0;; q += Graph->Offset[e])
+        {
+            if(Graph->Ts[q] == Graph->Time)
+            {
+                d += Graph->Dist[q];
+                break;
+            }
+            
+            e = Graph->Parent[q];
+            d++;
+            
+            if(e == MF_TERMINAL)
+            {
+                Graph->Ts[q] = Graph->Time;
+                Graph->Dist[q] = 1;
+                break;
+            }
+            else if(e == MF_ORPHAN)
+            {
+                d = MF_INFINITE_D;
+                break;
+            }
+        }
+        
+        if(d < MF_INFINITE_D)
+        {
+            if(d < MinDist)
+            {
+                MinEdge = k;
+                MinDist = d;
+            }
+            
+            /* Cache the distances along the path */
+            for(q = m; Graph->Ts[q] != Graph->Time;
+                q += Graph->Offset[(int)Graph->Parent[q]])
+            {
+                Graph->Ts[q] = Graph->Time;
+                Graph->Dist[q] = d--;
+            }
+        }
+    }
+    
+    if((Graph->Parent[n] = (signed char)MinEdge) != MF_FREE)
+    {
+        Graph->Ts[n] = Graph->Time;
+        Graph->Dist[n] = MinDist + 1;
+        return;
+    }
+    
+    /* No parent was found, n becomes free and its children orphans */
+    for(k = 0; k < NumEdges; k++)
+    {
+        if(!(Graph->Valid[n] & (1 << k)))
+            continue;
+        
+        m = n + Graph->Offset[k];
+        
+        if(Graph->Parent[m] == MF_FREE || Graph->IsSink[m] != IsSink)
+            continue;
+        
+        if((IsSink ? Cap[NumEdges*n + k] : Cap[NumEdges*m + (k^1)]) > 0)
+            SetActive(Graph, m);
+        
+        if(Graph->Parent[m] == (k^1))
+            SetOrphan(Graph, m);
+    }
+}
+
+
+/**
+ * @brief Compute a minimum cut of the grid graph
+ * @param Graph the graph from MaxflowNew
+ * @param TrCap terminal capacity of each node, TrCap[n] > 0 is the capacity
+ *    of the edge from the source to n and TrCap[n] < 0 is minus the
+ *    capacity of the edge from n to the sink
+ * @param Label set to 1 for the nodes on the source side of the cut and 0
+ *    for the nodes on the sink side
+ * @return the maximum flow, equal to the cut capacity
+ *
+ * The edges between neighbors have the capacities given to MaxflowNew.
+ * Nodes that are not connected to either terminal in the residual graph
+ * are put on the source side.  The graph is reset on each call, so it can
+ * be solved repeatedly with different terminal capacities.
+ */
+double MaxflowSolve(maxflow *Graph, const num *TrCap, unsigned char *Label)
+{
+    const long NumPixels = Graph->NumPixels;
+    const int NumEdges = Graph->NumEdges;
+    num *Cap = Graph->Cap;
+    double Flow = 0;
+    long n, m, Current = -1;
+    int k, Found;
+    
+    Graph->QueueFirst = Graph->QueueLast = -1;
+    Graph->OrphanFirst = Graph->NumOrphans = 0;
+    Graph->Time = 0;
+    
+    for(n = 0; n < NumPixels; n++)
+    {
+        for(k = 0; k < NumEdges; k++)
+            Cap[NumEdges*n + k] = (Graph->Valid[n] & (1 << k)) ?
+                Graph->Weight[k] : 0;
+        
+        Graph->TrCap[n] = TrCap[n];
+        Graph->Next[n] = MF_INACTIVE;
+        Graph->Ts[n] = 0;
+        Graph->Dist[n] = 1;
+        
+        if(TrCap[n] != 0)
+        {
+            Graph->Parent[n] = MF_TERMINAL;
+            Graph->IsSink[n] = (TrCap[n] < 0);
+            SetActive(Graph, n);
+        }
+        else
+        {
+            Graph->Parent[n] = MF_FREE;
+            Graph->IsSink[n] = 0;
+        }
+    }
+    
+    while(1)
+    {
+        /* Continue growing from the current node if it is still in a tree */
+        if((n = Current) >= 0)
+        {
+            Graph->Next[n] = MF_INACTIVE;
+            
+            if(Graph->Parent[n] == MF_FREE)
+                n = -1;
+        }
+        
+        if(n < 0 && (n = NextActive(Graph)) < 0)
+            break;
+        
+        /* Grow the tree of n until it touches the other tree */
+        for(k = 0, Found = 0; k < NumEdges; k++)
+        {
+            if(!(Graph->Valid[n] & (1 << k)))
+                continue;
+            
+            m = n + Graph->Offset[k];
+            
+            if((Graph->IsSink[n] ? Cap[NumEdges*m + (k^1)]
+                : Cap[NumEdges*n + k]) <= 0)
+                continue;
+            
+            if(Graph->Parent[m] == MF_FREE)
+            {
+                Graph->IsSink[m] = Graph->IsSink[n];
+                Graph->Parent[m] = (signed char)(k^1);
+                Graph->Ts[m] = Graph->Ts[n];
+                Graph->Dist[m] = Graph->Dist[n] + 1;
+                SetActive(Graph, m);
+            }
+            else if(Graph->IsSink[m] != Graph->IsSink[n])
+            {
+                Found = 1;
+                break;
+            }
+            else if(Graph->Ts[m] <= Graph->Ts[n]
+                && Graph->Dist[m] > Graph->Dist[n])
+            {
+                /* Shorten the path of m through n */
+                Graph->Parent[m] = (signed char)(k^1);
+                Graph->Ts[m] = Graph->Ts[n];
+                Graph->Dist[m] = Graph->Dist[n] + 1;
+            }
+        }
+        
+        Graph->Time++;
+        
+        if(!Found)
+        {
+            Current = -1;
+            continue;
+        }
+        
+        /* Keep n marked active while it is the current node */
+        Graph->Next[n] = n;
+        Current = n;
+        
+        if(Graph->IsSink[n])
+            Flow += Augment(Graph, m, k^1);
+        else
+            Flow += Augment(Graph, n, k);
+        
+        /* Adopt the orphans */
+        while(Graph->NumOrphans > 0)
+        {
+            m = Graph->Orphan[Graph->OrphanFirst];
+            
+            if(++Graph->OrphanFirst == NumPixels)
+                Graph->OrphanFirst = 0;
+            
+            Graph->NumOrphans--;
+            ProcessOrphan(Graph, m);
+        }
+    }
+    
+    for(n = 0; n < NumPixels; n++)
+        Label[n] = !(Graph->Parent[n] != MF_FREE && Graph->IsSink[n]);
+    
+    return Flow;
+}
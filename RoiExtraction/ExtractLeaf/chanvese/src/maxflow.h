@@ -0,0 +1,17 @@
+/**
+ * @file maxflow.h
+ * @brief Boykov-Kolmogorov max-flow on a 4- or 8-connected pixel grid
+ */
+#ifndef _MAXFLOW_H_
+#define _MAXFLOW_H_
+
+#include "num.h"
+#include "workspace.h"
+
+typedef struct maxflowstruct maxflow;
+
+maxflow *MaxflowNew(int Width, int Height, int Connectivity,
+    num AxisWeight, num DiagWeight, workspace *Ws);
+double MaxflowSolve(maxflow *Graph, const num *TrCap, unsigned char *Label);
+
+#endif /* _MAXFLOW_H_ */
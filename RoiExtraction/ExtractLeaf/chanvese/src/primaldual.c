@@ -0,0 +1,386 @@
+/**
+ * @file primaldual.c
+ * @brief Convex relaxation backend for Chan-Vese segmentation
+ *
+ * For fixed region averages c1 and c2, the Chan-Vese energy of a region
+ * with indicator function u is
+ *
+ *    mu TV(u) + int r u dx + const,
+ *    r = nu + lambda1 |f - c1|^2 - lambda2 |f - c2|^2.
+ *
+ * Chan, Esedoglu, and Nikolova showed that minimizing this energy over
+ * 0 <= u <= 1 instead of over indicator functions is a convex problem, and
+ * that thresholding a minimizer at any level in (0,1) gives a global
+ * minimizer of the two-phase problem.  This backend solves the relaxed
+ * problem with the first-order primal-dual algorithm of Chambolle and Pock,
+ * updating c1 and c2 from the thresholded solution every few iterations.
+ *
+ * T. F. Chan, S. Esedoglu, and M. Nikolova, "Algorithms for finding global
+ * minimizers of image segmentation and denoising models," SIAM Journal on
+ * Applied Mathematics, 66(5), pp. 1632-1648, 2006.
+ *
+ * A. Chambolle and T. Pock, "A first-order primal-dual algorithm for convex
+ * problems with applications to imaging," Journal of Mathematical Imaging
+ * and Vision, 40(1), pp. 120-145, 2011.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "basic.h"
+#include "chanveseopt.h"
+
+/** @brief Number of primal-dual iterations between updates of c1 and c2 */
+#define PD_AVERAGE_INTERVAL 10
+/** @brief Primal and dual step sizes, tau sigma ||grad||^2 <= 1 */
+#define PD_STEP             ((num)0.35355339059327376)
+
+/* Layout of the row accumulators of the primal update */
+/** @brief Sum of the squared changes in Phi */
+#define PD_PHIDIFF          0
+/** @brief Number of pixels where Phi changed sign */
+#define PD_FLIPS            1
+/** @brief Number of pixels with Phi >= 0 */
+#define PD_COUNT1           2
+/** @brief Per-channel sums of f over pixels with Phi >= 0 */
+#define PD_SUM1             3
+
+
+/** @brief Primal-dual variables */
+typedef struct
+{
+    /** @brief Primal variable v = 2u - 1, stored in Phi */
+    num *Phi;
+    /** @brief Extrapolated primal variable 2 v^(n+1) - v^n */
+    num *Bar;
+    /** @brief Dual variable, a vector field with |p| <= mu/2 */
+    num *Px;
+    num *Py;
+    /** @brief Data term r/2 */
+    num *Data;
+    const num *f;
+    long NumPixels;
+    int Width;
+    int Height;
+    int NumChannels;
+} pddata;
+
+
+/**
+ * @brief Compute the data term r/2 for the current averages
+ * @param Pd the primal-dual variables
+ * @param c1, c2 the region averages
+ * @param Opt chanveseopt options object
+ * @param j the row to compute
+ */
+static void DataRow(pddata *Pd, const num *c1, const num *c2,
+    const chanveseopt *Opt, int j)
+{
+    const long NumPixels = Pd->NumPixels;
+    const int Width = Pd->Width;
+    const num HalfNu = Opt->Nu/2;
+    const num HalfLambda1 = Opt->Lambda1/2, HalfLambda2 = Opt->Lambda2/2;
+    num *Data = Pd->Data + ((long)Width)*j;
+    const num *f = Pd->f + ((long)Width)*j, *fPtr;
+    num Dist1, Dist2, Temp;
+    int i, Channel;
+    
+    for(i = 0; i < Width; i++, f++)
+    {
+        Dist1 = Dist2 = 0;
+        
+        for(Channel = 0, fPtr = f; Channel < Pd->NumChannels;
+            Channel++, fPtr += NumPixels)
+        {
+            Temp = *fPtr - c1[Channel];
+            Dist1 += Temp*Temp;
+            Temp = *fPtr - c2[Channel];
+            Dist2 += Temp*Temp;
+        }
+        
+        Data[i] = HalfNu + HalfLambda1*Dist1 - HalfLambda2*Dist2;
+    }
+}
+
+
+/**
+ * @brief Dual update of one row
+ * @param Pd the primal-dual variables
+ * @param Bound bound on the dual variable, mu/2
+ * @param j the row to update
+ *
+ * p = proj(p + sigma grad Bar) onto |p| <= Bound, where grad uses forward
+ * differences with Neumann boundary conditions.
+ */
+static void DualRow(pddata *Pd, num Bound, int j)
+{
+    const int Width = Pd->Width;
+    const long Offset = ((long)Width)*j;
+    const num *Bar = Pd->Bar + Offset;
+    const num *BarDown = (j + 1 < Pd->Height) ? Bar + Width : Bar;
+    num *Px = Pd->Px + Offset, *Py = Pd->Py + Offset;
+    num Qx, Qy, Norm;
+    int i;
+    
+    for(i = 0; i < Width; i++)
+    {
+        Qx = Px[i] + ((i + 1 < Width) ? PD_STEP*(Bar[i + 1] - Bar[i]) : 0);
+        Qy = Py[i] + PD_STEP*(BarDown[i] - Bar[i]);
+        Norm = (num)sqrt(Qx*Qx + Qy*Qy);
+        
+        if(Norm > Bound)
+        {
+            Norm = (Norm > 0) ? Bound/Norm : 0;
+            Qx *= Norm;
+            Qy *= Norm;
+        }
+        
+        Px[i] = Qx;
+        Py[i] = Qy;
+    }
+}
+
+
+/**
+ * @brief Primal update of one row
+ * @param Pd the primal-dual variables
+ * @param j the row to update
+ * @param Acc accumulators for the row, see PD_PHIDIFF etc.
+ * @param Sums if nonzero, accumulate the region sums
+ *
+ * v = clamp(v + tau (div p - r/2), -1, 1), where div is the negative
+ * adjoint of grad, and Bar = 2 v^(n+1) - v^n.
+ */
+static void PrimalRow(pddata *Pd, int j, double *Acc, int Sums)
+{
+    const int Width = Pd->Width;
+    const long Offset = ((long)Width)*j;
+    const num *Px = Pd->Px + Offset, *Py = Pd->Py + Offset;
+    const num *PyUp = Py - Width;
+    const num *Data = Pd->Data + Offset;
+    num *Phi = Pd->Phi + Offset, *Bar = Pd->Bar + Offset;
+    const num *fPtr;
+    num Div, Old, New;
+    double Diff = 0;
+    long Flips = 0, Count1 = 0;
+    int i, Channel;
+    
+    for(i = 0; i < Width; i++)
+    {
+        Div = Px[i] + Py[i];
+        
+        if(i > 0)
+            Div -= Px[i - 1];
+        if(j > 0)
+            Div -= PyUp[i];
+        
+        Old = Phi[i];
+        New = Old + PD_STEP*(Div - Data[i]);
+        
+        if(New > 1)
+            New = 1;
+        else if(New < -1)
+            New = -1;
+        
+        Phi[i] = New;
+        Bar[i] = 2*New - Old;
+        Diff += (New - Old)*(New - Old);
+        Flips += ((New >= 0) != (Old >= 0));
+        Count1 += (New >= 0);
+    }
+    
+    Acc[PD_PHIDIFF] = Diff;
+    Acc[PD_FLIPS] = (double)Flips;
+    Acc[PD_COUNT1] = (double)Count1;
+    
+    if(Sums)
+        for(Channel = 0; Channel < Pd->NumChannels; Channel++)
+        {
+            fPtr = Pd->f + Offset + Pd->NumPixels*Channel;
+            Acc[PD_SUM1 + Channel] = 0;
+            
+            for(i = 0; i < Width; i++)
+                if(Phi[i] >= 0)
+                    Acc[PD_SUM1 + Channel] += fPtr[i];
+        }
+}
+
+
+/**
+ * @brief Chan-Vese segmentation with the convex relaxation
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @param Ws workspace for the scratch memory
+ * @return the final state as for ChanVese, 0 on failure
+ *
+ * The primal variable is v = 2u - 1, stored in Phi, so that the
+ * segmentation is the set where Phi >= 0 as with the other backends.  Phi
+ * is initialized by clamping the input Phi to [-1,1].  Each iteration is
+ * one primal-dual step, parallelized over the rows with OpenMP (see
+ * ChanVeseSetNumThreads), and c1 and c2 are updated every
+ * PD_AVERAGE_INTERVAL iterations.  The Delta passed to the plotting function
+ * and compared to Tol is the root mean square change in Phi.  The time step
+ * dt is not used.
+ *
+ * On return, Phi is thresholded to +1 or -1.
+ */
+int PrimalDualChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    const size_t Mark = WorkspaceMark(Ws);
+    const int AccStride = PD_SUM1 + NumChannels;
+    const num Bound = Opt->Mu/2;
+    pddata Pd;
+    fliptest FlipTest;
+    const unsigned long StartTime = Clock();
+    double *RowAcc, *Sum, *Total;
+    num *c1, *c2;
+    double Delta = 1000;
+    const num *fPtr;
+    long n;
+    int NumThreads = 1, Iter, j, k, Channel, Sums;
+    int State = CHANVESE_MAXITER, Success = 0;
+    
+    Pd.Phi = Phi;
+    Pd.f = f;
+    Pd.NumPixels = NumPixels;
+    Pd.Width = Width;
+    Pd.Height = Height;
+    Pd.NumChannels = NumChannels;
+
+#ifdef _OPENMP
+    NumThreads = (Opt->NumThreads > 0) ?
+        Opt->NumThreads : omp_get_num_procs();
+#else
+    (void)NumThreads;
+#endif
+
+    if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(Sum = (double *)WorkspaceAlloc(Ws, sizeof(double)*AccStride))
+        || !(Total = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*NumChannels))
+        || !(RowAcc = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*AccStride*Height))
+        || !(Pd.Bar = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Pd.Px = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Pd.Py = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Pd.Data = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !FlipTestInit(&FlipTest, Opt, NumPixels, Ws))
+        goto Done;
+    
+    for(n = 0; n < NumPixels; n++)
+    {
+        if(Phi[n] > 1)
+            Phi[n] = 1;
+        else if(Phi[n] < -1)
+            Phi[n] = -1;
+        
+        Pd.Bar[n] = Phi[n];
+        Pd.Px[n] = Pd.Py[n] = 0;
+    }
+    
+    for(Channel = 0, fPtr = f; Channel < NumChannels;
+        Channel++, fPtr += NumPixels)
+        for(n = 0, Total[Channel] = 0; n < NumPixels; n++)
+            Total[Channel] += fPtr[n];
+    
+    RegionAverages(c1, c2, Phi, f, Width, Height, NumChannels);
+    Success = CHANVESE_MAXITER;
+    
+    if(Opt->PlotFun)
+        if(!Opt->PlotFun(0, 0, (num)Delta, c1, c2, Phi,
+                Width, Height, NumChannels, Opt->PlotParam))
+            goto Done;
+    
+    for(Iter = 1; Iter <= Opt->MaxIter; Iter++)
+    {
+        Sums = (Iter % PD_AVERAGE_INTERVAL == 0);
+        
+        if(Iter % PD_AVERAGE_INTERVAL == 1)
+        {
+#ifdef _OPENMP
+            #pragma omp parallel for schedule(static) num_threads(NumThreads)
+#endif
+            for(j = 0; j < Height; j++)
+                DataRow(&Pd, c1, c2, Opt, j);
+        }
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(NumThreads)
+#endif
+        for(j = 0; j < Height; j++)
+            DualRow(&Pd, Bound, j);
+
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(static) num_threads(NumThreads)
+#endif
+        for(j = 0; j < Height; j++)
+            PrimalRow(&Pd, j, RowAcc + AccStride*j, Sums);
+        
+        /* Reduce the row accumulators in a fixed order */
+        for(k = 0; k < AccStride; k++)
+            Sum[k] = 0;
+        
+        for(j = 0; j < Height; j++)
+            for(k = 0; k < ((Sums) ? AccStride : PD_SUM1); k++)
+                Sum[k] += RowAcc[AccStride*j + k];
+        
+        if(Sums)
+            for(Channel = 0; Channel < NumChannels; Channel++)
+            {
+                c1[Channel] = (Sum[PD_COUNT1] > 0) ? (num)(
+                    Sum[PD_SUM1 + Channel]/Sum[PD_COUNT1]) : 0;
+                c2[Channel] = (Sum[PD_COUNT1] < NumPixels) ? (num)(
+                    (Total[Channel] - Sum[PD_SUM1 + Channel])
+                    / (NumPixels - Sum[PD_COUNT1])) : 0;
+            }
+        
+        Delta = sqrt(Sum[PD_PHIDIFF]/NumPixels);
+        TraceRecord(Opt->Trace, Iter, Delta, c1, c2, Sum[PD_FLIPS]);
+        
+        if(Iter >= 2 && Delta <= Opt->Tol)
+        {
+            State = CHANVESE_CONVERGED;
+            break;
+        }
+        
+        if(FlipTestUpdate(&FlipTest, Iter, Sum[PD_FLIPS]))
+        {
+            State = CHANVESE_NOFLIPS;
+            break;
+        }
+        
+        if(DeadlineReached(Opt, StartTime))
+        {
+            State = CHANVESE_DEADLINE;
+            break;
+        }
+        
+        if(Opt->PlotFun)
+            if(!Opt->PlotFun(0, Iter, (num)Delta, c1, c2, Phi,
+                    Width, Height, NumChannels, Opt->PlotParam))
+                goto Done;
+    }
+    
+    Success = State;
+    TraceClearProgress(Opt->Trace);
+    
+    for(n = 0; n < NumPixels; n++)
+        Phi[n] = (Phi[n] >= 0) ? 1 : -1;
+    
+    if(Opt->PlotFun)
+        Opt->PlotFun(State, (Iter <= Opt->MaxIter) ? Iter:Opt->MaxIter,
+            (num)Delta, c1, c2, Phi, Width, Height, NumChannels,
+            Opt->PlotParam);
+
+Done:
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
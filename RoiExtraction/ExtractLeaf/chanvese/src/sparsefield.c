@@ -0,0 +1,569 @@
+/**
+ * @file sparsefield.c
+ * @brief Sparse-field level set backend for Chan-Vese segmentation
+ *
+ * This file implements the Chan-Vese evolution with Whitaker's sparse-field
+ * level set method.  Instead of updating Phi over the whole image, the
+ * method maintains linked lists of the pixels in a few layers around the
+ * zero level set.  Only the zero layer is moved by the Chan-Vese force, the
+ * other layers are updated from their neighbors as approximate distances.
+ * The cost of an iteration is then proportional to the number of pixels on
+ * the boundary of the segmentation rather than to the image area.
+ *
+ * R. T. Whitaker, "A level-set approach to 3D reconstruction from range
+ * data," International Journal of Computer Vision, 29(3), pp. 203-231, 1998.
+ *
+ * S. Lankton, "Sparse field methods," technical report, Georgia Institute
+ * of Technology, 2009.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "basic.h"
+#include "chanveseopt.h"
+
+/** @brief Number of layers on each side of the zero layer */
+#define SF_NUM_LAYERS       2
+/** @brief Label of the pixels beyond the outermost layers */
+#define SF_FAR              (SF_NUM_LAYERS + 1)
+/** @brief Maximum change of Phi on the zero layer in one iteration */
+#define SF_MAX_STEP         ((num)0.45)
+/** @brief Number of iterations over which the net change is measured for Tol */
+#define SF_WINDOW           32
+/** @brief First iteration where Delta is compared to Tol */
+#define SF_MIN_ITER         4
+/** @brief Squared gradient norm below which the Laplacian is used */
+#define SF_MIN_NORM2        ((num)1e-2)
+/** @brief Curvature denominator regularization */
+#define SF_EPS              ((num)1e-8)
+
+/** @brief List of the pixels in layer k, -SF_NUM_LAYERS <= k <= SF_NUM_LAYERS */
+#define LAYER(k)            ((k) + SF_NUM_LAYERS)
+/** @brief List of the pixels moving to layer k, -SF_FAR <= k <= SF_FAR */
+#define STATUS(k)           (2*SF_NUM_LAYERS + 1 + (k) + SF_FAR)
+/** @brief Total number of lists */
+#define NUM_LISTS           (4*SF_NUM_LAYERS + 4)
+
+/** @brief Sparse-field data */
+typedef struct
+{
+    num *Phi;
+    const num *f;
+    /** @brief Layer of each pixel, or +/-SF_FAR inside/outside the layers */
+    signed char *Label;
+    /** @brief Links of the doubly-linked lists */
+    long *Next;
+    long *Prev;
+    /** @brief First pixel of each list, or -1 if the list is empty */
+    long Head[NUM_LISTS];
+    long Size[NUM_LISTS];
+    /** @brief Sums of f over the pixels with Phi >= 0 */
+    double *Sum1;
+    /** @brief Sums of f over the whole image */
+    double *Total;
+    /** @brief Number of pixels with Phi >= 0 */
+    double Count1;
+    /** @brief Number of sign changes in the current iteration */
+    double Flips;
+    long NumPixels;
+    int Width;
+    int Height;
+    int NumChannels;
+} sfdata;
+
+
+/** @brief Add pixel n to a list */
+static void ListAdd(sfdata *Sf, int List, long n)
+{
+    Sf->Prev[n] = -1;
+    Sf->Next[n] = Sf->Head[List];
+    
+    if(Sf->Head[List] >= 0)
+        Sf->Prev[Sf->Head[List]] = n;
+    
+    Sf->Head[List] = n;
+    Sf->Size[List]++;
+}
+
+
+/** @brief Remove pixel n from a list */
+static void ListRemove(sfdata *Sf, int List, long n)
+{
+    if(Sf->Prev[n] >= 0)
+        Sf->Next[Sf->Prev[n]] = Sf->Next[n];
+    else
+        Sf->Head[List] = Sf->Next[n];
+    
+    if(Sf->Next[n] >= 0)
+        Sf->Prev[Sf->Next[n]] = Sf->Prev[n];
+    
+    Sf->Size[List]--;
+}
+
+
+/** @brief Move pixel n from one list to another */
+static void ListMove(sfdata *Sf, int From, int To, long n)
+{
+    ListRemove(Sf, From, n);
+    ListAdd(Sf, To, n);
+}
+
+
+/** @brief Get the 4-neighbors of pixel n, returns the number of neighbors */
+static int Neighbors(const sfdata *Sf, long n, long *Nb)
+{
+    const int i = (int)(n % Sf->Width), j = (int)(n / Sf->Width);
+    int Count = 0;
+    
+    if(i > 0)
+        Nb[Count++] = n - 1;
+    if(i < Sf->Width - 1)
+        Nb[Count++] = n + 1;
+    if(j > 0)
+        Nb[Count++] = n - Sf->Width;
+    if(j < Sf->Height - 1)
+        Nb[Count++] = n + Sf->Width;
+    
+    return Count;
+}
+
+
+/** @brief Set Phi at pixel n, updating the region sums on a sign change */
+static void SetPhi(sfdata *Sf, long n, num Value)
+{
+    const int Inside = (Value >= 0);
+    const num *fPtr;
+    int Channel;
+    
+    if(Inside != (Sf->Phi[n] >= 0))
+    {
+        Sf->Flips++;
+        Sf->Count1 += (Inside) ? 1 : -1;
+        
+        for(Channel = 0, fPtr = Sf->f + n; Channel < Sf->NumChannels;
+            Channel++, fPtr += Sf->NumPixels)
+            Sf->Sum1[Channel] += (Inside) ? *fPtr : -*fPtr;
+    }
+    
+    Sf->Phi[n] = Value;
+}
+
+
+/**
+ * @brief Build the layers from the sign of Phi
+ *
+ * The zero layer is the set of pixels inside the curve (Phi >= 0) having a
+ * 4-neighbor outside.  The other layers are grown from it, and Phi is set
+ * to the layer number, or +/-SF_FAR beyond the layers.  The sign of Phi is
+ * not changed.
+ */
+static void InitLayers(sfdata *Sf)
+{
+    num *Phi = Sf->Phi;
+    long Nb[4];
+    long n, p;
+    int i, j, k, m, NumNb, Side;
+    
+    for(k = 0; k < NUM_LISTS; k++)
+    {
+        Sf->Head[k] = -1;
+        Sf->Size[k] = 0;
+    }
+    
+    for(j = 0, n = 0; j < Sf->Height; j++)
+        for(i = 0; i < Sf->Width; i++, n++)
+        {
+            Sf->Label[n] = (Phi[n] >= 0) ? SF_FAR : -SF_FAR;
+            
+            if(Phi[n] >= 0)
+                for(m = 0, NumNb = Neighbors(Sf, n, Nb); m < NumNb; m++)
+                    if(Phi[Nb[m]] < 0)
+                    {
+                        Sf->Label[n] = 0;
+                        ListAdd(Sf, LAYER(0), n);
+                        break;
+                    }
+        }
+    
+    for(n = 0; n < Sf->NumPixels; n++)
+        Phi[n] = (num)Sf->Label[n];
+    
+    for(k = 1; k <= SF_NUM_LAYERS; k++)
+        for(Side = -1; Side <= 1; Side += 2)
+            for(p = Sf->Head[LAYER(Side*(k - 1))]; p >= 0; p = Sf->Next[p])
+                for(m = 0, NumNb = Neighbors(Sf, p, Nb); m < NumNb; m++)
+                    if(Sf->Label[Nb[m]] == Side*SF_FAR)
+                    {
+                        Sf->Label[Nb[m]] = Side*k;
+                        Phi[Nb[m]] = (num)(Side*k);
+                        ListAdd(Sf, LAYER(Side*k), Nb[m]);
+                    }
+}
+
+
+/**
+ * @brief Curvature of the level sets of Phi at pixel n
+ *
+ * Where the gradient vanishes, the curvature is undefined and the Laplacian
+ * of Phi is returned instead.  This happens on the zero layer at isolated
+ * pixels and on lines one pixel wide, where the central differences cancel.
+ * Their Laplacian is about -4 (or +4 outside), which is the strong shrinking
+ * force such thin features should have.  Returning zero would leave them
+ * to the data term alone, and many of them would never be removed.
+ */
+static num Curvature(const sfdata *Sf, long n)
+{
+    const num *Phi = Sf->Phi;
+    const int i = (int)(n % Sf->Width), j = (int)(n / Sf->Width);
+    const long il = (i > 0) ? -1 : 0, ir = (i < Sf->Width - 1) ? 1 : 0;
+    const long iu = (j > 0) ? -Sf->Width : 0;
+    const long id = (j < Sf->Height - 1) ? Sf->Width : 0;
+    num PhiX, PhiY, PhiXX, PhiYY, PhiXY, Norm2;
+    
+    PhiX = (Phi[n + ir] - Phi[n + il])/2;
+    PhiY = (Phi[n + id] - Phi[n + iu])/2;
+    PhiXX = Phi[n + ir] - 2*Phi[n] + Phi[n + il];
+    PhiYY = Phi[n + id] - 2*Phi[n] + Phi[n + iu];
+    PhiXY = (Phi[n + id + ir] - Phi[n + id + il]
+        - Phi[n + iu + ir] + Phi[n + iu + il])/4;
+    Norm2 = PhiX*PhiX + PhiY*PhiY;
+    
+    if(Norm2 < SF_MIN_NORM2)
+        return PhiXX + PhiYY;
+    
+    return (PhiXX*PhiY*PhiY - 2*PhiX*PhiY*PhiXY + PhiYY*PhiX*PhiX)
+        / (Norm2*(num)sqrt(Norm2) + SF_EPS);
+}
+
+
+/**
+ * @brief Update the layer k from the next layer toward the zero layer
+ *
+ * Each pixel of layer k gets Phi = M + 1 (k > 0) or M - 1 (k < 0), where M
+ * is the value of its neighbor in layer k - 1 (or k + 1) closest to the zero
+ * level set.  Pixels without such a neighbor, or whose value leaves the
+ * range of the layer, are moved to the status lists.
+ */
+static void UpdateLayer(sfdata *Sf, int k)
+{
+    const int Side = (k > 0) ? 1 : -1;
+    const int Closer = k - Side;
+    long Nb[4];
+    long p, Next;
+    num M = 0, Value;
+    int m, NumNb, Found;
+    
+    for(p = Sf->Head[LAYER(k)]; p >= 0; p = Next)
+    {
+        Next = Sf->Next[p];
+        
+        for(m = 0, Found = 0, NumNb = Neighbors(Sf, p, Nb); m < NumNb; m++)
+            if(Sf->Label[Nb[m]] == Closer)
+            {
+                Value = Sf->Phi[Nb[m]];
+                
+                if(!Found || (Side > 0 && Value < M)
+                    || (Side < 0 && Value > M))
+                    M = Value;
+                
+                Found = 1;
+            }
+        
+        if(!Found)
+            ListMove(Sf, LAYER(k), STATUS(k + Side), p);
+        else
+        {
+            Value = M + Side;
+            SetPhi(Sf, p, Value);
+            
+            if(Side*Value <= Side*k - (num)0.5)
+                ListMove(Sf, LAYER(k), STATUS(Closer), p);
+            else if(Side*Value > Side*k + (num)0.5)
+                ListMove(Sf, LAYER(k), STATUS(k + Side), p);
+        }
+    }
+}
+
+
+/**
+ * @brief Move the pixels of the status lists to their new layers
+ *
+ * A pixel entering layer k with 0 < |k| < SF_NUM_LAYERS adds its neighbors
+ * beyond the layers to the status list of layer k +/- 1.  Pixels leaving
+ * the outermost layers are set to +/-SF_FAR.
+ */
+static void ProcessStatus(sfdata *Sf)
+{
+    long Nb[4];
+    long p, Next;
+    int k, m, NumNb, Side;
+    
+    for(p = Sf->Head[STATUS(0)]; p >= 0; p = Next)
+    {
+        Next = Sf->Next[p];
+        Sf->Label[p] = 0;
+        ListMove(Sf, STATUS(0), LAYER(0), p);
+    }
+    
+    for(k = 1; k <= SF_NUM_LAYERS; k++)
+        for(Side = -1; Side <= 1; Side += 2)
+            for(p = Sf->Head[STATUS(Side*k)]; p >= 0; p = Next)
+            {
+                Next = Sf->Next[p];
+                Sf->Label[p] = Side*k;
+                ListMove(Sf, STATUS(Side*k), LAYER(Side*k), p);
+                
+                if(k < SF_NUM_LAYERS)
+                    for(m = 0, NumNb = Neighbors(Sf, p, Nb); m < NumNb; m++)
+                        if(Sf->Label[Nb[m]] == Side*SF_FAR)
+                        {
+                            SetPhi(Sf, Nb[m], Sf->Phi[p] + Side);
+                            Sf->Label[Nb[m]] = Side*(k + 1);
+                            ListAdd(Sf, STATUS(Side*(k + 1)), Nb[m]);
+                        }
+            }
+    
+    for(Side = -1; Side <= 1; Side += 2)
+        for(p = Sf->Head[STATUS(Side*SF_FAR)]; p >= 0; p = Next)
+        {
+            Next = Sf->Next[p];
+            Sf->Label[p] = Side*SF_FAR;
+            SetPhi(Sf, p, (num)(Side*SF_FAR));
+            ListRemove(Sf, STATUS(Side*SF_FAR), p);
+        }
+}
+
+
+/** @brief Region averages from the maintained sums */
+static void SfAverages(num *c1, num *c2, const sfdata *Sf)
+{
+    const double Count2 = Sf->NumPixels - Sf->Count1;
+    int Channel;
+    
+    for(Channel = 0; Channel < Sf->NumChannels; Channel++)
+    {
+        c1[Channel] = (Sf->Count1 > 0) ?
+            (num)(Sf->Sum1[Channel]/Sf->Count1) : 0;
+        c2[Channel] = (Count2 > 0) ?
+            (num)((Sf->Total[Channel] - Sf->Sum1[Channel])/Count2) : 0;
+    }
+}
+
+
+/**
+ * @brief Chan-Vese segmentation with the sparse-field method
+ * @param Phi, f, Width, Height, NumChannels, Opt as for ChanVese
+ * @param Ws workspace for the scratch memory
+ * @return the final state as for ChanVese, 0 on failure
+ *
+ * The zero layer is moved with the Chan-Vese force
+ *    F = mu*curvature - nu - lambda1 |f - c1|^2 + lambda2 |f - c2|^2,
+ * normalized so that the fastest pixel moves by SF_MAX_STEP in each
+ * iteration.  The time step dt is not used, since the Chan-Vese force is
+ * often weak and the front would otherwise take many iterations to cross a
+ * pixel.  The region averages are maintained incrementally from the sign
+ * changes.
+ *
+ * On return, Phi is a clamped distance-like function with values in
+ * [-SF_FAR, SF_FAR] having the sign of the segmentation.  Since the zero
+ * layer pixels keep moving across the discrete boundary, neither the change
+ * in Phi nor the number of sign changes goes to zero: a few pixels on the
+ * boundary flip back and forth indefinitely.  The Delta passed to the
+ * plotting function and compared to Tol is instead the net change over the
+ * last SF_WINDOW iterations of the number of pixels inside the curve and of
+ * the sums of f over them, relative to the size of the zero layer.  The
+ * flipping pixels cancel out of the net change, while the window is long
+ * enough that a slowly moving front does not.  In the first SF_WINDOW
+ * iterations, Delta is the net change since the start, so that a nearly
+ * converged initialization, such as an upsampled pyramid level, can stop
+ * early.
+ *
+ * The front only moves locally, so unlike the level set backend, no new
+ * region appears away from the initial curve.  From the default
+ * ChanVeseInitPhi pattern, the small squares have nearly equal averages
+ * c1 and c2, so the length penalty shrinks them before the data term
+ * separates the regions.  The sparse-field backend should be started from
+ * an initial curve near the objects, for instance with ChanVeseInitPhiOtsu.
+ */
+int SparseFieldChanVese(num *Phi, const num *f,
+    int Width, int Height, int NumChannels, const chanveseopt *Opt,
+    workspace *Ws)
+{
+    const long NumPixels = ((long)Width) * ((long)Height);
+    const size_t Mark = WorkspaceMark(Ws);
+    sfdata Sf;
+    fliptest FlipTest;
+    const unsigned long StartTime = Clock();
+    const num *fPtr;
+    num *c1, *c2, *Force;
+    num Dist1, Dist2, Temp, MaxForce, dt;
+    double *History, *Prev, Delta = 1000;
+    long p, Next, n;
+    int Iter, k, Channel, State = CHANVESE_MAXITER, Success = 0;
+    
+    Sf.Phi = Phi;
+    Sf.f = f;
+    Sf.NumPixels = NumPixels;
+    Sf.Width = Width;
+    Sf.Height = Height;
+    Sf.NumChannels = NumChannels;
+    
+    if(!(c1 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(c2 = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumChannels))
+        || !(Force = (num *)WorkspaceAlloc(Ws, sizeof(num)*NumPixels))
+        || !(Sf.Label = (signed char *)WorkspaceAlloc(Ws, NumPixels))
+        || !(Sf.Next = (long *)WorkspaceAlloc(Ws, sizeof(long)*NumPixels))
+        || !(Sf.Prev = (long *)WorkspaceAlloc(Ws, sizeof(long)*NumPixels))
+        || !(Sf.Sum1 = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*NumChannels))
+        || !(Sf.Total = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*NumChannels))
+        || !(History = (double *)WorkspaceAlloc(Ws,
+            sizeof(double)*(1 + NumChannels)*SF_WINDOW))
+        || !FlipTestInit(&FlipTest, Opt, NumPixels, Ws))
+        goto Done;
+    
+    InitLayers(&Sf);
+    Sf.Count1 = 0;
+    
+    for(Channel = 0; Channel < NumChannels; Channel++)
+        Sf.Sum1[Channel] = Sf.Total[Channel] = 0;
+    
+    for(n = 0; n < NumPixels; n++)
+    {
+        if(Phi[n] >= 0)
+            Sf.Count1++;
+        
+        for(Channel = 0, fPtr = f + n; Channel < NumChannels;
+            Channel++, fPtr += NumPixels)
+        {
+            Sf.Total[Channel] += *fPtr;
+            
+            if(Phi[n] >= 0)
+                Sf.Sum1[Channel] += *fPtr;
+        }
+    }
+    
+    SfAverages(c1, c2, &Sf);
+    
+    /* History holds Count1 and Sum1 of the last SF_WINDOW iterations */
+    for(k = 0; k < SF_WINDOW; k++)
+    {
+        History[(1 + NumChannels)*k] = Sf.Count1;
+        
+        for(Channel = 0; Channel < NumChannels; Channel++)
+            History[(1 + NumChannels)*k + 1 + Channel] = Sf.Sum1[Channel];
+    }
+    
+    Success = CHANVESE_MAXITER;
+    
+    if(Opt->PlotFun)
+        if(!Opt->PlotFun(0, 0, (num)Delta, c1, c2, Phi,
+                Width, Height, NumChannels, Opt->PlotParam))
+            goto Done;
+    
+    for(Iter = 1; Iter <= Opt->MaxIter; Iter++)
+    {
+        /* Compute the force on the zero layer */
+        MaxForce = 0;
+        
+        for(p = Sf.Head[LAYER(0)], n = 0; p >= 0; p = Sf.Next[p], n++)
+        {
+            Dist1 = Dist2 = 0;
+            
+            for(Channel = 0, fPtr = f + p; Channel < NumChannels;
+                Channel++, fPtr += NumPixels)
+            {
+                Temp = *fPtr - c1[Channel];
+                Dist1 += Temp*Temp;
+                Temp = *fPtr - c2[Channel];
+                Dist2 += Temp*Temp;
+            }
+            
+            Force[n] = Opt->Mu*Curvature(&Sf, p) - Opt->Nu
+                - Opt->Lambda1*Dist1 + Opt->Lambda2*Dist2;
+            
+            if(fabs(Force[n]) > MaxForce)
+                MaxForce = (num)fabs(Force[n]);
+        }
+        
+        dt = (MaxForce > 0) ? SF_MAX_STEP/MaxForce : 0;
+        Sf.Flips = 0;
+        
+        /* Move the zero layer */
+        for(p = Sf.Head[LAYER(0)], n = 0; p >= 0; p = Next, n++)
+        {
+            Next = Sf.Next[p];
+            SetPhi(&Sf, p, Phi[p] + dt*Force[n]);
+            
+            if(Phi[p] > (num)0.5)
+                ListMove(&Sf, LAYER(0), STATUS(1), p);
+            else if(Phi[p] < (num)-0.5)
+                ListMove(&Sf, LAYER(0), STATUS(-1), p);
+        }
+        
+        /* Update the other layers, from the inside out */
+        for(k = 1; k <= SF_NUM_LAYERS; k++)
+        {
+            UpdateLayer(&Sf, -k);
+            UpdateLayer(&Sf, k);
+        }
+        
+        ProcessStatus(&Sf);
+        SfAverages(c1, c2, &Sf);
+        
+        /* Net change since SF_WINDOW iterations ago, or since the start */
+        Prev = History + (1 + NumChannels)*(Iter % SF_WINDOW);
+        Delta = fabs(Sf.Count1 - Prev[0]);
+        Prev[0] = Sf.Count1;
+        
+        for(Channel = 0; Channel < NumChannels; Channel++)
+        {
+            if(fabs(Sf.Sum1[Channel] - Prev[1 + Channel]) > Delta)
+                Delta = fabs(Sf.Sum1[Channel] - Prev[1 + Channel]);
+            
+            Prev[1 + Channel] = Sf.Sum1[Channel];
+        }
+        
+        Delta = (Sf.Size[LAYER(0)] > 0) ? Delta/Sf.Size[LAYER(0)] : 0;
+        
+        TraceRecord(Opt->Trace, Iter, Delta, c1, c2, Sf.Flips);
+        
+        if(Iter >= SF_MIN_ITER && Delta <= Opt->Tol)
+        {
+            State = CHANVESE_CONVERGED;
+            break;
+        }
+        
+        if(FlipTestUpdate(&FlipTest, Iter, Sf.Flips))
+        {
+            State = CHANVESE_NOFLIPS;
+            break;
+        }
+        
+        if(DeadlineReached(Opt, StartTime))
+        {
+            State = CHANVESE_DEADLINE;
+            break;
+        }
+        
+        if(Opt->PlotFun)
+            if(!Opt->PlotFun(0, Iter, (num)Delta, c1, c2, Phi,
+                    Width, Height, NumChannels, Opt->PlotParam))
+                goto Done;
+    }
+    
+    Success = State;
+    TraceClearProgress(Opt->Trace);
+    
+    if(Opt->PlotFun)
+        Opt->PlotFun(State, (Iter <= Opt->MaxIter) ? Iter:Opt->MaxIter,
+            (num)Delta, c1, c2, Phi, Width, Height, NumChannels,
+            Opt->PlotParam);
+
+Done:
+    WorkspaceRelease(Ws, Mark);
+    return Success;
+}
@@ -0,0 +1,228 @@
+/**
+ * @file workspace.c
+ * @brief Reusable stack allocator for per-call scratch buffers
+ *
+ * A workspace hands out scratch memory in stack order: a function records
+ * WorkspaceMark on entry, allocates with WorkspaceAlloc, and returns all of
+ * its blocks at once with WorkspaceRelease.  The memory is kept in chunks
+ * that are allocated as needed.  When the whole stack is released, the
+ * chunks are replaced by one chunk as large as the peak usage so far, so
+ * that later calls needing no more memory than the largest previous call do
+ * not allocate at all.
+ *
+ * A workspace also has a few persistent buffers (see WorkspaceBuffer) that
+ * are kept across calls and only grow.  A workspace is not thread safe; use
+ * one workspace per thread.
+ */
+
+#include "basic.h"
+#include "workspace.h"
+
+/** @brief Block alignment, matching that of malloc on common platforms */
+#define WS_ALIGN        16
+/** @brief Minimum chunk size in bytes */
+#define WS_MIN_CHUNK    65536
+/** @brief Number of persistent buffers */
+#define WS_NUM_SLOTS    4
+
+/** @brief Round Size up to a multiple of WS_ALIGN */
+#define WS_ROUND(Size)  (((Size) + (WS_ALIGN - 1)) \
+    & ~((size_t)(WS_ALIGN - 1)))
+
+
+/** @brief A chunk of memory, followed by its data */
+typedef struct wschunkstruct
+{
+    /** @brief The previous chunk on the stack */
+    struct wschunkstruct *Prev;
+    /** @brief Stack offset of the first byte of the chunk */
+    size_t Base;
+    /** @brief Size of the data in bytes */
+    size_t Size;
+} wschunk;
+
+struct workspacestruct
+{
+    /** @brief The most recent chunk */
+    wschunk *Top;
+    /** @brief Current stack offset, the number of bytes in use */
+    size_t Used;
+    /** @brief Largest value of Used so far */
+    size_t Peak;
+    /** @brief Persistent buffers */
+    void *Slot[WS_NUM_SLOTS];
+    size_t SlotSize[WS_NUM_SLOTS];
+};
+
+
+/** @brief The data of a chunk, after the aligned header */
+#define WS_DATA(Chunk)  ((unsigned char *)(Chunk) + WS_ROUND(sizeof(wschunk)))
+
+
+/** @brief Allocate a chunk on top of the stack */
+static wschunk *PushChunk(workspace *Ws, size_t Size)
+{
+    wschunk *Chunk;
+    
+    if(!(Chunk = (wschunk *)Malloc(WS_ROUND(sizeof(wschunk)) + Size)))
+        return NULL;
+    
+    Chunk->Prev = Ws->Top;
+    Chunk->Base = Ws->Used;
+    Chunk->Size = Size;
+    Ws->Top = Chunk;
+    return Chunk;
+}
+
+
+/** @brief Free all chunks */
+static void FreeChunks(workspace *Ws)
+{
+    wschunk *Chunk;
+    
+    while((Chunk = Ws->Top))
+    {
+        Ws->Top = Chunk->Prev;
+        Free(Chunk);
+    }
+}
+
+
+/**
+ * @brief Create a new workspace
+ * @return the workspace, or NULL on failure
+ *
+ * No scratch memory is allocated until the first WorkspaceAlloc.
+ */
+workspace *WorkspaceNew()
+{
+    workspace *Ws;
+    int Slot;
+    
+    if(!(Ws = (workspace *)Malloc(sizeof(struct workspacestruct))))
+        return NULL;
+    
+    Ws->Top = NULL;
+    Ws->Used = Ws->Peak = 0;
+    
+    for(Slot = 0; Slot < WS_NUM_SLOTS; Slot++)
+    {
+        Ws->Slot[Slot] = NULL;
+        Ws->SlotSize[Slot] = 0;
+    }
+    
+    return Ws;
+}
+
+
+/** @brief Free a workspace and all of its memory */
+void WorkspaceFree(workspace *Ws)
+{
+    int Slot;
+    
+    if(Ws)
+    {
+        FreeChunks(Ws);
+        
+        for(Slot = 0; Slot < WS_NUM_SLOTS; Slot++)
+            if(Ws->Slot[Slot])
+                Free(Ws->Slot[Slot]);
+        
+        Free(Ws);
+    }
+}
+
+
+/**
+ * @brief Allocate a block of scratch memory
+ * @param Ws the workspace
+ * @param Size size of the block in bytes
+ * @return pointer to the block, or NULL on failure
+ *
+ * The block is aligned to WS_ALIGN bytes and stays valid until a
+ * WorkspaceRelease with a mark taken before this call.
+ */
+void *WorkspaceAlloc(workspace *Ws, size_t Size)
+{
+    void *Ptr;
+    
+    Size = WS_ROUND(Size);
+    
+    if((!Ws->Top || Ws->Used + Size > Ws->Top->Base + Ws->Top->Size)
+        && !PushChunk(Ws, (Size > WS_MIN_CHUNK) ? Size : WS_MIN_CHUNK))
+        return NULL;
+    
+    Ptr = WS_DATA(Ws->Top) + (Ws->Used - Ws->Top->Base);
+    Ws->Used += Size;
+    
+    if(Ws->Used > Ws->Peak)
+        Ws->Peak = Ws->Used;
+    
+    return Ptr;
+}
+
+
+/** @brief Current position of the stack, to be passed to WorkspaceRelease */
+size_t WorkspaceMark(const workspace *Ws)
+{
+    return Ws->Used;
+}
+
+
+/**
+ * @brief Release all blocks allocated since a mark
+ * @param Ws the workspace
+ * @param Mark the value of WorkspaceMark before the allocations
+ */
+void WorkspaceRelease(workspace *Ws, size_t Mark)
+{
+    wschunk *Chunk;
+    
+    /* Chunks pushed after the mark are only needed while the workspace is
+       growing, they are merged below once the stack is empty */
+    while((Chunk = Ws->Top) && Chunk->Prev && Chunk->Base >= Mark)
+    {
+        Ws->Top = Chunk->Prev;
+        Free(Chunk);
+    }
+    
+    Ws->Used = Mark;
+    
+    if(!Mark && Ws->Top && (Ws->Top->Prev || Ws->Top->Size < Ws->Peak))
+    {
+        FreeChunks(Ws);
+        PushChunk(Ws, Ws->Peak);
+    }
+}
+
+
+/**
+ * @brief Get a persistent buffer of at least Size bytes
+ * @param Ws the workspace
+ * @param Slot which buffer, 0 <= Slot < WS_NUM_SLOTS
+ * @param Size minimum size in bytes
+ * @return pointer to the buffer, or NULL on failure
+ *
+ * The buffer is kept until the workspace is freed and is only reallocated
+ * when a larger size is requested, in which case its contents are lost.
+ */
+void *WorkspaceBuffer(workspace *Ws, int Slot, size_t Size)
+{
+    if(!Ws || Slot < 0 || Slot >= WS_NUM_SLOTS)
+        return NULL;
+    
+    if(Ws->SlotSize[Slot] < Size)
+    {
+        if(Ws->Slot[Slot])
+            Free(Ws->Slot[Slot]);
+        
+        Ws->SlotSize[Slot] = 0;
+        
+        if(!(Ws->Slot[Slot] = Malloc(Size)))
+            return NULL;
+        
+        Ws->SlotSize[Slot] = Size;
+    }
+    
+    return Ws->Slot[Slot];
+}
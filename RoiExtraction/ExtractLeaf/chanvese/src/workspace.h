@@ -0,0 +1,19 @@
+/**
+ * @file workspace.h
+ * @brief Reusable stack allocator for per-call scratch buffers
+ */
+#ifndef _WORKSPACE_H_
+#define _WORKSPACE_H_
+
+#include <stddef.h>
+
+typedef struct workspacestruct workspace;
+
+workspace *WorkspaceNew();
+void WorkspaceFree(workspace *Ws);
+void *WorkspaceAlloc(workspace *Ws, size_t Size);
+size_t WorkspaceMark(const workspace *Ws);
+void WorkspaceRelease(workspace *Ws, size_t Mark);
+void *WorkspaceBuffer(workspace *Ws, int Slot, size_t Size);
+
+#endif /* _WORKSPACE_H_ */
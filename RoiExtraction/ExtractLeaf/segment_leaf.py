@@ -5,9 +5,13 @@
     -an initial mask for the active contour method is calculated
     -after this, an active contour (chan-vese) is applied to the gray-scale image
     -the rectangular boundary of the active contour represents the ROI for the initial image
+
+    When the chanvese binary supports them, the initial mask is its built-in phi0:box and
+    the ROI is the bounding box it writes with roi:, otherwise make_mask and OpenCV are used.
 """
 
 import cv2
+import json
 import numpy
 import os
 import time
@@ -16,6 +20,28 @@ import subprocess
 from chanvese.make_mask import make_mask
 
 
+if os.name != 'nt':
+    CHANVESE_PATH = os.path.join(os.path.dirname(__file__), "chanvese", "chanvese")
+else:
+    CHANVESE_PATH = os.path.join(os.path.dirname(__file__), "chanvese", "chanvese.exe")
+
+_chanvese_help = None
+
+
+def chanvese_supports(option):
+    """Check whether the help message of the chanvese binary lists an option, e.g. "roi:" """
+    global _chanvese_help
+
+    if _chanvese_help is None:
+        try:
+            process = subprocess.Popen([CHANVESE_PATH], stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+            _chanvese_help = process.communicate()[0]
+        except OSError:
+            _chanvese_help = ""
+
+    return option in _chanvese_help
+
+
 def process_leaf(image_path, output_folder="."):
     time_s = time.time()
 
@@ -35,31 +61,43 @@ def process_leaf(image_path, output_folder="."):
     temp_img_path = os.path.join(os.path.dirname(__file__), "chanvese", file_name + '_temp.bmp')
 
     cv2.imwrite(temp_img_path, gray_image)
-    init_mask_path = make_mask(temp_img_path)
-   
-    if os.name != 'nt':
-        process = subprocess.Popen([os.path.join(os.path.dirname(__file__), "chanvese", "chanvese"),
-                                                                "phi0:%s" % init_mask_path, "mu:0.0", "iterperframe:1000", "maxiter:1000",
-                                                                temp_img_path, temp_img_path + "_animation.gif", temp_img_path + "_final.bmp"])
+
+    if chanvese_supports("phi0:box"):
+        init_mask_path = None
+        phi0 = "phi0:box"
     else:
-        process = subprocess.Popen([os.path.join(os.path.dirname(__file__), "chanvese", "chanvese.exe"),
-                                                                "phi0:%s" % init_mask_path, "mu:0.0", "iterperframe:1000", "maxiter:1000",
-                                                                temp_img_path, temp_img_path + "_animation.gif", temp_img_path + "_final.bmp"])
+        init_mask_path = make_mask(temp_img_path)
+        phi0 = "phi0:%s" % init_mask_path
+
+    roi_path = None
+    arguments = [CHANVESE_PATH, phi0, "mu:0.0", "iterperframe:1000", "maxiter:1000"]
+
+    if chanvese_supports("roi:"):
+        roi_path = temp_img_path + "_roi.json"
+        arguments.append("roi:%s" % roi_path)
+
+    process = subprocess.Popen(arguments + [temp_img_path, temp_img_path + "_animation.gif", temp_img_path + "_final.bmp"])
     process.wait()
 
-    mask = cv2.imread(temp_img_path + "_final.bmp", 0)
+    if roi_path is not None:
+        with open(roi_path) as roi_file:
+            roi = json.load(roi_file)
 
-    active_contour = cv2.bitwise_and(image, image, mask=mask)
+        x, y, w, h = roi["x"], roi["y"], roi["width"], roi["height"]
+    else:
+        mask = cv2.imread(temp_img_path + "_final.bmp", 0)
+
+        active_contour = cv2.bitwise_and(image, image, mask=mask)
 
-    active_contour = cv2.cvtColor(active_contour, cv2.COLOR_BGR2GRAY)
+        active_contour = cv2.cvtColor(active_contour, cv2.COLOR_BGR2GRAY)
 
-    contours, tree = cv2.findContours(active_contour, cv2.RETR_TREE, cv2.CHAIN_APPROX_SIMPLE)
+        contours, tree = cv2.findContours(active_contour, cv2.RETR_TREE, cv2.CHAIN_APPROX_SIMPLE)
 
-    areas = [cv2.contourArea(c) for c in contours]
-    max_index = numpy.argmax(areas)
-    cnt = contours[max_index]
+        areas = [cv2.contourArea(c) for c in contours]
+        max_index = numpy.argmax(areas)
+        cnt = contours[max_index]
 
-    x, y, w, h = cv2.boundingRect(cnt)
+        x, y, w, h = cv2.boundingRect(cnt)
 
     image = image[y:y+h, x:x+w]
 
@@ -67,7 +105,12 @@ def process_leaf(image_path, output_folder="."):
 
     os.remove(temp_img_path)
     os.remove(temp_img_path + "_animation.gif")
-    os.remove(init_mask_path)
     os.remove(temp_img_path + "_final.bmp")
 
+    if init_mask_path is not None:
+        os.remove(init_mask_path)
+
+    if roi_path is not None:
+        os.remove(roi_path)
+
     print "%ssec" % (time.time() - time_s)